@@ -31,6 +31,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/param.h>
 #include <unistd.h>
 
@@ -42,7 +43,15 @@ static void usage(const char * const name, const uint32_t nbufs)
     printf("%s\n", name);
     printf("\t -i interface           interface to run over\n");
     printf("\t[-b]                    optional, busy-wait\n");
+    printf("\t[-B usec]               optional, busy-poll for this long before "
+           "blocking\n");
+    printf("\t[-A usec]               optional, adaptively spin for up to this "
+           "long before blocking\n");
     printf("\t[-z]                    optional, turn off UDP checksums\n");
+    printf("\t[-T file]               optional, trace events and save them to "
+           "file on exit\n");
+    printf("\t[-c file]               optional, capture frames into pcap file "
+           "(raw-Ethernet backends)\n");
     printf("\t[-n buffers]            packet buffers to allocate "
            "(default %u)\n",
            nbufs);
@@ -83,15 +92,19 @@ int
 {
     const char * ifname = 0;
     bool busywait = false;
+    uint64_t busypoll = 0;
+    uint64_t adaptive = 0;
     struct w_sockopt opt = {0};
     uint32_t nbufs = 500000;
+    const char * trace = 0;
+    const char * pcap = 0;
 
     // handle arguments
     int ch;
 #ifndef NDEBUG
-    while ((ch = getopt(argc, argv, "hi:bzn:v:")) != -1) {
+    while ((ch = getopt(argc, argv, "hi:bA:B:zn:T:c:v:")) != -1) {
 #else
-    while ((ch = getopt(argc, argv, "hi:bzn:")) != -1) {
+    while ((ch = getopt(argc, argv, "hi:bA:B:zn:T:c:")) != -1) {
 #endif
         switch (ch) {
         case 'i':
@@ -100,9 +113,21 @@ int
         case 'b':
             busywait = true;
             break;
+        case 'B':
+            busypoll = strtoull(optarg, 0, 10) * NS_PER_US;
+            break;
+        case 'A':
+            adaptive = strtoull(optarg, 0, 10) * NS_PER_US;
+            break;
         case 'z':
             opt.enable_udp_zero_checksums = true;
             break;
+        case 'T':
+            trace = optarg;
+            break;
+        case 'c':
+            pcap = optarg;
+            break;
         case 'n':
             nbufs = (uint32_t)MAX(1, strtoul(optarg, 0, 10));
             break;
@@ -124,6 +149,17 @@ int
 
     // initialize a warpcore engine on the given network interface
     struct w_engine * w = w_init(ifname, 0, nbufs);
+    if (busypoll)
+        w_set_busy_poll(w, busypoll);
+    if (adaptive)
+        w_set_adaptive_poll(w, adaptive);
+    if (trace)
+        w_set_trace(w, 1 << 20);
+    if (pcap) {
+        const int err = w_set_capture(w, pcap, 0);
+        if (err)
+            warn(ERR, "cannot capture into %s: %s", pcap, strerror(err));
+    }
 
     // install a signal handler to clean up after interrupt
     ensure(signal(SIGTERM, &terminate) != SIG_ERR, "signal");
@@ -227,6 +263,11 @@ int
     }
 
     // we only get here after an interrupt; clean up
+    if (trace) {
+        const int err = w_trace_save(w, trace);
+        if (err)
+            warn(ERR, "cannot save trace to %s: %s", trace, strerror(err));
+    }
     w_cleanup(w);
     return 0;
 }
@@ -75,6 +75,10 @@ static void usage(const char * const name,
            conns);
     printf("\t[-z]                    turn off UDP checksums\n");
     printf("\t[-b]                    busy-wait\n");
+    printf("\t[-B usec]               busy-poll for this long before "
+           "blocking\n");
+    printf("\t[-A usec]               adaptively spin for up to this long "
+           "before blocking\n");
 #ifndef NDEBUG
     printf("\t[-v verbosity]          verbosity level (0-%d, default %d)\n",
            DLEVEL, util_dlevel);
@@ -108,15 +112,17 @@ int
     uint32_t end = 1458;
     uint32_t conns = 1;
     bool busywait = false;
+    uint64_t busypoll = 0;
+    uint64_t adaptive = 0;
     struct w_sockopt opt = {0};
     uint32_t nbufs = 500000;
 
     // handle arguments
     int ch;
 #ifndef NDEBUG
-    while ((ch = getopt(argc, argv, "hzbi:d:l:r:s:c:e:p:n:v:")) != -1) {
+    while ((ch = getopt(argc, argv, "hzbA:B:i:d:l:r:s:c:e:p:n:v:")) != -1) {
 #else
-    while ((ch = getopt(argc, argv, "hzbi:d:l:r:s:c:e:p:n:")) != -1) {
+    while ((ch = getopt(argc, argv, "hzbA:B:i:d:l:r:s:c:e:p:n:")) != -1) {
 #endif
         switch (ch) {
         case 'i':
@@ -150,6 +156,12 @@ int
         case 'b':
             busywait = true;
             break;
+        case 'B':
+            busypoll = strtoull(optarg, 0, 10) * NS_PER_US;
+            break;
+        case 'A':
+            adaptive = strtoull(optarg, 0, 10) * NS_PER_US;
+            break;
         case 'z':
             opt.enable_udp_zero_checksums = true;
             break;
@@ -182,6 +194,10 @@ int
 
     // initialize a warpcore engine on the given network interface
     struct w_engine * w = w_init(ifname, rip, nbufs);
+    if (busypoll)
+        w_set_busy_poll(w, busypoll);
+    if (adaptive)
+        w_set_adaptive_poll(w, adaptive);
 
     struct w_sock ** s = calloc(conns, sizeof(struct w_sock *));
     ensure(s, "got sockets");
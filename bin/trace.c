@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <inttypes.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+
+static void usage(const char * const name)
+{
+    printf("%s [-r] file\n", name);
+    printf("\t[-r]                    optional, print times relative to the "
+           "first event\n");
+    printf("\t file                   trace written by w_trace_save()\n");
+}
+
+
+static const char * const drop_name[] = {
+    [W_DROP_NO_BUFS] = "no_bufs",         [W_DROP_NOT_US] = "not_us",
+    [W_DROP_MALFORMED] = "malformed",     [W_DROP_BAD_CKSUM] = "bad_cksum",
+    [W_DROP_UNSUPPORTED] = "unsupported", [W_DROP_NO_SOCK] = "no_sock",
+    [W_DROP_TX_FULL] = "tx_full",         [W_DROP_TX_ERR] = "tx_err",
+    [W_DROP_IMPAIRED] = "impaired",       [W_DROP_TRUNC] = "trunc",
+    [W_DROP_RX_FULL] = "rx_full"};
+
+
+// convert a counter value into nanoseconds, using the calibration samples
+static uint64_t to_ns(const struct w_trace_hdr * const h, const uint64_t tsc)
+{
+    if (h->tsc1 == h->tsc0)
+        return h->ns0;
+    const double scale =
+        (double)(h->ns1 - h->ns0) / (double)(h->tsc1 - h->tsc0);
+    return h->ns0 + (uint64_t)((double)(int64_t)(tsc - h->tsc0) * scale);
+}
+
+
+static void print_ent(const struct w_trace_ent * const e)
+{
+    switch (e->type) {
+    case W_TRACE_RX:
+        printf("rx idx=%" PRIu32 " len=%u\n", e->a, e->b);
+        break;
+    case W_TRACE_DEMUX:
+        printf("demux idx=%" PRIu32 " port=%u\n", e->a, bswap16(e->b));
+        break;
+    case W_TRACE_TX:
+        printf("tx ring=%u slot=%" PRIu32 " len=%u\n", e->c, e->a, e->b);
+        break;
+    case W_TRACE_DROP:
+        printf("drop port=%u reason=%s\n", bswap16(e->b),
+               e->c < W_DROP_CNT ? drop_name[e->c] : "?");
+        break;
+    default:
+        printf("unknown type=%u\n", e->type);
+    }
+}
+
+
+int main(const int argc, char * const argv[])
+{
+    bool relative = false;
+    int ch;
+    while ((ch = getopt(argc, argv, "hr")) != -1) {
+        switch (ch) {
+        case 'r':
+            relative = true;
+            break;
+        case 'h':
+        case '?':
+        default:
+            usage(basename(argv[0]));
+            return 0;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(basename(argv[0]));
+        return 0;
+    }
+
+    FILE * const f = fopen(argv[optind], "rb");
+    ensure(f, "cannot open %s", argv[optind]);
+    struct w_trace_hdr h;
+    ensure(fread(&h, sizeof(h), 1, f) == 1 && h.magic == W_TRACE_MAGIC,
+           "%s is not a warpcore trace", argv[optind]);
+
+    uint64_t t0 = 0;
+    for (uint32_t n = 0; n < h.cnt; n++) {
+        struct w_trace_ent e;
+        if (fread(&e, sizeof(e), 1, f) != 1) {
+            warn(WRN, "%s truncated after %" PRIu32 " events", argv[optind],
+                 n);
+            break;
+        }
+        const uint64_t t = to_ns(&h, e.tsc);
+        if (relative && n == 0)
+            t0 = t;
+        printf("%" PRIu64 ".%09" PRIu64 " ", (t - t0) / NS_PER_S,
+               (t - t0) % NS_PER_S);
+        print_ent(&e);
+    }
+    fclose(f);
+
+    if (h.lost)
+        printf("# %" PRIu64 " earlier events overwritten\n", h.lost);
+    return 0;
+}
@@ -192,6 +192,13 @@ util_rwarn(time_t * const rt0,
            ...);
 
 
+extern void util_log_async(const uint64_t interval);
+
+extern void util_log_drain(void);
+
+extern void util_log_sync(void);
+
+
 #ifndef NDEBUG
 #include <regex.h>
 
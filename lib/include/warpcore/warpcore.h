@@ -209,6 +209,171 @@ struct eth_addr {
 #endif
 
 
+/// Reasons for which warpcore drops a packet, indexing w_stats::drop.
+///
+enum w_drop {
+    W_DROP_NO_BUFS,     ///< No free w_iov to receive or answer into.
+    W_DROP_NOT_US,      ///< Not addressed to a local MAC or IP address.
+    W_DROP_MALFORMED,   ///< Truncated, or with an illegal IP version.
+    W_DROP_BAD_CKSUM,   ///< Invalid IP, UDP or ICMP checksum.
+    W_DROP_UNSUPPORTED, ///< Unhandled protocol, IP options or fragments.
+    W_DROP_NO_SOCK,     ///< No w_sock bound to the destination port.
+    W_DROP_TX_FULL,     ///< TX ring or socket buffer full.
+    W_DROP_TX_ERR,      ///< Transmission failed with an error.
+    W_DROP_IMPAIRED,    ///< Dropped by an impairment, see w_set_impair().
+    W_DROP_TRUNC,       ///< Received datagram larger than a w_iov.
+    W_DROP_RX_FULL,     ///< Kernel socket receive buffer full.
+    W_DROP_CNT          ///< Number of drop reasons.
+};
+
+
+/// Packet counters of a w_engine or w_sock, see w_get_stats(). RX counters
+/// count UDP payloads delivered to a w_sock, TX counters UDP payloads handed
+/// to the kernel or NIC.
+///
+struct w_stats {
+    uint64_t rx_pkts;          ///< Received UDP datagrams.
+    uint64_t rx_bytes;         ///< Received UDP payload bytes.
+    uint64_t tx_pkts;          ///< Transmitted UDP datagrams.
+    uint64_t tx_bytes;         ///< Transmitted UDP payload bytes.
+    uint64_t rx_gro_pkts;      ///< Received UDP datagrams split from UDP GRO.
+    uint64_t drop[W_DROP_CNT]; ///< Dropped packets, by enum w_drop.
+};
+
+
+/// Latencies that w_set_latency_hist() records.
+///
+enum w_hist_type {
+    W_HIST_RX, ///< From w_iov::ts on arrival until returned by w_rx().
+    W_HIST_TX, ///< From w_tx() until the kernel or NIC has taken the w_iov.
+    W_HIST_CNT ///< Number of histogram types.
+};
+
+
+#define W_HIST_SUB_BITS 4 ///< Log2 of the number of buckets per power of two.
+#define W_HIST_BUCKETS ((64 - W_HIST_SUB_BITS + 1) << W_HIST_SUB_BITS)
+
+
+/// A log-linear latency histogram in the style of HdrHistogram. Values below
+/// 2^W_HIST_SUB_BITS ns have a bucket each, and every higher power of two is
+/// split into 2^W_HIST_SUB_BITS buckets, bounding the relative error of a
+/// bucket to 2^-W_HIST_SUB_BITS.
+///
+struct w_hist {
+    uint64_t cnt[W_HIST_BUCKETS]; ///< Number of samples per bucket.
+};
+
+
+/// Types of events in the trace ring, see w_set_trace(). The meaning of the
+/// w_trace_ent fields depends on the type.
+///
+enum w_trace_type {
+    W_TRACE_RX = 1, ///< Frame or datagram received: a = buffer, b = length.
+    W_TRACE_DEMUX,  ///< Payload delivered: a = buffer, b = local port.
+    W_TRACE_TX,     ///< Handed to TX: a = slot or buffer, b = length, c = ring.
+    W_TRACE_DROP    ///< Packet dropped: b = local port or 0, c = enum w_drop.
+};
+
+
+/// An entry in the trace ring. Ports are in network byte order.
+///
+struct w_trace_ent {
+    uint64_t tsc; ///< Timestamp, in ticks of the counter in w_trace_hdr.
+    uint32_t a;   ///< Event argument.
+    uint16_t b;   ///< Event argument.
+    uint8_t c;    ///< Event argument.
+    uint8_t type; ///< Event type, an enum w_trace_type.
+};
+
+
+#define W_TRACE_MAGIC 0x43525457 ///< "WTRC" in little-endian byte order.
+
+
+/// Header of a trace file written by w_trace_save(), which is followed by
+/// w_trace_hdr::cnt struct w_trace_ent, oldest first. Two samples of the
+/// timestamp counter and CLOCK_REALTIME allow converting timestamps into ns.
+///
+struct w_trace_hdr {
+    uint32_t magic; ///< W_TRACE_MAGIC.
+    uint32_t cnt;   ///< Number of entries that follow.
+    uint64_t lost;  ///< Older entries that were overwritten.
+    uint64_t tsc0;  ///< Timestamp counter when tracing was enabled.
+    uint64_t ns0;   ///< CLOCK_REALTIME when tracing was enabled.
+    uint64_t tsc1;  ///< Timestamp counter when the trace was saved.
+    uint64_t ns1;   ///< CLOCK_REALTIME when the trace was saved.
+};
+
+
+/// A classic BPF instruction. Laid out like struct sock_filter and struct
+/// bpf_insn, so the output of "tcpdump -dd" can be used as is.
+///
+struct w_bpf_insn {
+    uint16_t code; ///< Opcode.
+    uint8_t jt;    ///< Jump offset if true.
+    uint8_t jf;    ///< Jump offset if false.
+    uint32_t k;    ///< Generic field.
+};
+
+
+/// Options of a capture tap, see w_set_capture().
+///
+struct w_capture_opt {
+    uint64_t size;                    ///< Capture file size, zero for 64 MB.
+    uint32_t snaplen;                 ///< Bytes per frame, zero for all.
+    uint16_t filter_len;              ///< Number of instructions in @p filter.
+    const struct w_bpf_insn * filter; ///< Frame filter, zero for all frames.
+};
+
+
+/// Options of a pcap replay, see w_replay().
+///
+struct w_replay_opt {
+    /// Number of times to replay the input file. Zero replays it once.
+    uint32_t loops;
+    /// Replay frames at their recorded pace, rather than as fast as possible.
+    uint32_t timed : 1;
+    /// Rewrite the destination MAC and IP addresses of each frame to those of
+    /// the engine, and update the checksums, so that traffic captured on
+    /// another host is accepted.
+    uint32_t retarget : 1;
+    uint32_t : 30;
+};
+
+
+/// Directions of an engine that w_set_impair() can impair.
+///
+enum w_impair_dir {
+    W_IMPAIR_TX, ///< Between w_tx() and the kernel or NIC.
+    W_IMPAIR_RX, ///< Between the kernel or NIC and w_rx().
+    W_IMPAIR_CNT ///< Number of directions.
+};
+
+
+/// Options of an impairment, see w_set_impair(). Probabilities are in parts
+/// per million. A zero-initialized w_impair_opt impairs nothing.
+///
+struct w_impair_opt {
+    /// Probability of losing a datagram. With a non-zero @p p_bad, the loss
+    /// probability while in the good state of a Gilbert-Elliott model.
+    uint32_t loss;
+    /// Probability of moving from the good to the bad state of the
+    /// Gilbert-Elliott model, per datagram. Zero for independent losses.
+    uint32_t p_bad;
+    /// Probability of moving from the bad to the good state, per datagram.
+    uint32_t p_good;
+    /// Probability of losing a datagram while in the bad state.
+    uint32_t loss_bad;
+    uint32_t dup;     ///< Probability of duplicating a datagram.
+    uint32_t reorder; ///< Probability of a datagram skipping @p delay.
+    uint64_t delay;   ///< Delay of each datagram, in ns.
+    uint64_t jitter;  ///< Uniform variation of @p delay, in +/- ns.
+    uint64_t rate;    ///< Rate limit in bit/s of UDP payload, zero for none.
+    /// Maximum number of datagrams held back, zero for no limit other than
+    /// the free w_iovs of the engine. Further datagrams are lost.
+    uint32_t limit;
+};
+
+
 /// A warpcore backend engine.
 ///
 struct w_engine {
@@ -220,7 +385,18 @@ struct w_engine {
     struct eth_addr mac;  ///< Local Ethernet MAC address of the interface.
     // struct eth_addr rip;  ///< Ethernet MAC address of the next-hop router.
 
-    struct w_iov_sq iov; ///< Tail queue of w_iov buffers available.
+    struct w_iov_sq iov;      ///< Tail queue of w_iov buffers available.
+    uint64_t busy_poll;       ///< Busy-poll budget of w_nic_rx(), in ns.
+    uint64_t spin_max;        ///< Max. adaptive spin of w_nic_rx(), in ns.
+    uint64_t spin;            ///< Spin budget of current w_nic_rx(), in ns.
+    uint64_t rx_gap;          ///< Smoothed RX inter-arrival time, in ns.
+    uint64_t rx_last;         ///< Time of the last RX, in ns.
+    struct w_timers * timers; ///< Timing wheel, see w_timer_add().
+    struct w_stats stats;     ///< Engine-wide counters, see w_get_stats().
+    struct w_hist * hist;     ///< Latency histograms, by enum w_hist_type.
+    struct w_trace * trace;   ///< Event trace ring, see w_set_trace().
+    struct w_capture * cap;   ///< Capture tap, see w_set_capture().
+    struct w_impair * imp;    ///< Impairments, see w_set_impair().
 
     sl_entry(w_engine) next;      ///< Pointer to next engine.
     char ifname[IFNAMSIZ];        ///< Name of the interface of this engine.
@@ -263,10 +439,43 @@ struct w_sockopt {
     uint32_t enable_udp_zero_checksums : 1;
     /// Enable ECN, by setting ECT(0) on all packets.
     uint32_t enable_ecn : 1;
-    uint32_t : 27;
+    /// Enable UDP GRO on RX, i.e., let the kernel coalesce inbound datagrams,
+    /// which w_rx() splits again. (Socket backend on Linux only.)
+    uint32_t enable_udp_gro : 1;
+    /// Transmit payloads of at least w_sockopt::zerocopy_min_len bytes with
+    /// MSG_ZEROCOPY. Such w_iovs stay in use until the kernel releases them,
+    /// see w_tx_pending(). (Socket backend on Linux only.)
+    uint32_t enable_zerocopy : 1;
+    /// Do not transmit w_iovs before their w_iov::txtime. The socket backend
+    /// passes the time to the kernel via SO_TXTIME, which needs the fq qdisc
+    /// to take effect; the raw-Ethernet backends hold such w_iovs back in a
+    /// time-ordered queue that w_nic_tx() drains.
+    uint32_t enable_txtime : 1;
+    /// Use kernel RX timestamps for w_iov::ts where the backend can obtain
+    /// them (SO_TIMESTAMPNS on the socket backend), and set w_iov::ts to a
+    /// software timestamp when a w_iov is handed to the kernel or NIC on TX.
+    uint32_t enable_timestamps : 1;
+    /// Bind with SO_REUSEPORT, so that sockets of several engines (usually one
+    /// per thread) can share a port, with the kernel distributing inbound
+    /// packets among them. Only takes effect in w_bind(). (Socket backend.)
+    uint32_t enable_reuseport : 1;
+    /// Do not coalesce w_iovs into UDP GSO super-buffers on TX. The backend
+    /// sets this if the kernel does not support or refuses UDP GSO for the
+    /// w_sock. (Socket backend on Linux only.)
+    uint32_t disable_udp_gso : 1;
+    uint32_t : 21;
     uint32_t user_1 : 1; ///< User flag 1 (not used by warpcore.)
     uint32_t user_2 : 1; ///< User flag 2 (not used by warpcore.)
     uint32_t user_3 : 1; ///< User flag 3 (not used by warpcore.)
+    /// Minimum w_iov length to transmit with MSG_ZEROCOPY, when
+    /// w_sockopt::enable_zerocopy is set. Zero sends all w_iovs that way.
+    uint16_t zerocopy_min_len;
+    /// With w_sockopt::enable_reuseport, steer each inbound packet to the
+    /// socket with index (receiving CPU % reuseport_shards) in its SO_REUSEPORT
+    /// group, i.e., to the socket bound in that position. Bind the socket of
+    /// the engine running on CPU i as the i-th one. Zero keeps the default
+    /// flow hashing of the kernel. (Socket backend on Linux only.)
+    uint16_t reuseport_shards;
 };
 
 
@@ -284,6 +493,26 @@ struct w_sock {
     struct w_sockopt opt;   ///< Socket options.
     intptr_t fd;            ///< Socket descriptor underlying the engine.
     struct w_iov_sq iv;     ///< Tail queue containing incoming unread data.
+    struct w_iov_sq imp_iv; ///< Incoming data released by an RX impairment.
+
+    /// Whether this w_sock is on the ready list of the RX impairment.
+    uint8_t imp_rdy : 1;
+    uint8_t : 7;
+
+    /// Sequence number of the next MSG_ZEROCOPY send on this w_sock.
+    uint32_t zc_seq;
+
+    /// Position of this w_sock in the ready list of a raw-Ethernet backend,
+    /// plus one, or zero if it is not on it. (Internal use.)
+    uint32_t rdy;
+
+    /// Receive-queue drop count the kernel last reported for this w_sock via
+    /// SO_RXQ_OVFL. (Internal use.)
+    uint32_t rx_ovfl;
+
+    /// Counters of this w_sock, see w_get_stats(). Drops that happen before a
+    /// packet has been matched to a w_sock only count against the engine.
+    struct w_stats stats;
 
     sl_entry(w_sock) next; ///< Next socket.
 
@@ -309,7 +538,7 @@ struct w_sock {
 ///
 /// The meta data consists of the length of the payload data, the sender IP
 /// address and port number, the DSCP and ECN bits associated with the IP
-/// packet in which the payload arrived, and the netmap arrival timestamp.
+/// packet in which the payload arrived, and its arrival timestamp.
 ///
 /// The w_iov structure also contains a pointer to the next I/O vector, which
 /// can be used to chain together longer data items for use with w_rx() and
@@ -326,8 +555,19 @@ struct w_iov {
     uint8_t * base;       ///< Absolute start of buffer.
     uint8_t * buf;        ///< Start of payload data.
     sq_entry(w_iov) next; ///< Next w_iov in a w_iov_sq.
-    uint32_t idx;         ///< Index of netmap buffer.
-    uint16_t len;         ///< Length of payload data.
+
+    /// Earliest departure time on TX, in nanoseconds of w_now(CLOCK_MONOTONIC).
+    /// Zero sends immediately. Only honored if w_sockopt::enable_txtime is set.
+    uint64_t txtime;
+
+    /// Arrival time on RX, in nanoseconds of w_now(CLOCK_REALTIME). This is a
+    /// kernel or NIC timestamp where available, and otherwise the time the
+    /// backend took the packet from the kernel or NIC. On TX, the time the
+    /// w_iov was handed to them, if w_sockopt::enable_timestamps is set.
+    uint64_t ts;
+
+    uint32_t idx; ///< Index of netmap buffer.
+    uint16_t len; ///< Length of payload data.
 
     /// DSCP + ECN of the received IP packet on RX, DSCP + ECN to use for the
     /// to-be-transmitted IP packet on TX.
@@ -342,6 +582,34 @@ struct w_iov {
 };
 
 
+/// A timer, to be embedded in application state and armed with w_timer_add().
+/// A zero-initialized w_timer is not pending.
+///
+struct w_timer {
+    /// Function called on expiry, with the w_timer and w_timer::data.
+    void (*cb)(struct w_timer * const t, void * const data);
+    void * data;     ///< Argument for w_timer::cb.
+    uint64_t expiry; ///< Expiry, in nanoseconds of w_now(CLOCK_MONOTONIC).
+    /// @cond
+    struct w_timer * next;  ///< @internal Next timer in the same wheel slot.
+    struct w_timer ** prev; ///< @internal Link to this timer; zero if idle.
+    /// @endcond
+};
+
+
+/// Return whether timer @p t is pending.
+///
+/// @param[in]  t     A w_timer.
+///
+/// @return     True if @p t is pending, false otherwise.
+///
+static inline bool __attribute__((nonnull))
+w_timer_pending(const struct w_timer * const t)
+{
+    return t->prev != 0;
+}
+
+
 #define wv_port saddr.port
 #define wv_af saddr.addr.af
 #define wv_ip4 saddr.addr.ip4
@@ -470,6 +738,63 @@ w_init(const char * const ifname, const uint32_t rip, const uint_t nbufs);
 
 extern void __attribute__((nonnull)) w_cleanup(struct w_engine * const w);
 
+extern void __attribute__((nonnull))
+w_set_batch(struct w_engine * const w, const uint32_t n);
+
+extern void __attribute__((nonnull))
+w_set_busy_poll(struct w_engine * const w, const uint64_t nsec);
+
+extern void __attribute__((nonnull))
+w_set_adaptive_poll(struct w_engine * const w, const uint64_t nsec);
+
+extern void __attribute__((nonnull(1, 3)))
+w_get_stats(const struct w_engine * const w,
+            const struct w_sock * const s,
+            struct w_stats * const st);
+
+extern void __attribute__((nonnull))
+w_set_latency_hist(struct w_engine * const w, const bool enable);
+
+extern void __attribute__((nonnull))
+w_get_latency_hist(const struct w_engine * const w,
+                   const enum w_hist_type t,
+                   struct w_hist * const h);
+
+extern uint64_t __attribute__((nonnull))
+w_hist_quantile(const struct w_hist * const h, const uint32_t ppm);
+
+extern void __attribute__((nonnull))
+w_set_trace(struct w_engine * const w, const uint32_t n);
+
+extern int __attribute__((nonnull))
+w_trace_save(const struct w_engine * const w, const char * const path);
+
+extern int __attribute__((nonnull(1)))
+w_set_capture(struct w_engine * const w,
+              const char * const path,
+              const struct w_capture_opt * const opt);
+
+extern int __attribute__((nonnull(1)))
+w_replay(struct w_engine * const w,
+         const char * const in,
+         const char * const out,
+         const struct w_replay_opt * const opt);
+
+extern int __attribute__((nonnull(1)))
+w_set_impair(struct w_engine * const w,
+             const enum w_impair_dir dir,
+             const struct w_impair_opt * const opt);
+
+extern void __attribute__((nonnull(1, 2, 4)))
+w_timer_add(struct w_engine * const w,
+            struct w_timer * const t,
+            const uint64_t expiry,
+            void (*const cb)(struct w_timer * const, void * const),
+            void * const data);
+
+extern void __attribute__((nonnull))
+w_timer_cancel(struct w_engine * const w, struct w_timer * const t);
+
 extern struct w_sock * __attribute__((nonnull(1)))
 w_bind(struct w_engine * const w,
        const uint16_t addr_idx,
@@ -524,6 +849,8 @@ extern void __attribute__((nonnull)) w_free(struct w_iov_sq * const q);
 
 extern void __attribute__((nonnull)) w_free_iov(struct w_iov * const v);
 
+extern bool __attribute__((nonnull)) w_tx_pending(const struct w_iov * const v);
+
 extern const char * __attribute__((nonnull))
 w_ntop(const struct w_addr * const addr, char * const dst);
 
@@ -68,6 +68,7 @@ arp_is_at(struct w_engine * const w, uint8_t * const buf, const uint32_t ip)
     struct w_iov * const v = w_alloc_iov_base(w);
     if (unlikely(v == 0)) {
         warn(CRT, "no more bufs; ARP reply not sent");
+        count_drop(w, 0, W_DROP_NO_BUFS);
         return;
     }
     struct arp_hdr * const reply = (void *)eth_data(v->base);
@@ -110,6 +111,7 @@ void
     struct w_iov * const v = w_alloc_iov_base(w);
     if (unlikely(v == 0)) {
         warn(CRT, "no more bufs; neighbor request not sent");
+        count_drop(w, 0, W_DROP_NO_BUFS);
         return;
     }
 
@@ -161,12 +163,14 @@ void
     if (arp->hrd != ARP_HRD_ETHER || arp->hln != ETH_LEN) {
         warn(INF, "unhandled ARP hardware format %d with len %d",
              bswap16(arp->hrd), arp->hln);
+        count_drop(w, 0, W_DROP_UNSUPPORTED);
         return;
     }
 
     if (arp->pro != ETH_TYPE_IP4 || arp->pln != IP4_LEN) {
         warn(INF, "unhandled ARP protocol format %d with len %d",
              bswap16(arp->pro), arp->pln);
+        count_drop(w, 0, W_DROP_UNSUPPORTED);
         return;
     }
 
@@ -36,11 +36,18 @@
 
 #ifdef WITH_NETMAP
 #include <net/netmap_user.h>
+#elif defined(WITH_XDP)
+#include <linux/bpf.h>
+#include <linux/if_xdp.h>
+#elif defined(WITH_URING)
+#include <linux/io_uring.h>
 #endif
 
 #include <warpcore/warpcore.h>
 
-#if defined(HAVE_KQUEUE)
+#if defined(WITH_URING)
+#include <sys/socket.h>
+#elif defined(HAVE_KQUEUE)
 #include <sys/event.h>
 #include <time.h>
 #elif defined(HAVE_EPOLL)
@@ -49,31 +56,268 @@
 #include <poll.h>
 #endif
 
-#ifdef WITH_NETMAP
+#ifdef WITH_ETH
+#include <poll.h>
+#endif
+
+#if !defined(WITH_ETH) && !defined(WITH_URING) && defined(__linux__)
+#include <linux/errqueue.h>
+#include <sys/socket.h>
+#if defined(HAVE_SENDMMSG) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define HAVE_ZEROCOPY
+#endif
+#if defined(SO_TXTIME) && defined(SCM_TXTIME)
+#include <linux/net_tstamp.h>
+#define HAVE_TXTIME
+#endif
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+#include <linux/filter.h>
+#define HAVE_REUSEPORT_CBPF
+#endif
+#if defined(SO_BUSY_POLL) && defined(SO_PREFER_BUSY_POLL)
+#define HAVE_BUSY_POLL
+#endif
+#endif
+
+#include "trace.h"
+
+#ifdef WITH_ETH
 #include "arp.h"
+#include "capture.h"
 #include "eth.h"
+#include "flow.h"
 #include "neighbor.h"
 #include "udp.h"
 
-KHASH_INIT(sock,
-           struct w_socktuple *,
-           struct w_sock *,
-           1,
-           w_socktuple_hash,
-           w_socktuple_cmp)
+
+/// An inbound Ethernet frame, as handed by a raw-Ethernet backend to eth_rx().
+///
+struct w_slot {
+    /// Index of the buffer holding the frame. If udp_rx() keeps the frame for
+    /// a w_iov, it replaces this with the index of a spare buffer, which the
+    /// backend must then use for future RX in place of the original one.
+    uint32_t buf_idx;
+    uint16_t len; ///< Length of the frame.
+    /// @cond
+    uint8_t _unused[2]; ///< @internal Padding.
+                        /// @endcond
+    uint64_t ts; ///< Arrival time, in nanoseconds of w_now(CLOCK_REALTIME).
+};
+
+
+/// A w_iov that a raw-Ethernet backend holds back until its w_iov::txtime.
+///
+struct edt_ent {
+    uint64_t t;        ///< Earliest departure time.
+    struct w_sock * s; ///< Socket to transmit on.
+    struct w_iov * v;  ///< The w_iov to transmit.
+    uint32_t seq;      ///< Enqueue order, to keep equal times in FIFO order.
+    uint32_t idx;      ///< Buffer index of @p v when it was queued.
+};
+
+/// Flags in w_backend::edt_st.
+#define EDT_QUEUED 0x01 ///< The w_iov is in the EDT queue.
+#define EDT_HELD 0x02   ///< The application has freed the w_iov.
+#endif
+
+#if !defined(WITH_ETH) && !defined(WITH_URING)
+/// Message vectors that the socket backend keeps across calls, with one slot
+/// per datagram of a send or receive call.
+struct msg_batch {
+    struct iovec * iov;           ///< Payload vectors.
+    struct sockaddr_storage * sa; ///< Peer addresses.
+    uint8_t * ctrl;               ///< Control message space of each slot.
+    struct w_iov ** v;            ///< The w_iov of each slot.
+};
+#endif
+
+#ifdef HAVE_ZEROCOPY
+/// A w_iov in a MSG_ZEROCOPY send that the kernel has not released yet.
+struct zc_pend {
+    struct w_sock * s; ///< Socket the w_iov was sent on; zero once released.
+    uint32_t seq;      ///< Zero-copy sequence number of the send.
+    uint32_t idx;      ///< Index of the w_iov in w_engine::bufs.
+};
+
+/// Flag in w_backend::zc_ref marking a w_iov that the application has freed.
+#define ZC_HELD 0x8000
+#endif
+
+#ifdef WITH_PACKET
+/// Size of a packet buffer, and of a TX ring frame.
+#define PKT_FRAME_SIZE 2048
+#endif
+
+#ifdef WITH_PCAP
+/// Size of a packet buffer of the pcap replay backend.
+#define PCAP_FRAME_SIZE 2048
+#endif
+
+#ifdef WITH_MEM
+/// Size of a packet buffer of the memory backend.
+#define MEM_FRAME_SIZE 2048
+
+/// Number of slots in each direction of a memory pipe.
+#define MEM_RING_SLOTS 1024
+
+/// One direction of a memory pipe, a lock-free single-producer,
+/// single-consumer ring of frames. Each slot always owns a buffer; the receiver
+/// may swap it for a spare one, which the sender fills the next time around.
+///
+struct mem_ring {
+    uint32_t prod __attribute__((aligned(64))); ///< Slots filled by sender.
+    uint32_t cons __attribute__((aligned(64))); ///< Slots drained by receiver.
+    struct w_slot slot[MEM_RING_SLOTS];         ///< Frames.
+};
+
+struct mem_pipe;
+#endif
+
+#ifdef WITH_XDP
+/// Size of a UMEM frame. Each frame holds one packet buffer.
+#define XSK_FRAME_SHIFT 11
+#define XSK_FRAME_SIZE (1U << XSK_FRAME_SHIFT)
+
+/// A producer/consumer ring shared with the kernel AF_XDP socket.
+struct xsk_ring {
+    uint32_t * prod;  ///< Producer index.
+    uint32_t * cons;  ///< Consumer index.
+    uint32_t * flags; ///< Ring flags.
+    void * desc;      ///< Ring entries.
+    void * map;       ///< Mapped ring memory.
+    size_t map_len;   ///< Length of @p map.
+    uint32_t mask;    ///< Ring index mask.
+    uint32_t cached;  ///< Local copy of the index we own.
+};
+#endif
+
+#ifdef WITH_URING
+/// Space for the sender address in front of each received datagram.
+#define URING_NAME_LEN 32
+
+/// Space for the control messages in front of each received datagram.
+#define URING_CTRL_LEN (2 * CMSG_SPACE(sizeof(int)))
+
+/// Space in front of each packet buffer, into which multishot recvmsg places
+/// its struct io_uring_recvmsg_out, the sender address and control messages.
+#define URING_RX_HDR                                                           \
+    (sizeof(struct io_uring_recvmsg_out) + URING_NAME_LEN + URING_CTRL_LEN)
+
+struct uring_tx;
+
+/// Flag in w_backend::tx_ref marking a w_iov that the application has freed.
+#define TX_HELD 0x8000
+#endif
+
+#if defined(WITH_URING) || defined(WITH_ETH)
+/// A growable array of w_sock pointers.
+struct sock_vec {
+    struct w_sock ** s; ///< Array of sockets.
+    uint32_t n;         ///< Number of sockets in @p s.
+    uint32_t cap;       ///< Capacity of @p s.
+};
+#endif
+
+#ifdef WITH_ETH
+struct port_map;
 #endif
 
 
 struct w_backend {
+#ifdef WITH_ETH
+    // state of the userspace Ethernet/IP/UDP stack, shared by all backends
+    // that run it
+    khash_t(neighbor) neighbor; ///< The ARP cache.
+    struct flow_tab sock;       ///< Flow table of the bound w_socks.
+    struct sock_vec rdy;        ///< Sockets with data in w_sock::iv.
+    struct port_map ** port;    ///< Port occupancy, per w_engine::ifaddr.
+    struct edt_ent * edt;       ///< EDT queue, a binary min-heap.
+    struct edt_ent * edt_fin;   ///< Held w_iovs sent, awaiting TX completion.
+    uint8_t * edt_st;           ///< Per w_iov, EDT_QUEUED | EDT_HELD.
+    uint32_t edt_cnt;           ///< Number of entries in @p edt.
+    uint32_t edt_cap;           ///< Capacity of @p edt.
+    uint32_t edt_fin_cnt;       ///< Number of entries in @p edt_fin.
+    uint32_t edt_fin_cap;       ///< Capacity of @p edt_fin.
+    uint32_t edt_seq;           ///< Sequence number for the next EDT entry.
+    uint32_t edt_busy;          ///< Whether edt_tx() is running.
+    uint64_t * tx_t;            ///< Per TX buffer, eth_tx() time (W_HIST_TX).
+#endif
+
 #ifdef WITH_NETMAP
     int fd;                     ///< Netmap file descriptor.
     uint32_t cur_txr;           ///< Index of the TX ring currently active.
     struct netmap_if * nif;     ///< Netmap interface.
     struct nmreq * req;         ///< Netmap request structure.
-    khash_t(neighbor) neighbor; ///< The ARP cache.
     uint32_t * tail;            ///< TX ring tails after last NIOCTXSYNC call.
     struct w_iov *** slot_buf;  ///< For each ring slot, a pointer to its w_iov.
-    khash_t(sock) sock;         ///< List of open (bound) w_sock sockets.
+#elif defined(WITH_XDP)
+    int fd;                     ///< AF_XDP socket.
+    int map_fd;                 ///< XSKMAP steering to @p fd.
+    int prog_fd;                ///< XDP program redirecting into @p map_fd.
+    int link_fd;                ///< Attachment of @p prog_fd to the interface.
+    struct xsk_ring rx;         ///< RX ring.
+    struct xsk_ring tx;         ///< TX ring.
+    struct xsk_ring fr;         ///< Fill ring.
+    struct xsk_ring cr;         ///< Completion ring.
+    struct w_iov ** tx_iov;     ///< For each UMEM frame in TX, its w_iov.
+    uint32_t * tx_spare;        ///< Spare frames to swap into TX w_iovs.
+    uint32_t tx_spare_cnt;      ///< Number of frames in @p tx_spare.
+    uint32_t nframes;           ///< Number of UMEM frames.
+#elif defined(WITH_PACKET)
+    int fd;                     ///< AF_PACKET socket.
+    uint32_t rx_idx;            ///< Buffer the next RX frame is copied into.
+    uint8_t * ring;             ///< Mapped RX ring, followed by the TX ring.
+    size_t ring_len;            ///< Length of @p ring.
+    uint8_t * tx_ring;          ///< Start of the TX ring in @p ring.
+    uint32_t rx_blk;            ///< Index of the next RX block to process.
+    uint32_t tx_cur;            ///< Index of the next TX frame to fill.
+    uint32_t tx_queued;         ///< TX frames filled since the last kick.
+#elif defined(WITH_MEM)
+    struct mem_pipe * pipe;     ///< Pipe shared with the peer engine.
+    struct mem_ring * rx;       ///< Ring the peer engine fills.
+    struct mem_ring * tx;       ///< Ring the peer engine drains.
+#elif defined(WITH_PCAP)
+    uint8_t * in;               ///< Mapped input pcap file.
+    size_t in_len;              ///< Length of @p in.
+    size_t in_pos;              ///< Offset of the next frame record in @p in.
+    uint64_t t0;                ///< Recorded time of the first frame, in ns.
+    uint64_t dur;               ///< Time of the last frame minus @p t0.
+    uint64_t start;             ///< When the current loop started, in ns.
+    uint32_t loops;             ///< Replays of the input left after this one.
+    uint32_t timed : 1;         ///< Replay at the recorded pace.
+    uint32_t in_ns : 1;         ///< Input has nanosecond timestamps.
+    uint32_t in_swap : 1;       ///< Input is in the other byte order.
+    uint32_t : 29;
+    uint32_t rx_idx;            ///< Buffer the next RX frame is copied into.
+    struct w_capture * out;     ///< Output pcap file for TX frames.
+#elif defined(WITH_URING)
+    int fd;                         ///< io_uring file descriptor.
+    uint32_t sq_mask;               ///< SQ ring index mask.
+    uint32_t sq_entries;            ///< Number of SQ ring entries.
+    uint32_t sq_tail;               ///< Local SQ tail, published on submit.
+    uint32_t * sq_khead;            ///< Kernel SQ head.
+    uint32_t * sq_ktail;            ///< Kernel SQ tail.
+    uint32_t * sq_array;            ///< SQ index array.
+    struct io_uring_sqe * sqes;     ///< SQ entries.
+    uint32_t cq_mask;               ///< CQ ring index mask.
+    uint32_t tx_nfree;              ///< Number of free slots in @p tx_free.
+    uint32_t * cq_khead;            ///< Kernel CQ head.
+    uint32_t * cq_ktail;            ///< Kernel CQ tail.
+    struct io_uring_cqe * cqes;     ///< CQ entries.
+    void * ring;                    ///< Mapped SQ and CQ rings.
+    size_t ring_len;                ///< Length of @p ring.
+    struct uring_tx * tx;           ///< Message headers for queued TX SQEs.
+    uint32_t * tx_free;             ///< Indices of the free slots in @p tx.
+    uint16_t * tx_ref;              ///< Per w_iov, sends in flight, | TX_HELD.
+    uint16_t br_mask;               ///< Provided buffer ring index mask.
+    uint16_t br_tail;               ///< Local provided buffer ring tail.
+    uint32_t br_cnt;                ///< Buffers currently in @p br.
+    struct io_uring_buf_ring * br;  ///< Provided buffer ring.
+    struct w_iov ** br_iov;         ///< For each buffer ID, its w_iov.
+    struct msghdr rx_hdr;           ///< Template for multishot recvmsg.
+    struct sock_vec socks;          ///< Open (bound) w_sock sockets.
+    struct sock_vec rearm;          ///< Sockets whose multishot recv ended.
+    struct w_sock * closing;        ///< Socket waiting for its final RX CQE.
 #else
 #if defined(HAVE_KQUEUE)
     struct kevent ev[64]; // XXX arbitrary value
@@ -90,8 +334,36 @@ struct w_backend {
 #endif
     struct w_sock_slist socks;
 #endif
+    uint8_t * gro_buf; ///< Staging area for UDP GRO super-datagrams.
+    bool has_gso;      ///< Whether the kernel supports UDP GSO.
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr * tx_msg; ///< Message headers for sendmmsg().
+#else
+    struct msghdr * tx_msg; ///< Message header for sendmsg().
+#endif
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr * rx_msg; ///< Message headers for recvmmsg().
+#else
+    struct msghdr * rx_msg; ///< Message header for recvmsg().
+#endif
+    struct msg_batch tx; ///< TX slots; w_iovs are the first of each message.
+    struct msg_batch rx; ///< RX slots, with w_iovs posted for receiving.
+#ifdef HAVE_ZEROCOPY
+    uint16_t * zc_ref;   ///< Per w_iov, zero-copy sends in flight, | ZC_HELD.
+    struct zc_pend * zc; ///< Zero-copy sends in flight, oldest first.
+    uint32_t zc_head;    ///< Index of the oldest entry in @p zc.
+    uint32_t zc_cnt;     ///< Number of entries in @p zc.
+    uint32_t zc_cap;     ///< Capacity of @p zc.
+#endif
+    uint32_t batch; ///< Number of slots in @p tx and @p rx.
     int n;
-#ifndef HAVE_KQUEUE
+#if !defined(HAVE_KQUEUE) && defined(HAVE_EPOLL)
+    bool ep_busy_poll; ///< Whether epoll_wait() busy-polls in the kernel.
+    bool ep_no_pwait2; ///< Whether the kernel lacks epoll_pwait2().
+    /// @cond
+    uint8_t _unused[2]; ///< @internal Padding.
+                        /// @endcond
+#elif !defined(HAVE_KQUEUE)
     /// @cond
     uint8_t _unused[4]; ///< @internal Padding.
                         /// @endcond
@@ -100,10 +372,14 @@ struct w_backend {
 };
 
 
-#ifdef WITH_NETMAP
+#ifdef WITH_ETH
 #define max_buf_len(w) (uint16_t)((w)->mtu)
 #define iov_off(w, af)                                                         \
     (sizeof(struct eth_hdr) + ip_hdr_len(af) + sizeof(struct udp_hdr))
+#elif defined(WITH_URING)
+#define max_buf_len(w)                                                         \
+    (uint16_t)(((w)->mtu - 28 + URING_RX_HDR + 7) & ~7U) // keep 8B-aligned
+#define iov_off(w, af) URING_RX_HDR
 #else
 #define max_buf_len(w)                                                         \
     (uint16_t)((w)->mtu - 28) // 28 = min_hdr(IP4, IP6) + UDP hdr
@@ -111,6 +387,176 @@ struct w_backend {
 #endif
 
 
+/// Busy-poll until @p ready is true, for at most the spin budget w_nic_rx()
+/// set for engine @p w, and for at most @p nsec unless that is -1. Deducts
+/// the time spent from a positive @p nsec. Returns false without evaluating
+/// @p ready if the spin budget is zero.
+///
+/// @param      w      Backend engine.
+/// @param      nsec   Remaining timeout of w_nic_rx(), updated in place.
+/// @param      ready  Expression that is true once RX data is pending.
+///
+/// @return     The last value of @p ready.
+///
+#define spin_rx(w, nsec, ready)                                                \
+    __extension__({                                                            \
+        bool _ready = false;                                                   \
+        if ((w)->spin) {                                                       \
+            const uint64_t _t0 = w_now(CLOCK_MONOTONIC);                       \
+            const uint64_t _max =                                              \
+                (nsec) < 0 ? (w)->spin : MIN((w)->spin, (uint64_t)(nsec));     \
+            uint64_t _t;                                                       \
+            do {                                                               \
+                _ready = (ready);                                              \
+                _t = w_now(CLOCK_MONOTONIC) - _t0;                             \
+            } while (_ready == false && _t < _max);                            \
+            if ((nsec) > 0)                                                    \
+                (nsec) -= (int64_t)MIN(_t, (uint64_t)(nsec));                  \
+        }                                                                      \
+        _ready;                                                                \
+    })
+
+
+/// Convert a w_nic_rx() timeout into a struct timespec.
+///
+/// @param[in]  nsec  Timeout in nanoseconds, or -1 for infinite wait.
+/// @param      ts    Struct timespec to fill.
+///
+/// @return     Pointer to @p ts, or zero if @p nsec is -1.
+///
+static inline struct timespec * __attribute__((nonnull))
+to_timespec(const int64_t nsec, struct timespec * const ts)
+{
+    if (nsec < 0)
+        return 0;
+    ts->tv_sec = (time_t)((uint64_t)nsec / NS_PER_S);
+    ts->tv_nsec = (long)((uint64_t)nsec % NS_PER_S);
+    return ts;
+}
+
+
+/// Convert a w_nic_rx() timeout into a millisecond timeout for poll() and
+/// friends. Rounds up, so that a short timeout does not turn into a spin.
+///
+/// @param[in]  nsec  Timeout in nanoseconds, or -1 for infinite wait.
+///
+/// @return     Timeout in milliseconds, or -1 for infinite wait.
+///
+static inline int to_msec(const int64_t nsec)
+{
+    return nsec < 0 ? -1
+                    : (int)MIN(INT32_MAX,
+                               NS_TO_MS((uint64_t)nsec + NS_PER_MS - 1));
+}
+
+
+#ifdef POLLIN
+/// Wait for events on @p fds for up to @p nsec, with nanosecond resolution
+/// where ppoll() is available.
+///
+/// @param      fds   Array of struct pollfd.
+/// @param[in]  n     Number of entries in @p fds.
+/// @param[in]  nsec  Timeout in nanoseconds, or -1 for infinite wait.
+///
+/// @return     Return value of ppoll() or poll().
+///
+static inline int __attribute__((nonnull))
+poll_ns(struct pollfd * const fds, const nfds_t n, const int64_t nsec)
+{
+#ifdef HAVE_PPOLL
+    struct timespec ts;
+    return ppoll(fds, n, to_timespec(nsec, &ts), 0);
+#else
+    return poll(fds, n, to_msec(nsec));
+#endif
+}
+#endif
+
+
+/// Count a UDP payload of @p len bytes received on w_sock @p s.
+///
+/// @param      s     The w_sock the payload was delivered to.
+/// @param[in]  len   Payload length.
+///
+static inline void __attribute__((nonnull))
+count_rx(struct w_sock * const s, const uint16_t len)
+{
+    s->stats.rx_pkts++;
+    s->stats.rx_bytes += len;
+    s->w->stats.rx_pkts++;
+    s->w->stats.rx_bytes += len;
+}
+
+
+/// Count a UDP payload of @p len bytes transmitted over w_sock @p s.
+///
+/// @param      s     The w_sock the payload was sent over.
+/// @param[in]  len   Payload length.
+///
+static inline void __attribute__((nonnull))
+count_tx(struct w_sock * const s, const uint16_t len)
+{
+    s->stats.tx_pkts++;
+    s->stats.tx_bytes += len;
+    s->w->stats.tx_pkts++;
+    s->w->stats.tx_bytes += len;
+}
+
+
+/// Count a packet dropped for reason @p why.
+///
+/// @param      w     Backend engine.
+/// @param      s     The w_sock the packet belonged to, or zero if unknown.
+/// @param[in]  why   Drop reason.
+///
+static inline void __attribute__((nonnull(1)))
+count_drop(struct w_engine * const w,
+           struct w_sock * const s,
+           const enum w_drop why)
+{
+    w->stats.drop[why]++;
+    if (s)
+        s->stats.drop[why]++;
+    trace_ev(w, W_TRACE_DROP, drop, 0, s ? s->ws_lport : 0, why);
+}
+
+
+#ifdef WITH_ETH
+/// Append w_sock @p s, whose w_sock::iv just became non-empty, to the ready
+/// list of its engine, so that w_rx_ready() need not look at idle sockets.
+///
+/// @param      s     The w_sock.
+///
+static inline void __attribute__((nonnull)) rdy_add(struct w_sock * const s)
+{
+    struct sock_vec * const r = &s->w->b->rdy;
+    if (unlikely(r->n == r->cap)) {
+        r->cap = r->cap ? 2 * r->cap : 64;
+        ensure((r->s = realloc(r->s, r->cap * sizeof(*r->s))) != 0,
+               "cannot realloc ready list");
+    }
+    r->s[r->n++] = s;
+    s->rdy = r->n;
+}
+
+
+/// Remove w_sock @p s from the ready list of its engine, if it is on it.
+///
+/// @param      s     The w_sock.
+///
+static inline void __attribute__((nonnull)) rdy_rem(struct w_sock * const s)
+{
+    if (s->rdy == 0)
+        return;
+    struct sock_vec * const r = &s->w->b->rdy;
+    struct w_sock * const last = r->s[--r->n];
+    r->s[s->rdy - 1] = last;
+    last->rdy = s->rdy;
+    s->rdy = 0;
+}
+#endif
+
+
 static inline bool __attribute__((nonnull))
 is_pipe(const struct w_engine * const w
 #ifndef WITH_NETMAP
@@ -142,17 +588,77 @@ idx_to_buf(const struct w_engine * const w, const uint32_t i)
 {
 #ifdef WITH_NETMAP
     return (uint8_t *)NETMAP_BUF(NETMAP_TXRING(w->b->nif, 0), i);
+#elif defined(WITH_XDP)
+    // leave the headroom that AF_XDP copy mode places in front of RX data
+    return (uint8_t *)w->mem + ((intptr_t)i << XSK_FRAME_SHIFT) +
+           XDP_PACKET_HEADROOM;
+#elif defined(WITH_PACKET)
+    return (uint8_t *)w->mem + ((intptr_t)i * PKT_FRAME_SIZE);
+#elif defined(WITH_PCAP)
+    return (uint8_t *)w->mem + ((intptr_t)i * PCAP_FRAME_SIZE);
+#elif defined(WITH_MEM)
+    return (uint8_t *)w->mem + ((intptr_t)i * MEM_FRAME_SIZE);
 #else
     return (uint8_t *)w->mem + ((intptr_t)i * max_buf_len(w));
 #endif
 }
 
 
-static inline uint16_t __attribute__((always_inline)) pick_local_port(void)
+#ifdef HAVE_ZEROCOPY
+/// Check whether the kernel may still read from w_iov @p v after a zero-copy
+/// send. If so, mark @p v to be returned to the free pool once it is released.
+///
+/// @param      v     The w_iov the application is freeing.
+///
+/// @return     Whether @p v must be held back from the free pool.
+///
+static inline bool __attribute__((nonnull)) zc_hold(struct w_iov * const v)
 {
-    // compute a random port >= 1024
-    return bswap16(1024 + (uint16_t)w_rand_uniform32(UINT16_MAX - 1024));
+    uint16_t * const ref = &v->w->b->zc_ref[w_iov_idx(v)];
+    if (likely(*ref == 0))
+        return false;
+    *ref |= ZC_HELD;
+    return true;
 }
+#endif
+
+
+#ifdef WITH_URING
+/// Check whether a sendmsg SQE for w_iov @p v is still in flight. If so, mark
+/// @p v to be returned to the free pool once its CQE has been reaped.
+///
+/// @param      v     The w_iov the application is freeing.
+///
+/// @return     Whether @p v must be held back from the free pool.
+///
+static inline bool __attribute__((nonnull)) tx_hold(struct w_iov * const v)
+{
+    uint16_t * const ref = &v->w->b->tx_ref[w_iov_idx(v)];
+    if (likely(*ref == 0))
+        return false;
+    *ref |= TX_HELD;
+    return true;
+}
+#endif
+
+
+#ifdef WITH_ETH
+/// Check whether w_iov @p v is waiting in the EDT queue. If so, mark @p v to be
+/// returned to the free pool once it has been transmitted.
+///
+/// @param      v     The w_iov the application is freeing.
+///
+/// @return     Whether @p v must be held back from the free pool.
+///
+static inline bool __attribute__((nonnull)) edt_hold(struct w_iov * const v)
+{
+    uint8_t * const st = &v->w->b->edt_st[w_iov_idx(v)];
+    if (likely(*st == 0))
+        return false;
+    *st |= EDT_HELD;
+    return true;
+}
+#endif
 
 
 #define sa_len(f)                                                              \
@@ -196,6 +702,47 @@ backend_init(struct w_engine * const w, const uint32_t nbufs);
 
 extern void __attribute__((nonnull)) backend_cleanup(struct w_engine * const w);
 
+extern void __attribute__((nonnull))
+backend_busy_poll(struct w_engine * const w);
+
+extern bool __attribute__((nonnull))
+backend_nic_rx(struct w_engine * const w, const int64_t nsec);
+
+extern void __attribute__((nonnull))
+backend_rx(struct w_sock * const s, struct w_iov_sq * const i);
+
+extern void __attribute__((nonnull))
+backend_tx(struct w_sock * const s, struct w_iov_sq * const o);
+
+extern void __attribute__((nonnull)) backend_nic_tx(struct w_engine * const w);
+
+extern uint32_t __attribute__((nonnull))
+backend_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl);
+
+#if !defined(WITH_ETH) && !defined(WITH_URING) && !defined(RIOT_VERSION)
+extern void __attribute__((nonnull))
+backend_batch(struct w_engine * const w, const uint32_t n);
+#endif
+
+#ifdef WITH_ETH
+extern void __attribute__((nonnull))
+edt_init(struct w_engine * const w, const uint32_t nbufs);
+
+extern void __attribute__((nonnull)) eth_cleanup(struct w_engine * const w);
+
+extern void __attribute__((nonnull)) edt_tx(struct w_engine * const w);
+
+extern void __attribute__((nonnull)) edt_free(struct w_engine * const w);
+#endif
+
+#ifdef WITH_PCAP
+extern int __attribute__((nonnull(1)))
+replay_open(struct w_engine * const w,
+            const char * const in,
+            const char * const out,
+            const struct w_replay_opt * const opt);
+#endif
+
 extern struct w_sock * __attribute__((nonnull(1, 2)))
 w_get_sock(struct w_engine * const w,
            const struct w_sockaddr * const local,
@@ -0,0 +1,562 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Socket handling shared by the backends that run the warpcore Ethernet/IP/UDP
+// stack over raw Ethernet frames (netmap, AF_XDP, AF_PACKET).
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "backend.h"
+#include "eth.h"
+#include "neighbor.h"
+#include "udp.h"
+
+
+#define PORT_MIN 1024                        ///< Lowest ephemeral port.
+#define PORT_WORDS ((UINT16_MAX + 1) / 64)   ///< Words in port_map::used.
+#define PORT_WORDS_MIN (PORT_MIN / 64)       ///< First ephemeral word.
+#define PORT_REFS_MAX UINT8_MAX              ///< Saturated port_map::refs.
+
+
+/// Port occupancy of one local address. A port shared by PORT_REFS_MAX or more
+/// w_socks saturates its count, which is then recounted from the flow table
+/// whenever one of them is removed.
+struct port_map {
+    uint64_t used[PORT_WORDS];    ///< Bit set for each port in use.
+    uint8_t refs[UINT16_MAX + 1]; ///< Number of w_socks per port.
+};
+
+
+/// Return the port map of local address @p a, allocating it if needed.
+///
+/// @param      w     Backend engine.
+/// @param[in]  a     Local address, one of w_engine::ifaddr.
+///
+/// @return     Port map of @p a.
+///
+static struct port_map * __attribute__((nonnull))
+get_port_map(struct w_engine * const w, const struct w_addr * const a)
+{
+    uint16_t i = 0;
+    while (i < w->addr_cnt && w_addr_cmp(&w->ifaddr[i].addr, a) == false)
+        i++;
+    ensure(i < w->addr_cnt, "%s is not a local address", w_ntop(a, ip_tmp));
+
+    struct w_backend * const b = w->b;
+    if (unlikely(b->port == 0))
+        ensure((b->port = calloc(w->addr_cnt, sizeof(*b->port))) != 0,
+               "cannot alloc port maps");
+    if (unlikely(b->port[i] == 0))
+        ensure((b->port[i] = calloc(1, sizeof(*b->port[i]))) != 0,
+               "cannot alloc port map");
+    return b->port[i];
+}
+
+
+/// Pick a local port for the unbound w_sock @p s. Ports that no other w_sock
+/// on the local address uses are preferred; the bitmap is walked from a
+/// random word with a random odd stride, which visits every word once. Only
+/// if all ports are in use, the same order is walked again for a port whose
+/// four-tuple (or, if @p s is not connected, whose local address and port) is
+/// not yet bound, so that a port can be shared towards different peers.
+///
+/// @param      s     The w_sock to pick a port for.
+///
+/// @return     Port in network byte order, or zero if none is available.
+///
+static uint16_t __attribute__((nonnull)) pick_port(struct w_sock * const s)
+{
+    const struct port_map * const pm = get_port_map(s->w, &s->ws_laddr);
+    const uint32_t start = w_rand_uniform32(PORT_WORDS);
+    const uint32_t stride = w_rand32() | 1;
+    const uint32_t rot = w_rand_uniform32(64);
+
+    for (uint32_t i = 0; i < PORT_WORDS; i++) {
+        const uint32_t wi = (start + i * stride) % PORT_WORDS;
+        const uint64_t avail = ~pm->used[wi];
+        if (wi < PORT_WORDS_MIN || avail == 0)
+            continue;
+        // prefer the first free port at or above the random rotation
+        const uint64_t hi = avail & (UINT64_MAX << rot);
+        const uint32_t bit = (uint32_t)__builtin_ctzll(hi ? hi : avail);
+        return bswap16((uint16_t)(wi * 64 + bit));
+    }
+
+    struct w_sockaddr loc = s->ws_loc;
+    const struct w_sockaddr * const rem = w_connected(s) ? &s->ws_rem : 0;
+    for (uint32_t i = 0; i < PORT_WORDS; i++) {
+        const uint32_t wi = (start + i * stride) % PORT_WORDS;
+        if (wi < PORT_WORDS_MIN)
+            continue;
+        for (uint32_t j = 0; j < 64; j++) {
+            loc.port = bswap16((uint16_t)(wi * 64 + (rot + j) % 64));
+            if (flow_get(&s->w->b->sock, &loc, rem) == 0)
+                return loc.port;
+        }
+    }
+    return 0;
+}
+
+
+/// Free the port maps of engine @p w. All sockets must have been closed.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) port_cleanup(struct w_engine * const w)
+{
+    if (w->b->port == 0)
+        return;
+    for (uint16_t i = 0; i < w->addr_cnt; i++)
+        free(w->b->port[i]);
+    free(w->b->port);
+}
+
+
+/// Count the bound w_socks that share the local address and port of @p s,
+/// up to PORT_REFS_MAX.
+///
+/// @param[in]  s     A w_sock.
+///
+/// @return     Number of w_socks in the flow table using the port of @p s.
+///
+static uint8_t __attribute__((nonnull))
+port_refs(const struct w_sock * const s)
+{
+    uint32_t n = 0;
+    const struct w_sock * t;
+    flow_foreach (t, &s->w->b->sock)
+        if (t->ws_lport == s->ws_lport &&
+            w_addr_cmp(&t->ws_laddr, &s->ws_laddr))
+            n++;
+    return (uint8_t)MIN(n, PORT_REFS_MAX);
+}
+
+
+static void __attribute__((nonnull)) ins_sock(struct w_sock * const s)
+{
+    const bool ins = flow_put(&s->w->b->sock, s);
+    assure(ins, "inserted");
+
+    struct port_map * const pm = get_port_map(s->w, &s->ws_laddr);
+    const uint16_t p = bswap16(s->ws_lport);
+    if (pm->refs[p] == 0)
+        pm->used[p / 64] |= UINT64_C(1) << (p % 64);
+    if (likely(pm->refs[p] < PORT_REFS_MAX))
+        pm->refs[p]++;
+}
+
+
+static void __attribute__((nonnull)) rem_sock(struct w_sock * const s)
+{
+    const bool del = flow_del(&s->w->b->sock, s);
+    assure(del, "found");
+
+    struct port_map * const pm = get_port_map(s->w, &s->ws_laddr);
+    const uint16_t p = bswap16(s->ws_lport);
+    if (unlikely(pm->refs[p] == PORT_REFS_MAX))
+        pm->refs[p] = port_refs(s);
+    else
+        pm->refs[p]--;
+    if (pm->refs[p] == 0)
+        pm->used[p / 64] &= ~(UINT64_C(1) << (p % 64));
+}
+
+
+static inline bool __attribute__((nonnull))
+edt_before(const struct edt_ent * const a, const struct edt_ent * const b)
+{
+    return a->t < b->t || (a->t == b->t && (int32_t)(a->seq - b->seq) < 0);
+}
+
+
+static void __attribute__((nonnull))
+edt_up(struct edt_ent * const h, uint32_t i)
+{
+    const struct edt_ent e = h[i];
+    while (i && edt_before(&e, &h[(i - 1) / 2])) {
+        h[i] = h[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h[i] = e;
+}
+
+
+static void __attribute__((nonnull))
+edt_down(struct edt_ent * const h, const uint32_t n, uint32_t i)
+{
+    const struct edt_ent e = h[i];
+    for (uint32_t c = 2 * i + 1; c < n; i = c, c = 2 * i + 1) {
+        if (c + 1 < n && edt_before(&h[c + 1], &h[c]))
+            c++;
+        if (!edt_before(&h[c], &e))
+            break;
+        h[i] = h[c];
+    }
+    h[i] = e;
+}
+
+
+/// Add w_iov @p v to the EDT queue, to be sent on w_sock @p s at w_iov::txtime.
+///
+/// @param      s     The w_sock to transmit on.
+/// @param      v     The w_iov to transmit.
+///
+static void __attribute__((nonnull))
+edt_push(struct w_sock * const s, struct w_iov * const v)
+{
+    struct w_backend * const b = s->w->b;
+    if (unlikely(b->edt_cnt == b->edt_cap)) {
+        b->edt_cap = b->edt_cap ? 2 * b->edt_cap : 256;
+        ensure((b->edt = realloc(b->edt, b->edt_cap * sizeof(*b->edt))) != 0,
+               "cannot realloc EDT queue");
+    }
+    b->edt[b->edt_cnt] = (struct edt_ent){
+        .t = v->txtime, .s = s, .v = v, .seq = b->edt_seq++, .idx = v->idx};
+    edt_up(b->edt, b->edt_cnt++);
+    b->edt_st[w_iov_idx(v)] = EDT_QUEUED;
+}
+
+
+/// Allocate the EDT state for the @p nbufs w_iovs of engine @p w.
+///
+/// @param      w      Backend engine.
+/// @param[in]  nbufs  Number of w_iovs.
+///
+void edt_init(struct w_engine * const w, const uint32_t nbufs)
+{
+    ensure((w->b->edt_st = calloc(nbufs, sizeof(*w->b->edt_st))) != 0,
+           "cannot alloc EDT state");
+}
+
+
+/// Free the EDT state of engine @p w. All sockets must have been closed.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) edt_cleanup(struct w_engine * const w)
+{
+    free(w->b->edt);
+    free(w->b->edt_fin);
+    free(w->b->edt_st);
+}
+
+
+/// Close all sockets of engine @p w, and free the state of the userspace
+/// Ethernet/IP/UDP stack that the raw-Ethernet backends share.
+///
+/// @param      w     Backend engine.
+///
+void eth_cleanup(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    struct w_sock * s;
+    flow_foreach (s, &b->sock)
+        w_close(s);
+    flow_free(&b->sock);
+    free(b->rdy.s);
+    free(b->tx_t);
+    edt_cleanup(w);
+    port_cleanup(w);
+    free_neighbor(w);
+}
+
+
+/// Move the w_iovs in the EDT queue whose departure time has come into the TX
+/// rings. Stops early if the rings are full.
+///
+/// @param      w     Backend engine.
+///
+void edt_tx(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    // udp_tx() may end up back here via ARP and w_nic_tx()
+    if (likely(b->edt_cnt == 0) || b->edt_busy)
+        return;
+    b->edt_busy = true;
+
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    while (b->edt_cnt && b->edt[0].t <= now) {
+        const struct edt_ent e = b->edt[0];
+        const uint16_t len = e.v->len;
+        if (unlikely(udp_tx(e.s, e.v) == false))
+            break;
+        count_tx(e.s, len);
+        b->edt[0] = b->edt[--b->edt_cnt];
+        edt_down(b->edt, b->edt_cnt, 0);
+
+        uint8_t * const st = &b->edt_st[w_iov_idx(e.v)];
+        if (unlikely(*st & EDT_HELD)) {
+            // the application freed it, so do that once the TX has completed
+            if (unlikely(b->edt_fin_cnt == b->edt_fin_cap)) {
+                b->edt_fin_cap = b->edt_fin_cap ? 2 * b->edt_fin_cap : 64;
+                ensure((b->edt_fin = realloc(b->edt_fin,
+                                             b->edt_fin_cap *
+                                                 sizeof(*b->edt_fin))) != 0,
+                       "cannot realloc EDT list");
+            }
+            b->edt_fin[b->edt_fin_cnt++] = e;
+        }
+        *st = 0;
+    }
+
+    b->edt_busy = false;
+}
+
+
+/// Return the w_iovs that the application freed while they were in the EDT
+/// queue to the free pool, once their transmission has completed.
+///
+/// @param      w     Backend engine.
+///
+void edt_free(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    for (uint32_t i = 0; i < b->edt_fin_cnt;) {
+        struct edt_ent * const e = &b->edt_fin[i];
+        // the TX path swaps a spare buffer into the w_iov until it completes
+        if (e->v->idx == e->idx) {
+            w_free_iov(e->v);
+            *e = b->edt_fin[--b->edt_fin_cnt];
+        } else
+            i++;
+    }
+}
+
+
+/// Set the socket options.
+///
+/// @param      s     The w_sock to change options for.
+/// @param[in]  opt   Socket options for this socket.
+///
+void w_set_sockopt(struct w_sock * const s, const struct w_sockopt * const opt)
+{
+    s->opt = *opt;
+}
+
+
+/// Bind a warpcore socket of a raw-Ethernet backend. Only picks an ephemeral
+/// port if the socket is not bound to a specific port yet.
+///
+/// @param      s     The w_sock to bind.
+/// @param[in]  opt   Socket options for this socket. Can be zero.
+///
+/// @return     Zero on success, @p errno otherwise.
+///
+int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
+{
+    if (unlikely(w_get_sock(s->w, &s->ws_loc, 0))) {
+        warn(INF, "UDP source port %d already in bound", bswap16(s->ws_lport));
+        return 0;
+    }
+
+    if (opt)
+        w_set_sockopt(s, opt);
+
+    if (likely(s->ws_lport == 0)) {
+        s->ws_lport = pick_port(s);
+        if (unlikely(s->ws_lport == 0)) {
+            errno = EADDRINUSE;
+            return EADDRINUSE;
+        }
+    }
+
+    ins_sock(s);
+    return 0;
+}
+
+
+/// Remove the socket from the list of sockets.
+///
+/// @param      s     The w_sock to close.
+///
+void backend_close(struct w_sock * const s)
+{
+    // drop any w_iovs still waiting in the EDT queue for this socket
+    struct w_backend * const b = s->w->b;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < b->edt_cnt; i++) {
+        if (b->edt[i].s != s) {
+            b->edt[n++] = b->edt[i];
+            continue;
+        }
+        uint8_t * const st = &b->edt_st[w_iov_idx(b->edt[i].v)];
+        const bool held = *st & EDT_HELD;
+        *st = 0;
+        if (held)
+            w_free_iov(b->edt[i].v);
+    }
+    if (n != b->edt_cnt) {
+        b->edt_cnt = n;
+        for (uint32_t i = n / 2; i-- > 0;)
+            edt_down(b->edt, n, i);
+    }
+
+    // remove the socket from list of sockets
+    rdy_rem(s);
+    rem_sock(s);
+}
+
+
+void backend_preconnect(struct w_sock * const s)
+{
+    // remove the socket from list of sockets
+    rem_sock(s);
+}
+
+
+/// Connect the given w_sock, using a raw-Ethernet backend. If the Ethernet MAC
+/// address of the destination (or the default router towards it) is not
+/// known, it will block trying to look it up via ARP.
+///
+/// @param      s     w_sock to connect.
+///
+/// @return     Zero on success, @p errno otherwise.
+///
+int backend_connect(struct w_sock * const s)
+{
+    // // find the Ethernet MAC address of the destination or the default
+    // router,
+    // // and update the template header
+    // const uint32_t ip = s->w->rip && (mk_net(s->tup.dip, s->w->mask) !=
+    //                                   mk_net(s->tup.sip, s->w->mask))
+    //                         ? s->w->rip
+    //                         : s->tup.dip;
+    s->dmac = who_has(s->w, &s->ws_raddr);
+
+    // see if we need to update the sport
+    if (unlikely(w_get_sock(s->w, &s->ws_loc, &s->ws_rem))) {
+        // four-tuple exists, pick another sport
+        const uint16_t p = pick_port(s);
+        if (unlikely(p == 0)) {
+            // stay bound, but unconnected
+            memset(&s->ws_rem, 0, sizeof(s->ws_rem));
+            ins_sock(s);
+            return EADDRINUSE;
+        }
+        s->ws_lport = p;
+    }
+
+    ins_sock(s);
+    return 0;
+}
+
+
+/// Return any new data that has been received on a socket by appending it
+/// to the w_iov tail queue @p i. The tail queue must eventually be returned
+/// to warpcore via w_free().
+///
+/// @param      s     w_sock for which the application would like to receive
+/// new
+///                   data.
+/// @param      i     w_iov tail queue to append new data to.
+///
+void backend_rx(struct w_sock * const s, struct w_iov_sq * const i)
+{
+    rdy_rem(s);
+    sq_concat(i, &s->iv);
+}
+
+
+/// Loops over the w_iov structures in the w_iov_sq @p o, sending them all
+/// over w_sock @p s. Places the payloads into IPv4 UDP packets, and
+/// attempts to move them into TX rings. Will force a NIC TX if all rings
+/// are full, retry the failed w_iovs. The (last batch of) packets are not
+/// send yet; w_nic_tx() needs to be called (again) for that. This is, so
+/// that an application has control over exactly when to schedule packet
+/// I/O.
+///
+/// If w_sockopt::enable_txtime is set, w_iovs with a non-zero w_iov::txtime are
+/// instead placed into a time-ordered queue, from which w_nic_tx() moves them
+/// into the TX rings once their departure time has come.
+///
+/// @param      s     w_sock socket to transmit over.
+/// @param      o     w_iov_sq to send.
+///
+void backend_tx(struct w_sock * const s, struct w_iov_sq * const o)
+{
+    struct w_iov * v;
+    sq_foreach (v, o, next) {
+        if (unlikely(s->opt.enable_txtime && v->txtime)) {
+            edt_push(s, v);
+            continue;
+        }
+        const uint16_t len = v->len;
+        while (unlikely(udp_tx(s, v) == false)) {
+            backend_nic_tx(s->w);
+            v->len = len;
+        }
+        count_tx(s, len);
+    }
+}
+
+
+/// Fill a w_sock_slist with pointers to some sockets with pending inbound
+/// data. Data can be obtained via w_rx() on each w_sock in the list. Call
+/// can optionally block to wait for at least one ready connection. Will
+/// return the number of ready connections, or zero if none are ready. When
+/// the return value is not zero, a repeated call may return additional
+/// ready sockets.
+///
+/// @param[in]  w     Backend engine.
+/// @param      sl    Empty and initialized w_sock_slist.
+///
+/// @return     Number of connections that are ready for reading.
+///
+uint32_t backend_rx_ready(struct w_engine * const w,
+                          struct w_sock_slist * const sl)
+{
+    // insert all sockets with pending inbound data, which are on the ready list
+    const struct sock_vec * const r = &w->b->rdy;
+    for (uint32_t i = 0; i < r->n; i++)
+        sl_insert_head(sl, r->s[i], next);
+    return r->n;
+}
+
+
+/// Get the socket bound to the given four-tuple <source IP, source port,
+/// destination IP, destination port>.
+///
+/// @param      w       Backend engine.
+/// @param[in]  local   The local IP address and port.
+/// @param[in]  remote  The remote IP address and port.
+///
+/// @return     The w_sock bound to the given four-tuple.
+///
+struct w_sock * w_get_sock(struct w_engine * const w,
+                           const struct w_sockaddr * const local,
+                           const struct w_sockaddr * const remote)
+{
+    return flow_get(&w->b->sock, local, remote);
+}
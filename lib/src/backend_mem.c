@@ -0,0 +1,283 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#ifdef HAVE_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+#include "backend.h"
+#include "eth.h"
+#include "hist.h"
+#include "ifaddr.h"
+#include "neighbor.h"
+
+
+/// Maximum number of buffers of a pipe and its two engines. Only the address
+/// space is reserved up front.
+#define MEM_PIPE_BUFS (1U << 20)
+
+/// Sleep interval while waiting for the peer engine in backend_nic_rx().
+#define MEM_POLL_NS (50 * NS_PER_US)
+
+
+/// Two engines cross-connected in memory. All buffers of both engines and of
+/// the rings come from one region, so that they can change hands by swapping
+/// buffer indices.
+///
+struct mem_pipe {
+    sl_entry(mem_pipe) next; ///< Next pipe.
+    char ifname[IFNAMSIZ];   ///< Interface the engines take on.
+    uint8_t * mem;           ///< Buffer memory of the pipe and its engines.
+    uint32_t nbufs;          ///< Buffers of @p mem handed out so far.
+    uint32_t refs;           ///< Number of engines on the pipe.
+    struct mem_ring ring[2]; ///< Left-to-right and right-to-left rings.
+};
+
+
+/// Pipes with at least one engine.
+static sl_head(mem_pipes, mem_pipe) pipes = sl_head_initializer(pipes);
+
+
+static inline bool __attribute__((nonnull))
+ring_ready(const struct mem_ring * const r)
+{
+    return __atomic_load_n(&r->prod, __ATOMIC_ACQUIRE) != r->cons;
+}
+
+
+/// Attach engine @p w to the pipe on its interface that is waiting for a peer,
+/// or create such a pipe.
+///
+/// @param      w     Backend engine.
+///
+/// @return     The pipe of @p w.
+///
+static struct mem_pipe * __attribute__((nonnull))
+pipe_attach(struct w_engine * const w)
+{
+    struct mem_pipe * p;
+    sl_foreach (p, &pipes, next)
+        if (p->refs == 1 && strncmp(p->ifname, w->ifname, IFNAMSIZ) == 0) {
+            w->is_right_pipe = true;
+            p->refs++;
+            return p;
+        }
+
+    ensure((p = calloc(1, sizeof(*p))) != 0, "cannot alloc pipe");
+    strncpy(p->ifname, w->ifname, sizeof(p->ifname) - 1);
+    ensure((p->mem = mmap(0, (size_t)MEM_PIPE_BUFS * MEM_FRAME_SIZE,
+                          PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+                          0)) != MAP_FAILED,
+           "cannot reserve pipe memory");
+
+    // give each ring slot a buffer
+    for (uint32_t r = 0; r < 2; r++)
+        for (uint32_t i = 0; i < MEM_RING_SLOTS; i++)
+            p->ring[r].slot[i].buf_idx = p->nbufs++;
+    p->refs = 1;
+    sl_insert_head(&pipes, p, next);
+    return p;
+}
+
+
+/// Initialize the warpcore memory backend for engine @p w. The first engine on
+/// an interface waits for a peer, the second one is cross-connected with it, so
+/// that the frames one engine transmits are received by the other, without any
+/// system calls. Both engines take on the addresses of the interface, so the
+/// pair behaves like two engines on a loopback interface.
+///
+/// @param      w      Backend engine.
+/// @param[in]  nbufs  Number of packet buffers to allocate.
+///
+void backend_init(struct w_engine * const w, const uint32_t nbufs)
+{
+    struct w_backend * const b = w->b;
+
+    backend_addr_config(w);
+    w->mtu = MIN(w->mtu, MEM_FRAME_SIZE - sizeof(struct eth_hdr));
+
+    struct mem_pipe * const p = b->pipe = pipe_attach(w);
+    ensure(MEM_PIPE_BUFS - p->nbufs >= nbufs,
+           "cannot alloc %" PRIu32 " bufs, pipe has %" PRIu32 " left", nbufs,
+           MEM_PIPE_BUFS - p->nbufs);
+    b->tx = &p->ring[w->is_right_pipe];
+    b->rx = &p->ring[!w->is_right_pipe];
+
+    w->mem = p->mem;
+    ensure((w->bufs = calloc(nbufs, sizeof(*w->bufs))) != 0,
+           "cannot alloc bufs");
+    for (uint32_t i = 0; i < nbufs; i++) {
+        init_iov(w, &w->bufs[i], p->nbufs++);
+        sq_insert_head(&w->iov, &w->bufs[i], next);
+        ASAN_POISON_MEMORY_REGION(w->bufs[i].buf, max_buf_len(w));
+    }
+    edt_init(w, nbufs);
+
+    // both engines have the same addresses, so preload the ARP cache
+    for (uint16_t idx = 0; idx < w->addr_cnt; idx++)
+        neighbor_update(w, &w->ifaddr[idx].addr, w->mac);
+
+    w->backend_name = "memory";
+    w->backend_variant = w->is_right_pipe ? "right pipe" : "left pipe";
+}
+
+
+/// Shut a warpcore memory engine down cleanly. The last engine on a pipe
+/// releases the buffer memory.
+///
+/// @param      w     Backend engine.
+///
+void backend_cleanup(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+
+    // close all sockets, and free the state of the userspace stack
+    eth_cleanup(w);
+
+    free(w->bufs);
+    if (--b->pipe->refs)
+        return;
+    sl_remove(&pipes, b->pipe, mem_pipe, next);
+    ensure(munmap(b->pipe->mem, (size_t)MEM_PIPE_BUFS * MEM_FRAME_SIZE) != -1,
+           "cannot munmap pipe memory");
+    free(b->pipe);
+}
+
+
+/// Nothing to do for memory pipes; w_nic_rx() spins on the RX ring instead.
+///
+/// @param      w     Backend engine.
+///
+void backend_busy_poll(struct w_engine * const w __attribute__((unused))) {}
+
+
+/// Places an Ethernet frame into the TX ring, i.e., the RX ring of the peer
+/// engine. The frame is copied into the buffer of the next free slot, so @p v
+/// can be reused immediately.
+///
+/// @param      v     The w_iov containing the Ethernet frame to transmit.
+///
+/// @return     True if the frame was placed into the TX ring, false otherwise.
+///
+bool eth_tx(struct w_iov * const v)
+{
+    struct mem_ring * const r = v->w->b->tx;
+    const uint32_t prod = r->prod;
+    if (unlikely(prod - __atomic_load_n(&r->cons, __ATOMIC_ACQUIRE) ==
+                 MEM_RING_SLOTS)) {
+        warn(NTE, "tx ring is full");
+        return false;
+    }
+
+    struct w_slot * const s = &r->slot[prod % MEM_RING_SLOTS];
+    s->len = v->len + sizeof(struct eth_hdr);
+    s->ts = w_now(CLOCK_REALTIME);
+    uint8_t * const buf = idx_to_buf(v->w, s->buf_idx);
+    ASAN_UNPOISON_MEMORY_REGION(buf, s->len);
+    memcpy(buf, v->base, s->len);
+    cap_tap(v->w, v->base, s->len);
+
+    warn(DBG, "Eth %s -> %s, type 0x%04x, len %u",
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->src, eth_tmp,
+                  ETH_STRLEN),
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->dst, eth_tmp,
+                  ETH_STRLEN),
+         bswap16(((struct eth_hdr *)(void *)v->base)->type), s->len);
+
+    if (unlikely(v->w->hist))
+        hist_add(v->w, W_HIST_TX, s->ts, w_now(CLOCK_REALTIME));
+    trace_ev(v->w, W_TRACE_TX, tx, prod % MEM_RING_SLOTS, v->len, 0);
+    __atomic_store_n(&r->prod, prod + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+/// Hand the frames the peer engine placed into the RX ring to eth_rx(). Since
+/// there is nothing to block on, waits for the peer by sleeping in short
+/// intervals.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
+///                   for infinite wait.
+///
+/// @return     Whether any data is ready for reading.
+///
+bool backend_nic_rx(struct w_engine * const w, const int64_t nsec)
+{
+    struct mem_ring * const r = w->b->rx;
+    int64_t t = nsec;
+again:
+    if (ring_ready(r) == false && spin_rx(w, t, ring_ready(r)) == false) {
+        if (t == 0)
+            return false;
+        const uint64_t d = t < 0 ? MEM_POLL_NS : MIN(MEM_POLL_NS, (uint64_t)t);
+        w_nanosleep(d);
+        if (t > 0)
+            t -= (int64_t)d;
+        goto again;
+    }
+
+    bool rx = false;
+    const uint32_t prod = __atomic_load_n(&r->prod, __ATOMIC_ACQUIRE);
+    for (uint32_t cons = r->cons; cons != prod;) {
+        // if udp_rx() keeps the frame, it swaps a spare buffer into the slot
+        struct w_slot * const s = &r->slot[cons % MEM_RING_SLOTS];
+        rx |= eth_rx(w, s, idx_to_buf(w, s->buf_idx));
+        // return the slot to the peer engine
+        __atomic_store_n(&r->cons, ++cons, __ATOMIC_RELEASE);
+    }
+
+    if (rx == false && nsec == -1)
+        goto again;
+
+    return rx;
+}
+
+
+/// Push data placed in the TX ring via udp_tx() and similar methods to the
+/// peer engine. Due w_iovs from the EDT queue are placed into the TX ring
+/// first.
+///
+/// @param[in]  w     Backend engine.
+///
+void backend_nic_tx(struct w_engine * const w)
+{
+    edt_tx(w);
+    edt_free(w);
+}
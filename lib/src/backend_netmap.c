@@ -52,39 +52,12 @@
 
 #include "backend.h"
 #include "eth.h"
+#include "hist.h"
 #include "ifaddr.h"
 #include "neighbor.h"
 #include "udp.h"
 
 
-static void __attribute__((nonnull)) ins_sock(struct w_sock * const s)
-{
-    int ret;
-    const khiter_t k = kh_put(sock, &s->w->b->sock, &s->tup, &ret);
-    assure(ret >= 1, "inserted is %d", ret);
-    kh_val(&s->w->b->sock, k) = s;
-}
-
-
-static void __attribute__((nonnull)) rem_sock(struct w_sock * const s)
-{
-    const khiter_t k = kh_get(sock, &s->w->b->sock, &s->tup);
-    assure(k != kh_end(&s->w->b->sock), "found");
-    kh_del(sock, &s->w->b->sock, k);
-}
-
-
-/// Set the socket options.
-///
-/// @param      s     The w_sock to change options for.
-/// @param[in]  opt   Socket options for this socket.
-///
-void w_set_sockopt(struct w_sock * const s, const struct w_sockopt * const opt)
-{
-    s->opt = *opt;
-}
-
-
 /// Initialize the warpcore netmap backend for engine @p w. This switches the
 /// interface to netmap mode, maps the underlying buffers into memory and locks
 /// it there, and sets up the extra buffers.
@@ -169,13 +142,15 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
              r->slot[0].buf_idx, r->slot[r->num_slots - 1].buf_idx);
     }
 
-#ifndef NDEBUG
     for (uint32_t ri = 0; likely(ri < b->nif->ni_rx_rings); ri++) {
-        const struct netmap_ring * const r = NETMAP_RXRING(b->nif, ri);
+        struct netmap_ring * const r = NETMAP_RXRING(b->nif, ri);
+        // have the kernel stamp the ring with the time of each RX sync
+        r->flags |= NR_TIMESTAMP;
+#ifndef NDEBUG
         warn(INF, "rx ring %d has %d slots (%d-%d)", ri, r->num_slots,
              r->slot[0].buf_idx, r->slot[r->num_slots - 1].buf_idx);
-    }
 #endif
+    }
 
     // save the indices of the extra buffers in the warpcore structure
     w->bufs = calloc(b->req->nr_arg3, sizeof(*w->bufs));
@@ -193,6 +168,9 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
         warn(WRN, "can only allocate %d/%d extra buffers", b->req->nr_arg3,
              nbufs);
     ensure(b->req->nr_arg3 != 0, "got some extra buffers");
+    edt_init(w, b->req->nr_arg3);
+    ensure((b->tx_t = calloc(b->req->nr_arg3, sizeof(*b->tx_t))) != 0,
+           "cannot alloc TX times");
 
     // lock memory
     ensure(mlockall(MCL_CURRENT | MCL_FUTURE) != -1, "mlockall");
@@ -206,13 +184,8 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
 ///
 void backend_cleanup(struct w_engine * const w)
 {
-    // close all sockets
-    struct w_sock * s;
-    kh_foreach_value(&w->b->sock, s, { w_close(s); });
-    kh_release(sock, &w->b->sock);
-
-    // free ARP cache
-    free_neighbor(w);
+    // close all sockets, and free the state of the userspace stack
+    eth_cleanup(w);
 
     // re-construct the extra bufs list, so netmap can free the memory
     for (uint32_t n = 0; likely(n < sq_len(&w->iov)); n++) {
@@ -240,121 +213,98 @@ void backend_cleanup(struct w_engine * const w)
 }
 
 
-/// Netmap-specific code to bind a warpcore socket. Only computes a random
-/// port number if the socket is not bound to a specific port yet.
+/// Places an Ethernet frame into a TX ring. The Ethernet frame is contained in
+/// the w_iov @p v, and will be placed into an available slot in a TX ring or -
+/// if all are full - dropped.
 ///
-/// @param      s     The w_sock to bind.
-/// @param[in]  opt   Socket options for this socket. Can be zero.
+/// @param      v     The w_iov containing the Ethernet frame to transmit.
 ///
-/// @return     Zero on success, @p errno otherwise.
+/// @return     True if the buffer was placed into a TX ring, false otherwise.
 ///
-int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
+bool eth_tx(struct w_iov * const v)
 {
-    if (unlikely(w_get_sock(s->w, &s->ws_loc, 0))) {
-        warn(INF, "UDP source port %d already in bound", bswap16(s->ws_lport));
-        return 0;
-    }
-
-    if (opt)
-        w_set_sockopt(s, opt);
+    struct w_backend * const b = v->w->b;
+
+    // find a tx ring with space
+    struct netmap_ring * txr = 0;
+    uint32_t r = 0;
+    for (; likely(r < b->nif->ni_tx_rings); r++) {
+        txr = NETMAP_TXRING(b->nif, b->cur_txr);
+        if (likely(!nm_ring_empty(txr)))
+            // we have space in this ring
+            break;
 
-    if (likely(s->ws_lport == 0))
-        s->ws_lport = pick_local_port();
+        warn(INF, "tx ring %u full; moving to next", b->cur_txr);
+        b->cur_txr = (b->cur_txr + 1) % b->nif->ni_tx_rings;
+    }
 
-    ins_sock(s);
-    return 0;
-}
+    // return false if all rings are full
+    if (unlikely(r == b->nif->ni_tx_rings)) {
+        warn(NTE, "all tx rings are full");
+        return false;
+    }
 
+    struct netmap_slot * const s = &txr->slot[txr->cur];
+    b->slot_buf[txr->ringid][txr->cur] = v;
+    trace_ev(v->w, W_TRACE_TX, tx, txr->cur, v->len, txr->ringid);
+    if (unlikely(v->w->hist))
+        b->tx_t[w_iov_idx(v)] = w_now(CLOCK_REALTIME);
+    s->len = v->len + sizeof(struct eth_hdr);
+    cap_tap(v->w, v->base, s->len);
 
-/// The netmap backend performs no operation here.
-///
-/// @param      s     The w_sock to close.
-///
-void backend_close(struct w_sock * const s)
-{
-    // remove the socket from list of sockets
-    rem_sock(s);
-}
+    warn(DBG, "Eth %s -> %s, type 0x%04x, len %u",
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->src, eth_tmp,
+                  ETH_STRLEN),
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->dst, eth_tmp,
+                  ETH_STRLEN),
+         bswap16(((struct eth_hdr *)(void *)v->base)->type), s->len);
 
 
-void backend_preconnect(struct w_sock * const s)
-{
-    // remove the socket from list of sockets
-    rem_sock(s);
-}
+    if (unlikely(is_pipe(v->w))) {
+#if 0
+        warn(DBG, "copying iov idx %u into tx ring %u slot %d (into %u)",
+             v->idx, b->cur_txr, txr->cur, s->buf_idx);
+#endif
+        memcpy(NETMAP_BUF(txr, s->buf_idx), v->base, s->len);
 
+    } else {
+#if 0
+        warn(DBG, "placing iov idx %u into tx ring %u slot %d (swap with %u)",
+             v->idx, b->cur_txr, txr->cur, s->buf_idx);
+#endif
 
-/// Connect the given w_sock, using the netmap backend. If the Ethernet MAC
-/// address of the destination (or the default router towards it) is not
-/// known, it will block trying to look it up via ARP.
-///
-/// @param      s     w_sock to connect.
-///
-/// @return     Zero on success, @p errno otherwise.
-///
-int backend_connect(struct w_sock * const s)
-{
-    // // find the Ethernet MAC address of the destination or the default
-    // router,
-    // // and update the template header
-    // const uint32_t ip = s->w->rip && (mk_net(s->tup.dip, s->w->mask) !=
-    //                                   mk_net(s->tup.sip, s->w->mask))
-    //                         ? s->w->rip
-    //                         : s->tup.dip;
-    s->dmac = who_has(s->w, &s->ws_raddr);
-
-    // see if we need to update the sport
-    uint8_t n = 200;
-    while (n--) {
-        if (likely(w_get_sock(s->w, &s->ws_loc, &s->ws_rem) == 0))
-            break;
-        // four-tuple exists, reroll sport
-        s->ws_lport = pick_local_port();
+        // temporarily place v into the current tx ring
+        const uint32_t slot_idx = s->buf_idx;
+        s->buf_idx = v->idx;
+        v->idx = slot_idx;
+        s->flags = NS_BUF_CHANGED;
+        if (unlikely(nm_ring_space(txr) == 1 || sq_next(v, next) == 0)) {
+            // we are using the last slot in this ring, or this is the last
+            // w_iov in this batch - mark the slot for reporting
+            s->flags |= NS_REPORT;
+        }
     }
 
-    if (likely(n))
-        ins_sock(s);
-
-    return n == 0;
+    // advance tx ring
+    txr->head = txr->cur = nm_ring_next(txr, txr->cur);
+    return true;
 }
 
 
-/// Return any new data that has been received on a socket by appending it
-/// to the w_iov tail queue @p i. The tail queue must eventually be returned
-/// to warpcore via w_free().
-///
-/// @param      s     w_sock for which the application would like to receive
-/// new
-///                   data.
-/// @param      i     w_iov tail queue to append new data to.
+/// Sync the RX rings without poll(), and check whether any holds new data.
 ///
-void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
-{
-    sq_concat(i, &s->iv);
-}
-
-
-/// Loops over the w_iov structures in the w_iov_sq @p o, sending them all
-/// over w_sock @p s. Places the payloads into IPv4 UDP packets, and
-/// attempts to move them into TX rings. Will force a NIC TX if all rings
-/// are full, retry the failed w_iovs. The (last batch of) packets are not
-/// send yet; w_nic_tx() needs to be called (again) for that. This is, so
-/// that an application has control over exactly when to schedule packet
-/// I/O.
+/// @param[in]  w     Backend engine.
 ///
-/// @param      s     w_sock socket to transmit over.
-/// @param      o     w_iov_sq to send.
+/// @return     Whether any RX ring is non-empty.
 ///
-void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
+static bool __attribute__((nonnull))
+nm_rx_sync(const struct w_engine * const w)
 {
-    struct w_iov * v;
-    sq_foreach (v, o, next) {
-        const uint16_t len = v->len;
-        while (unlikely(udp_tx(s, v) == false)) {
-            w_nic_tx(s->w);
-            v->len = len;
-        }
-    }
+    ensure(ioctl(w->b->fd, NIOCRXSYNC, 0) != -1, "cannot sync rx rings");
+    for (uint32_t i = 0; likely(i < w->b->nif->ni_rx_rings); i++)
+        if (!nm_ring_empty(NETMAP_RXRING(w->b->nif, i)))
+            return true;
+    return false;
 }
 
 
@@ -367,25 +317,37 @@ void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
 ///
 /// @return     Whether any data is ready for reading.
 ///
-bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
+bool backend_nic_rx(struct w_engine * const w, const int64_t nsec)
 {
     struct pollfd fds = {.fd = w->b->fd, .events = POLLIN};
+    int64_t t = nsec;
 again:
-    if (poll(&fds, 1, nsec < 0 ? -1 : (int)(nsec / NS_PER_MS)) == 0)
+    // when busy-polling, sync the RX rings directly rather than via poll()
+    if (spin_rx(w, t, nm_rx_sync(w)) == false &&
+        ((w->spin && t == 0) || poll_ns(&fds, 1, t) == 0))
         return false;
 
     // loop over all rx rings
     bool rx = false;
     for (uint32_t i = 0; likely(i < w->b->nif->ni_rx_rings); i++) {
         struct netmap_ring * const r = NETMAP_RXRING(w->b->nif, i);
+        const uint64_t ts = (uint64_t)r->ts.tv_sec * NS_PER_S +
+                            (uint64_t)r->ts.tv_usec * NS_PER_US;
         while (likely(!nm_ring_empty(r))) {
 #if 0
             warn(DBG, "rx idx %u from ring %u slot %u", r->slot[r->cur].buf_idx,
                  i, r->cur);
 #endif
             // process the current slot
-            rx = eth_rx(w, &r->slot[r->cur],
-                        (uint8_t *)NETMAP_BUF(r, r->slot[r->cur].buf_idx));
+            struct netmap_slot * const ns = &r->slot[r->cur];
+            struct w_slot s = {
+                .buf_idx = ns->buf_idx, .len = ns->len, .ts = ts};
+            rx = eth_rx(w, &s, (uint8_t *)NETMAP_BUF(r, ns->buf_idx));
+            if (s.buf_idx != ns->buf_idx) {
+                // udp_rx() swapped a spare buffer into the slot
+                ns->buf_idx = s.buf_idx;
+                ns->flags = NS_BUF_CHANGED;
+            }
             r->head = r->cur = nm_ring_next(r, r->cur);
         }
     }
@@ -397,14 +359,22 @@ again:
 }
 
 
+/// Nothing to do for netmap; w_nic_rx() busy-polls with NIOCRXSYNC.
+///
+/// @param      w     Backend engine.
+///
+void backend_busy_poll(struct w_engine * const w __attribute__((unused))) {}
+
+
 /// Push data placed in the TX rings via udp_tx() and similar methods out
 /// onto the link. Also move any transmitted data back into the original
-/// w_iovs.
+/// w_iovs. Due w_iovs from the EDT queue are placed into the TX rings first.
 ///
 /// @param[in]  w     Backend engine.
 ///
-void w_nic_tx(struct w_engine * const w)
+void backend_nic_tx(struct w_engine * const w)
 {
+    edt_tx(w);
     ensure(ioctl(w->b->fd, NIOCTXSYNC, 0) != -1, "cannot kick tx ring");
 
     if (unlikely(is_pipe(w)))
@@ -412,6 +382,7 @@ void w_nic_tx(struct w_engine * const w)
 
     // grab the transmitted data out of the NIC rings and place it back into
     // the original w_iov_sqs, so it's not lost to the app
+    const uint64_t now = unlikely(w->hist) ? w_now(CLOCK_REALTIME) : 0;
     for (uint32_t i = 0; likely(i < w->b->nif->ni_tx_rings); i++) {
         struct netmap_ring * const r = NETMAP_TXRING(w->b->nif, i);
 #if 0
@@ -425,6 +396,8 @@ void w_nic_tx(struct w_engine * const w)
              likely(j != nm_ring_next(r, r->tail)); j = nm_ring_next(r, j)) {
             struct netmap_slot * const s = &r->slot[j];
             struct w_iov * const v = w->b->slot_buf[r->ringid][j];
+            if (unlikely(now) && w->b->tx_t[w_iov_idx(v)])
+                hist_add(w, W_HIST_TX, w->b->tx_t[w_iov_idx(v)], now);
 #if 0
             warn(DBG, "move idx %u from ring %u slot %u to w_iov (swap w/%u)",
                  s->buf_idx, i, j, v->idx);
@@ -439,52 +412,6 @@ void w_nic_tx(struct w_engine * const w)
         // remember current tail
         w->b->tail[i] = r->tail;
     }
-}
-
-
-/// Fill a w_sock_slist with pointers to some sockets with pending inbound
-/// data. Data can be obtained via w_rx() on each w_sock in the list. Call
-/// can optionally block to wait for at least one ready connection. Will
-/// return the number of ready connections, or zero if none are ready. When
-/// the return value is not zero, a repeated call may return additional
-/// ready sockets.
-///
-/// @param[in]  w     Backend engine.
-/// @param      sl    Empty and initialized w_sock_slist.
-///
-/// @return     Number of connections that are ready for reading.
-///
-uint32_t w_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
-{
-    // insert all sockets with pending inbound data
-    struct w_sock * s;
-    uint32_t n = 0;
-    kh_foreach_value(&w->b->sock, s, {
-        if (!sq_empty(&s->iv)) {
-            sl_insert_head(sl, s, next);
-            n++;
-        }
-    });
-    return n;
-}
-
 
-/// Get the socket bound to the given four-tuple <source IP, source port,
-/// destination IP, destination port>.
-///
-/// @param      w       Backend engine.
-/// @param[in]  local   The local IP address and port.
-/// @param[in]  remote  The remote IP address and port.
-///
-/// @return     The w_sock bound to the given four-tuple.
-///
-struct w_sock * w_get_sock(struct w_engine * const w,
-                           const struct w_sockaddr * const local,
-                           const struct w_sockaddr * const remote)
-{
-    struct w_socktuple tup = {.local = *local};
-    if (remote)
-        tup.remote = *remote;
-    const khiter_t k = kh_get(sock, &w->b->sock, &tup);
-    return unlikely(k == kh_end(&w->b->sock)) ? 0 : kh_val(&w->b->sock, k);
+    edt_free(w);
 }
@@ -0,0 +1,462 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+#ifdef HAVE_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+#include "backend.h"
+#include "eth.h"
+#include "ifaddr.h"
+#include "in_cksum.h"
+#include "ip4.h"
+#include "ip6.h"
+#include "neighbor.h"
+#include "udp.h"
+
+
+#define PCAP_RX_BATCH 64 ///< Maximum number of frames per backend_nic_rx().
+
+
+/// Return the record at the current input position of engine backend @p b, in
+/// host byte order, with the frame following it.
+///
+/// @param      b     Engine backend.
+/// @param[out] r     Record header.
+///
+/// @return     The frame of @p r, or zero if there is no complete record left.
+///
+static uint8_t * __attribute__((nonnull))
+next_rec(const struct w_backend * const b, struct pcap_rec * const r)
+{
+    if (b->in_len - b->in_pos < sizeof(*r))
+        return 0;
+    memcpy(r, b->in + b->in_pos, sizeof(*r));
+    if (b->in_swap) {
+        r->sec = bswap32(r->sec);
+        r->nsec = bswap32(r->nsec);
+        r->incl_len = bswap32(r->incl_len);
+        r->orig_len = bswap32(r->orig_len);
+    }
+    if (b->in_len - b->in_pos - sizeof(*r) < r->incl_len)
+        return 0;
+    return b->in + b->in_pos + sizeof(*r);
+}
+
+
+/// Return the timestamp of record @p r in nanoseconds.
+///
+/// @param      b     Engine backend.
+/// @param[in]  r     Record header.
+///
+/// @return     Timestamp of @p r.
+///
+static inline uint64_t __attribute__((nonnull))
+rec_ns(const struct w_backend * const b, const struct pcap_rec * const r)
+{
+    return (uint64_t)r->sec * NS_PER_S +
+           (b->in_ns ? r->nsec : (uint64_t)r->nsec * NS_PER_US);
+}
+
+
+/// Add the source MAC and IP address of the frame in @p buf to the neighbor
+/// cache of engine @p w, unless there already is an entry for the address.
+///
+/// @param      w     Backend engine.
+/// @param[in]  buf   Ethernet frame, copied into an aligned buffer.
+/// @param[in]  len   Length of @p buf.
+///
+static void __attribute__((nonnull))
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+    __attribute__((no_sanitize("alignment")))
+#endif
+    learn(struct w_engine * const w, uint8_t * const buf, const uint32_t len)
+{
+    const struct eth_hdr * const eth = (const void *)buf;
+    struct w_addr a;
+    if (eth->type == ETH_TYPE_IP4 &&
+        len >= sizeof(*eth) + sizeof(struct ip4_hdr)) {
+        a.af = AF_INET;
+        a.ip4 = ((const struct ip4_hdr *)(void *)eth_data(buf))->src;
+    } else if (eth->type == ETH_TYPE_IP6 &&
+               len >= sizeof(*eth) + sizeof(struct ip6_hdr)) {
+        a.af = AF_INET6;
+        memcpy(a.ip6, ((const struct ip6_hdr *)(void *)eth_data(buf))->src,
+               IP6_LEN);
+    } else
+        return;
+
+    if (kh_get(neighbor, &w->b->neighbor, &a) == kh_end(&w->b->neighbor))
+        neighbor_update(w, &a, eth->src);
+}
+
+
+/// Rewrite the destination MAC and IP address of the frame in @p buf to those
+/// of engine @p w, and update the IPv4 and UDP checksums to match.
+///
+/// @param      w     Backend engine.
+/// @param      buf   Ethernet frame, copied into an aligned buffer.
+/// @param[in]  len   Length of @p buf.
+///
+static void __attribute__((nonnull))
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+    __attribute__((no_sanitize("alignment")))
+#endif
+    retarget(const struct w_engine * const w,
+             uint8_t * const buf,
+             const uint32_t len)
+{
+    struct eth_hdr * const eth = (void *)buf;
+    eth->dst = w->mac;
+
+    uint16_t ip_hdr_len;
+    struct udp_hdr * udp = 0;
+    if (eth->type == ETH_TYPE_IP4 && w->have_ip4 &&
+        len >= sizeof(*eth) + sizeof(struct ip4_hdr)) {
+        struct ip4_hdr * const ip = (void *)eth_data(buf);
+        ip_hdr_len = ip4_hl(ip->vhl);
+        if (len < sizeof(*eth) + ip_hdr_len)
+            return;
+        ip->dst = w->ifaddr[w->addr4_pos].addr.ip4;
+        ip->cksum = 0;
+        ip->cksum = ip_cksum(ip, ip_hdr_len);
+        if (ip->p == IP_P_UDP && (ip->off & IP4_OFFMASK) == 0)
+            udp = (void *)ip4_data(buf);
+
+    } else if (eth->type == ETH_TYPE_IP6 && w->have_ip6 &&
+               len >= sizeof(*eth) + sizeof(struct ip6_hdr)) {
+        struct ip6_hdr * const ip = (void *)eth_data(buf);
+        ip_hdr_len = sizeof(*ip);
+        memcpy(ip->dst, w->ifaddr[0].addr.ip6, IP6_LEN);
+        if (ip->next_hdr == IP_P_UDP)
+            udp = (void *)ip6_data(buf);
+
+    } else
+        return;
+
+    // update the UDP checksum, unless the sender disabled it
+    if (udp == 0 || udp->cksum == 0 ||
+        len < sizeof(*eth) + ip_hdr_len + bswap16(udp->len))
+        return;
+    udp->cksum = 0;
+    udp->cksum = payload_cksum(eth_data(buf), ip_hdr_len + bswap16(udp->len));
+}
+
+
+/// Stop replaying the current input file of engine @p w, if any, and close the
+/// output file.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) replay_close(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    if (b->in)
+        ensure(munmap(b->in, b->in_len) != -1, "cannot munmap pcap input");
+    if (b->out)
+        cap_close(b->out);
+    b->in = 0;
+    b->out = 0;
+    b->in_len = b->in_pos = 0;
+}
+
+
+/// Map pcap file @p in for replay by engine @p w. The input is mapped
+/// privately, so retargeting does not modify the file. All records are checked
+/// up front, so backend_nic_rx() can trust the record headers.
+///
+/// @param      w     Backend engine.
+/// @param[in]  in    Input pcap file, or zero to stop replaying.
+/// @param[in]  out   Output pcap file for transmitted frames, or zero.
+/// @param[in]  opt   Replay options, or zero for the defaults.
+///
+/// @return     Zero on success, @p errno otherwise.
+///
+int replay_open(struct w_engine * const w,
+                const char * const in,
+                const char * const out,
+                const struct w_replay_opt * const opt)
+{
+    struct w_backend * const b = w->b;
+    replay_close(w);
+    if (in == 0)
+        return 0;
+
+    const int fd = open(in, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return errno;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        const int err = errno;
+        close(fd);
+        return err;
+    }
+    if ((size_t)st.st_size < sizeof(struct pcap_hdr)) {
+        close(fd);
+        return EINVAL;
+    }
+    void * const map = mmap(0, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE, fd, 0);
+    const int err = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+        return err;
+    b->in = map;
+    b->in_len = (size_t)st.st_size;
+
+    struct pcap_hdr h;
+    memcpy(&h, b->in, sizeof(h));
+    b->in_ns = h.magic == PCAP_MAGIC_NS || h.magic == bswap32(PCAP_MAGIC_NS);
+    b->in_swap =
+        h.magic == bswap32(PCAP_MAGIC_US) || h.magic == bswap32(PCAP_MAGIC_NS);
+    if ((h.magic != PCAP_MAGIC_US && b->in_ns == false &&
+         b->in_swap == false) ||
+        (b->in_swap ? bswap32(h.link) : h.link) != PCAP_LINK_ETH) {
+        warn(ERR, "%s is not a pcap file of Ethernet frames", in);
+        replay_close(w);
+        return EINVAL;
+    }
+
+    // walk the input once, learning neighbors and retargeting frames
+    uint32_t n = 0;
+    struct pcap_rec r;
+    uint8_t * f;
+    b->dur = 0;
+    for (b->in_pos = sizeof(h); (f = next_rec(b, &r)) != 0;
+         b->in_pos += sizeof(r) + r.incl_len, n++) {
+        const uint64_t t = rec_ns(b, &r);
+        if (n == 0)
+            b->t0 = t;
+        if (t > b->t0)
+            b->dur = MAX(b->dur, t - b->t0);
+        if (r.incl_len > PCAP_FRAME_SIZE)
+            continue;
+        // the frame may not be aligned in the file
+        uint8_t buf[PCAP_FRAME_SIZE] __attribute__((aligned(8)));
+        memcpy(buf, f, r.incl_len);
+        learn(w, buf, r.incl_len);
+        if (opt && opt->retarget) {
+            retarget(w, buf, r.incl_len);
+            memcpy(f, buf, r.incl_len);
+        }
+    }
+    if (b->in_pos != b->in_len) {
+        warn(WRN, "ignoring truncated record at end of %s", in);
+        b->in_len = b->in_pos;
+    }
+
+    if (out) {
+        const int ret = cap_open(&b->out, out, 0);
+        if (ret) {
+            replay_close(w);
+            return ret;
+        }
+    }
+
+    b->in_pos = sizeof(h);
+    b->start = 0;
+    b->loops = opt && opt->loops ? opt->loops - 1 : 0;
+    b->timed = opt && opt->timed;
+    warn(NTE, "replaying %" PRIu32 " frame%s from %s", n, plural(n), in);
+    return 0;
+}
+
+
+/// Initialize the warpcore pcap replay backend for engine @p w. The engine has
+/// no link; it takes on the addresses of interface w_engine::ifname, receives
+/// the frames of a pcap file handed to w_replay(), and writes the frames it
+/// transmits into another.
+///
+/// @param      w      Backend engine.
+/// @param[in]  nbufs  Number of packet buffers to allocate.
+///
+void backend_init(struct w_engine * const w, const uint32_t nbufs)
+{
+    struct w_backend * const b = w->b;
+
+    backend_addr_config(w);
+    w->mtu = MIN(w->mtu, PCAP_FRAME_SIZE - sizeof(struct eth_hdr));
+
+    // one more buffer than requested, to copy inbound frames into
+    ensure((w->mem = calloc(nbufs + 1, PCAP_FRAME_SIZE)) != 0,
+           "cannot alloc %" PRIu32 " * %u buf mem", nbufs + 1, PCAP_FRAME_SIZE);
+    ensure((w->bufs = calloc(nbufs, sizeof(*w->bufs))) != 0,
+           "cannot alloc bufs");
+    for (uint32_t i = 0; i < nbufs; i++) {
+        init_iov(w, &w->bufs[i], i);
+        sq_insert_head(&w->iov, &w->bufs[i], next);
+        ASAN_POISON_MEMORY_REGION(w->bufs[i].buf, max_buf_len(w));
+    }
+    b->rx_idx = nbufs;
+    edt_init(w, nbufs);
+
+    // our own addresses need no resolution
+    for (uint16_t idx = 0; idx < w->addr_cnt; idx++)
+        neighbor_update(w, &w->ifaddr[idx].addr, w->mac);
+
+    w->backend_name = "pcap";
+    w->backend_variant = "replay";
+}
+
+
+/// Shut a warpcore pcap replay engine down cleanly.
+///
+/// @param      w     Backend engine.
+///
+void backend_cleanup(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+
+    // close all sockets, and free the state of the userspace stack
+    eth_cleanup(w);
+
+    replay_close(w);
+    free(w->mem);
+    free(w->bufs);
+}
+
+
+/// Nothing to do for pcap replay, which has no kernel to poll.
+///
+/// @param      w     Backend engine.
+///
+void backend_busy_poll(struct w_engine * const w __attribute__((unused))) {}
+
+
+/// Appends an Ethernet frame to the output pcap file, if any. There is no link,
+/// so the frame is "transmitted" immediately and @p v can be reused right away.
+///
+/// @param      v     The w_iov containing the Ethernet frame to transmit.
+///
+/// @return     True.
+///
+bool eth_tx(struct w_iov * const v)
+{
+    struct w_backend * const b = v->w->b;
+    const uint16_t len = v->len + sizeof(struct eth_hdr);
+
+    warn(DBG, "Eth %s -> %s, type 0x%04x, len %u",
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->src, eth_tmp,
+                  ETH_STRLEN),
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->dst, eth_tmp,
+                  ETH_STRLEN),
+         bswap16(((struct eth_hdr *)(void *)v->base)->type), len);
+
+    trace_ev(v->w, W_TRACE_TX, tx, v->idx, v->len, 0);
+    cap_tap(v->w, v->base, len);
+    if (b->out)
+        cap_frame(b->out, v->base, len);
+    return true;
+}
+
+
+/// Hand the next frames of the input pcap file to eth_rx(), as if they had just
+/// been received. When replaying at the recorded pace, waits up to @p nsec for
+/// the next frame to become due. Returns right away once the input is
+/// exhausted, since nothing else can ever arrive.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
+///                   for infinite wait.
+///
+/// @return     Whether any data is ready for reading.
+///
+bool backend_nic_rx(struct w_engine * const w, const int64_t nsec)
+{
+    struct w_backend * const b = w->b;
+    bool rx = false;
+    for (uint32_t n = 0;
+         b->in && (n < PCAP_RX_BATCH || (rx == false && nsec == -1)); n++) {
+        if (b->in_pos == b->in_len) {
+            if (b->loops == 0)
+                break;
+            // start the next loop where the recording ended
+            b->loops--;
+            b->in_pos = sizeof(struct pcap_hdr);
+            b->start += b->dur;
+        }
+
+        struct pcap_rec r;
+        const uint8_t * const f = next_rec(b, &r);
+        if (b->timed) {
+            const uint64_t now = w_now(CLOCK_MONOTONIC);
+            if (b->start == 0)
+                b->start = now;
+            const uint64_t t = rec_ns(b, &r);
+            const uint64_t due = b->start + (t > b->t0 ? t - b->t0 : 0);
+            if (due > now) {
+                if (rx || nsec == 0)
+                    break;
+                if (nsec > 0 && due - now > (uint64_t)nsec) {
+                    w_nanosleep((uint64_t)nsec);
+                    break;
+                }
+                w_nanosleep(due - now);
+            }
+        }
+        b->in_pos += sizeof(r) + r.incl_len;
+        if (unlikely(r.incl_len < sizeof(struct eth_hdr) ||
+                     r.incl_len > PCAP_FRAME_SIZE))
+            continue;
+
+        struct w_slot s = {.buf_idx = b->rx_idx,
+                           .len = (uint16_t)r.incl_len,
+                           .ts = w_now(CLOCK_REALTIME)};
+        uint8_t * const buf = idx_to_buf(w, s.buf_idx);
+        ASAN_UNPOISON_MEMORY_REGION(buf, s.len);
+        memcpy(buf, f, s.len);
+        rx |= eth_rx(w, &s, buf);
+        b->rx_idx = s.buf_idx;
+    }
+    return rx;
+}
+
+
+/// Push w_iovs from the EDT queue out. Other frames were already written out by
+/// eth_tx().
+///
+/// @param[in]  w     Backend engine.
+///
+void backend_nic_tx(struct w_engine * const w)
+{
+    edt_tx(w);
+    edt_free(w);
+}
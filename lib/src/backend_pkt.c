@@ -0,0 +1,341 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+#ifdef HAVE_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+#include "backend.h"
+#include "eth.h"
+#include "hist.h"
+#include "ifaddr.h"
+#include "neighbor.h"
+
+
+#define PKT_BLOCK_SIZE (1U << 16) ///< Size of a ring block.
+#define PKT_RX_BLOCKS 64          ///< Number of blocks in the RX ring.
+#define PKT_TX_BLOCKS 64          ///< Number of blocks in the TX ring.
+#define PKT_RX_TOV 1              ///< RX block retire timeout in ms.
+
+/// Number of frames in the TX ring.
+#define PKT_TX_FRAMES (PKT_TX_BLOCKS * (PKT_BLOCK_SIZE / PKT_FRAME_SIZE))
+
+/// Offset of the frame data in a TX ring frame.
+#define PKT_TX_OFF (TPACKET3_HDRLEN - sizeof(struct sockaddr_ll))
+
+
+static inline struct tpacket_block_desc * __attribute__((nonnull))
+rx_block(const struct w_backend * const b, const uint32_t i)
+{
+    return (void *)(b->ring + (size_t)i * PKT_BLOCK_SIZE);
+}
+
+
+static inline bool __attribute__((nonnull))
+rx_block_ready(const struct tpacket_block_desc * const blk)
+{
+    return __atomic_load_n(&blk->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+           TP_STATUS_USER;
+}
+
+
+static inline struct tpacket3_hdr * __attribute__((nonnull))
+tx_frame(const struct w_backend * const b, const uint32_t i)
+{
+    return (void *)(b->tx_ring + (size_t)i * PKT_FRAME_SIZE);
+}
+
+
+/// Initialize the warpcore AF_PACKET backend for engine @p w. This opens a
+/// packet socket on the interface and maps a TPACKET_V3 RX and TX ring for it.
+/// TX bypasses the qdisc layer. Unless the interface is a loopback, the socket
+/// also joins a hash fanout group for the interface, so that several warpcore
+/// processes on the same interface split the inbound flows between them.
+///
+/// @param      w      Backend engine.
+/// @param[in]  nbufs  Number of packet buffers to allocate.
+///
+void backend_init(struct w_engine * const w, const uint32_t nbufs)
+{
+    struct w_backend * const b = w->b;
+
+    backend_addr_config(w);
+    w->mtu = MIN(w->mtu, PKT_FRAME_SIZE - sizeof(struct eth_hdr));
+
+    // one more buffer than requested, to copy inbound frames into
+    ensure((w->mem = calloc(nbufs + 1, PKT_FRAME_SIZE)) != 0,
+           "cannot alloc %" PRIu32 " * %u buf mem", nbufs + 1, PKT_FRAME_SIZE);
+    ensure((w->bufs = calloc(nbufs, sizeof(*w->bufs))) != 0,
+           "cannot alloc bufs");
+    for (uint32_t i = 0; i < nbufs; i++) {
+        init_iov(w, &w->bufs[i], i);
+        sq_insert_head(&w->iov, &w->bufs[i], next);
+        ASAN_POISON_MEMORY_REGION(w->bufs[i].buf, max_buf_len(w));
+    }
+    b->rx_idx = nbufs;
+    edt_init(w, nbufs);
+    ensure((b->tx_t = calloc(PKT_TX_FRAMES, sizeof(*b->tx_t))) != 0,
+           "cannot alloc TX times");
+
+    ensure((b->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC,
+                           bswap16(ETH_P_ALL))) != -1,
+           "cannot create AF_PACKET socket");
+    ensure(setsockopt(b->fd, SOL_PACKET, PACKET_VERSION, &(int){TPACKET_V3},
+                      sizeof(int)) == 0,
+           "cannot use TPACKET_V3");
+    ensure(setsockopt(b->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &(int){1},
+                      sizeof(int)) == 0,
+           "cannot bypass qdisc");
+    // don't see our own TX (or that of the kernel) on the RX ring
+    ensure(setsockopt(b->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &(int){1},
+                      sizeof(int)) == 0,
+           "cannot ignore outgoing packets");
+
+    const struct tpacket_req3 rx_req = {.tp_block_size = PKT_BLOCK_SIZE,
+                                        .tp_block_nr = PKT_RX_BLOCKS,
+                                        .tp_frame_size = PKT_FRAME_SIZE,
+                                        .tp_frame_nr = PKT_RX_BLOCKS *
+                                                       (PKT_BLOCK_SIZE /
+                                                        PKT_FRAME_SIZE),
+                                        .tp_retire_blk_tov = PKT_RX_TOV};
+    ensure(setsockopt(b->fd, SOL_PACKET, PACKET_RX_RING, &rx_req,
+                      sizeof(rx_req)) == 0,
+           "cannot set up RX ring");
+    const struct tpacket_req3 tx_req = {.tp_block_size = PKT_BLOCK_SIZE,
+                                        .tp_block_nr = PKT_TX_BLOCKS,
+                                        .tp_frame_size = PKT_FRAME_SIZE,
+                                        .tp_frame_nr = PKT_TX_FRAMES};
+    ensure(setsockopt(b->fd, SOL_PACKET, PACKET_TX_RING, &tx_req,
+                      sizeof(tx_req)) == 0,
+           "cannot set up TX ring");
+
+    b->ring_len = (size_t)(PKT_RX_BLOCKS + PKT_TX_BLOCKS) * PKT_BLOCK_SIZE;
+    ensure((b->ring = mmap(0, b->ring_len, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, b->fd, 0)) != MAP_FAILED,
+           "cannot mmap packet rings");
+    b->tx_ring = b->ring + (size_t)PKT_RX_BLOCKS * PKT_BLOCK_SIZE;
+
+    const int ifindex = (int)if_nametoindex(w->ifname);
+    ensure(ifindex, "%s: cannot get interface index", w->ifname);
+    const struct sockaddr_ll sll = {.sll_family = AF_PACKET,
+                                    .sll_protocol = bswap16(ETH_P_ALL),
+                                    .sll_ifindex = ifindex};
+    ensure(bind(b->fd, (const struct sockaddr *)&sll, sizeof(sll)) == 0,
+           "%s: cannot bind AF_PACKET socket", w->ifname);
+
+    w->backend_name = "packet";
+    if (w->is_loopback) {
+        // loopback has no ARP, so preload the ARP cache
+        for (uint16_t idx = 0; idx < w->addr_cnt; idx++)
+            neighbor_update(w, &w->ifaddr[idx].addr,
+                            (struct eth_addr){ETH_ADDR_NONE});
+        w->backend_variant = "loopback";
+    } else {
+        const uint32_t fanout =
+            ((uint32_t)ifindex & 0xffff) |
+            (uint32_t)(PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16;
+        ensure(setsockopt(b->fd, SOL_PACKET, PACKET_FANOUT, &fanout,
+                          sizeof(fanout)) == 0,
+               "%s: cannot join fanout group", w->ifname);
+        w->backend_variant = "fanout";
+    }
+}
+
+
+/// Shut a warpcore AF_PACKET engine down cleanly.
+///
+/// @param      w     Backend engine.
+///
+void backend_cleanup(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+
+    // close all sockets, and free the state of the userspace stack
+    eth_cleanup(w);
+
+    ensure(munmap(b->ring, b->ring_len) != -1, "cannot munmap packet rings");
+    ensure(close(b->fd) != -1, "cannot close AF_PACKET socket");
+    free(w->mem);
+    free(w->bufs);
+}
+
+
+/// Nothing to do for AF_PACKET, which has no kernel busy-polling;
+/// w_nic_rx() spins on the RX ring instead.
+///
+/// @param      w     Backend engine.
+///
+void backend_busy_poll(struct w_engine * const w __attribute__((unused))) {}
+
+
+/// Places an Ethernet frame into the TX ring. The Ethernet frame contained in
+/// the w_iov @p v is copied into the next free ring frame, so @p v can be
+/// reused immediately.
+///
+/// @param      v     The w_iov containing the Ethernet frame to transmit.
+///
+/// @return     True if the buffer was placed into the TX ring, false otherwise.
+///
+bool eth_tx(struct w_iov * const v)
+{
+    struct w_backend * const b = v->w->b;
+
+    struct tpacket3_hdr * const f = tx_frame(b, b->tx_cur);
+    const uint32_t status = __atomic_load_n(&f->tp_status, __ATOMIC_ACQUIRE);
+    if (unlikely(status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING))) {
+        warn(NTE, "tx ring is full");
+        return false;
+    }
+    if (unlikely(status & TP_STATUS_WRONG_FORMAT))
+        warn(WRN, "kernel rejected earlier frame in tx ring slot %u",
+             b->tx_cur);
+
+    const uint16_t len = v->len + sizeof(struct eth_hdr);
+    memcpy((uint8_t *)f + PKT_TX_OFF, v->base, len);
+    f->tp_len = f->tp_snaplen = len;
+    f->tp_next_offset = 0;
+    cap_tap(v->w, v->base, len);
+
+    warn(DBG, "Eth %s -> %s, type 0x%04x, len %u",
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->src, eth_tmp,
+                  ETH_STRLEN),
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->dst, eth_tmp,
+                  ETH_STRLEN),
+         bswap16(((struct eth_hdr *)(void *)v->base)->type), len);
+
+    if (unlikely(v->w->hist))
+        b->tx_t[b->tx_cur] = w_now(CLOCK_REALTIME);
+    trace_ev(v->w, W_TRACE_TX, tx, b->tx_cur, v->len, 0);
+    __atomic_store_n(&f->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    b->tx_cur = (b->tx_cur + 1) % PKT_TX_FRAMES;
+    b->tx_queued++;
+    return true;
+}
+
+
+/// Trigger the kernel to make new received data available to w_rx(). Iterates
+/// over the frames in any filled RX blocks, copying each into a buffer and
+/// calling eth_rx() for it, and then returns the blocks to the kernel.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
+///                   for infinite wait.
+///
+/// @return     Whether any data is ready for reading.
+///
+bool backend_nic_rx(struct w_engine * const w, const int64_t nsec)
+{
+    struct w_backend * const b = w->b;
+    struct pollfd fds = {.fd = b->fd, .events = POLLIN};
+    int64_t t = nsec;
+again:;
+    struct tpacket_block_desc * blk = rx_block(b, b->rx_blk);
+    if (rx_block_ready(blk) == false &&
+        spin_rx(w, t, rx_block_ready(blk)) == false &&
+        ((w->spin && t == 0) || poll_ns(&fds, 1, t) == 0))
+        return false;
+
+    bool rx = false;
+    while (rx_block_ready(blk)) {
+        const struct tpacket3_hdr * p =
+            (const void *)((uint8_t *)blk + blk->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < blk->hdr.bh1.num_pkts; i++) {
+            // blocks are returned to the kernel as a whole, so copy the frame
+            struct w_slot s = {.buf_idx = b->rx_idx,
+                               .len = (uint16_t)MIN(p->tp_snaplen,
+                                                    PKT_FRAME_SIZE),
+                               .ts = (uint64_t)p->tp_sec * NS_PER_S +
+                                     p->tp_nsec};
+            uint8_t * const buf = idx_to_buf(w, s.buf_idx);
+            ASAN_UNPOISON_MEMORY_REGION(buf, s.len);
+            memcpy(buf, (const uint8_t *)p + p->tp_mac, s.len);
+            rx |= eth_rx(w, &s, buf);
+            b->rx_idx = s.buf_idx;
+            p = (const void *)((const uint8_t *)p + p->tp_next_offset);
+        }
+
+        __atomic_store_n(&blk->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                         __ATOMIC_RELEASE);
+        b->rx_blk = (b->rx_blk + 1) % PKT_RX_BLOCKS;
+        blk = rx_block(b, b->rx_blk);
+    }
+
+    if (rx == false && nsec == -1)
+        goto again;
+
+    return rx;
+}
+
+
+/// Push data placed in the TX ring via udp_tx() and similar methods out onto
+/// the link. Due w_iovs from the EDT queue are placed into the TX ring first.
+///
+/// @param[in]  w     Backend engine.
+///
+void backend_nic_tx(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    edt_tx(w);
+
+    // a blocking send returns once the kernel has drained the TX ring
+    while (send(b->fd, 0, 0, 0) == -1)
+        if (errno != EINTR && errno != EAGAIN) {
+            warn(ERR, "cannot kick tx ring: %s", strerror(errno));
+            break;
+        }
+
+    if (unlikely(w->hist) && b->tx_queued) {
+        const uint64_t now = w_now(CLOCK_REALTIME);
+        for (uint32_t n = MIN(b->tx_queued, PKT_TX_FRAMES); n; n--) {
+            const uint64_t t =
+                b->tx_t[(b->tx_cur + PKT_TX_FRAMES - n) % PKT_TX_FRAMES];
+            if (t)
+                hist_add(w, W_HIST_TX, t, now);
+        }
+    }
+    b->tx_queued = 0;
+
+    edt_free(w);
+}
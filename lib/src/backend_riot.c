@@ -171,6 +171,9 @@ void backend_close(struct w_sock * const s)
 void backend_preconnect(struct w_sock * const s __attribute__((unused))) {}
 
 
+void backend_busy_poll(struct w_engine * const w __attribute__((unused))) {}
+
+
 /// Connect the given w_sock, using the RIOT backend.
 ///
 /// @param      s     w_sock to connect.
@@ -205,7 +208,7 @@ int backend_connect(struct w_sock * const s)
 ///                   data.
 /// @param      i     w_iov tail queue to append new data to.
 ///
-void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
+void backend_rx(struct w_sock * const s, struct w_iov_sq * const i)
 {
     struct w_iov * v = w_alloc_iov(s->w, s->ws_af, 0, 0);
     if (unlikely(v == 0))
@@ -220,6 +223,8 @@ void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
         v->wv_port = sa_port(&sa);
         w_to_waddr(&v->wv_addr, (struct sockaddr *)&sa);
         sq_insert_tail(i, v, next);
+        count_rx(s, v->len);
+        trace_ev(s->w, W_TRACE_RX, rx, v->idx, v->len, 0);
     } else
         w_free_iov(v);
 }
@@ -231,7 +236,7 @@ void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
 /// @param      s     w_sock socket to transmit over.
 /// @param      o     w_iov_sq to send.
 ///
-void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
+void backend_tx(struct w_sock * const s, struct w_iov_sq * const o)
 {
     const bool is_connected = w_connected(s);
 
@@ -244,8 +249,13 @@ void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
 
         if (unlikely(sendto(s->fd, v->buf, v->len, 0,
                             is_connected ? 0 : (struct sockaddr *)&ss,
-                            is_connected ? 0 : sa_len(s->ws_af)) != v->len))
+                            is_connected ? 0 : sa_len(s->ws_af)) != v->len)) {
             warn(ERR, "sendto returned %d (%s)", errno, strerror(errno));
+            count_drop(s->w, s, W_DROP_TX_ERR);
+        } else {
+            count_tx(s, v->len);
+            trace_ev(s->w, W_TRACE_TX, tx, v->idx, v->len, 0);
+        }
         v = sq_next(v, next);
     };
 }
@@ -259,7 +269,7 @@ void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
 ///
 /// @return     Whether any data is ready for reading.
 ///
-bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
+bool backend_nic_rx(struct w_engine * const w, const int64_t nsec)
 {
     struct w_backend * const b = w->b;
     FD_ZERO(&b->fds);
@@ -283,7 +293,7 @@ bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
 ///
 /// @param[in]  w     Backend engine.
 ///
-void w_nic_tx(struct w_engine * const w) {}
+void backend_nic_tx(struct w_engine * const w) {}
 
 
 /// Fill a w_sock_slist with pointers to some sockets with pending inbound
@@ -298,7 +308,8 @@ void w_nic_tx(struct w_engine * const w) {}
 ///
 /// @return     Number of connections that are ready for reading.
 ///
-uint32_t w_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
+uint32_t backend_rx_ready(struct w_engine * const w,
+                          struct w_sock_slist * const sl)
 {
     uint32_t i = 0;
     struct w_sock * s;
@@ -30,6 +30,7 @@
 
 #if defined(__linux__)
 #include <limits.h>
+#include <netinet/udp.h>
 #elif defined(__APPLE__)
 #include <netinet/udp.h>
 #else
@@ -41,11 +42,9 @@
 #include <stdlib.h>
 #include <sys/param.h>
 #include <sys/socket.h>
-#include <unistd.h>
-
-#ifndef NDEBUG
 #include <string.h>
-#endif
+#include <time.h>
+#include <unistd.h>
 
 #include <warpcore/warpcore.h>
 
@@ -65,9 +64,9 @@
 
 #if defined(HAVE_KQUEUE)
 #include <sys/event.h>
-#include <time.h>
 #elif defined(HAVE_EPOLL)
 #include <sys/epoll.h>
+#include <sys/ioctl.h>
 #elif !defined(PARTICLE)
 #include <poll.h>
 #endif
@@ -78,15 +77,84 @@
 #define SENDFUNC "sendmsg"
 #endif
 
+#if defined(HAVE_SENDMMSG) && defined(UDP_SEGMENT)
+#define HAVE_UDP_GSO
+
+#ifndef UDP_MAX_SEGMENTS
+// from <linux/udp.h>; the kernel refuses GSO sends with more segments
+#define UDP_MAX_SEGMENTS 64
+#endif
+#endif
+
+#if defined(HAVE_RECVMMSG) && defined(UDP_GRO)
+#define HAVE_UDP_GRO
+
+// Number of UDP GRO super-datagrams to receive per recvmmsg() call.
+#define GRO_BATCH 8
+
+// Size of a UDP GRO super-datagram staging buffer.
+#define GRO_BUF_LEN UINT16_MAX
+#endif
+
 #if defined(HAVE_RECVMMSG)
 #define RECVFUNC "recvmmsg"
 #else
 #define RECVFUNC "recvmsg"
 #endif
 
+#if defined(HAVE_SENDMMSG) && defined(HAVE_RECVMMSG)
+// There is a tradeoff here in terms of how many messages we should try and
+// send or receive per call. Preparing to handle longer sizes has preparation
+// overheads, whereas only handling shorter sizes may require multiple syscalls
+// (and incur their overheads). So we're picking a number out of a hat, which
+// w_set_batch() can change.
+#define DEF_BATCH MIN(64, IOV_MAX)
+#else
+#define DEF_BATCH 1
+#endif
+
+#if defined(HAVE_EPOLL) && defined(__linux__) && !defined(EPIOCSPARAMS)
+// from <linux/eventpoll.h> (Linux 6.9+), which conflicts with <sys/epoll.h>
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+#ifdef HAVE_RECVMMSG
+#define rx_hdr(b, j) (&(b)->rx_msg[(j)].msg_hdr)
+#else
+#define rx_hdr(b, j) (&(b)->rx_msg[(j)])
+#endif
+
+// Control message space for one datagram on TX and RX.
+#ifdef __linux__
+// kernels below 4.9 can't deal with getting an uint8_t passed in, sigh
+#define TX_CTRL_LEN                                                            \
+    (CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint16_t)) +                  \
+     CMSG_SPACE(sizeof(uint64_t)))
+#define RX_CTRL_LEN                                                            \
+    (2 * CMSG_SPACE(sizeof(uint8_t)) + CMSG_SPACE(sizeof(struct timespec)) +  \
+     CMSG_SPACE(sizeof(uint32_t)))
+#else
+#define TX_CTRL_LEN CMSG_SPACE(sizeof(uint8_t))
+#define RX_CTRL_LEN (2 * CMSG_SPACE(sizeof(uint8_t)))
+#endif
+
 #include "backend.h"
+#include "hist.h"
 #include "ifaddr.h"
 
+#ifdef HAVE_ZEROCOPY
+// Maximum number of w_iovs in a zero-copy UDP GSO super-buffer. The kernel
+// pins each w_iov as up to two page fragments, and refuses sends that need
+// more than MAX_SKB_FRAGS (usually 17) of them.
+#define ZC_GSO_SEGS 8
+#endif
+
 
 /// Set the socket options.
 ///
@@ -122,12 +190,134 @@ void w_set_sockopt(struct w_sock * const s, const struct w_sockopt * const opt)
             warn(WRN, "cannot setsockopt IP_TOS/IPV6_TCLASS; running on WSL?");
     }
 
+#ifdef HAVE_UDP_GSO
+    s->opt.disable_udp_gso = opt->disable_udp_gso || s->w->b->has_gso == false;
+#endif
+
+#ifdef HAVE_UDP_GRO
+    if (s->opt.enable_udp_gro != opt->enable_udp_gro) {
+        s->opt.enable_udp_gro = opt->enable_udp_gro;
+        if (s->opt.enable_udp_gro && s->w->b->gro_buf == 0)
+            ensure((s->w->b->gro_buf = malloc(GRO_BATCH * GRO_BUF_LEN)) != 0,
+                   "cannot alloc GRO staging buffer");
+        const int ret = setsockopt((int)s->fd, SOL_UDP, UDP_GRO,
+                                   &(int){s->opt.enable_udp_gro}, sizeof(int));
+        if (unlikely(ret < 0)) {
+            warn(WRN, "cannot setsockopt UDP_GRO");
+            s->opt.enable_udp_gro = false;
+        }
+    }
+#endif
+
+#ifdef HAVE_ZEROCOPY
+    s->opt.zerocopy_min_len = opt->zerocopy_min_len;
+    if (s->opt.enable_zerocopy != opt->enable_zerocopy) {
+        s->opt.enable_zerocopy = opt->enable_zerocopy;
+        const int ret = setsockopt((int)s->fd, SOL_SOCKET, SO_ZEROCOPY,
+                                   &(int){s->opt.enable_zerocopy}, sizeof(int));
+        if (unlikely(ret < 0)) {
+            warn(WRN, "cannot setsockopt SO_ZEROCOPY");
+            s->opt.enable_zerocopy = false;
+        }
+    }
+#endif
+
+#ifdef SO_TIMESTAMPNS
+    if (s->opt.enable_timestamps != opt->enable_timestamps) {
+        s->opt.enable_timestamps = opt->enable_timestamps;
+        const int ret =
+            setsockopt((int)s->fd, SOL_SOCKET, SO_TIMESTAMPNS,
+                       &(int){s->opt.enable_timestamps}, sizeof(int));
+        if (unlikely(ret < 0)) {
+            warn(WRN, "cannot setsockopt SO_TIMESTAMPNS");
+            s->opt.enable_timestamps = false;
+        }
+    }
+#else
+    s->opt.enable_timestamps = opt->enable_timestamps;
+#endif
+
+#ifdef HAVE_TXTIME
+    if (s->opt.enable_txtime != opt->enable_txtime) {
+        s->opt.enable_txtime = opt->enable_txtime;
+        // the kernel cannot turn SO_TXTIME off again, but without SCM_TXTIME
+        // control messages it does not delay anything
+        if (s->opt.enable_txtime &&
+            setsockopt((int)s->fd, SOL_SOCKET, SO_TXTIME,
+                       &(struct sock_txtime){.clockid = CLOCK_MONOTONIC},
+                       sizeof(struct sock_txtime)) < 0) {
+            warn(WRN, "cannot setsockopt SO_TXTIME");
+            s->opt.enable_txtime = false;
+        }
+    }
+#endif
+
     s->opt.user_1 = opt->user_1;
     s->opt.user_2 = opt->user_2;
     s->opt.user_3 = opt->user_3;
 }
 
 
+static void __attribute__((nonnull))
+msg_batch_init(struct msg_batch * const mb,
+               const uint32_t n,
+               const size_t ctrl_len)
+{
+    ensure((mb->iov = calloc(n, sizeof(*mb->iov))) != 0 &&
+               (mb->sa = calloc(n, sizeof(*mb->sa))) != 0 &&
+               (mb->ctrl = calloc(n, ctrl_len)) != 0 &&
+               (mb->v = calloc(n, sizeof(*mb->v))) != 0,
+           "cannot alloc %" PRIu32 " message slots", n);
+}
+
+
+static void __attribute__((nonnull)) msg_batch_free(struct msg_batch * const mb)
+{
+    free(mb->iov);
+    free(mb->sa);
+    free(mb->ctrl);
+    free(mb->v);
+}
+
+
+/// Set the number of datagrams that the socket backend sends or receives per
+/// system call for engine @p w, and (re-)allocate the message vectors it keeps
+/// for that. Returns any w_iovs posted for RX to the free pool; fresh ones are
+/// posted by the next w_rx().
+///
+/// @param      w     Backend engine.
+/// @param[in]  n     Number of datagrams per batch.
+///
+void backend_batch(struct w_engine * const w, const uint32_t n)
+{
+    struct w_backend * const b = w->b;
+    if (b->batch) {
+        for (uint32_t j = 0; j < b->batch; j++)
+            if (b->rx.v[j])
+                w_free_iov(b->rx.v[j]);
+        msg_batch_free(&b->tx);
+        msg_batch_free(&b->rx);
+        free(b->tx_msg);
+        free(b->rx_msg);
+    }
+
+    b->batch = MAX(1, MIN(n, DEF_BATCH == 1 ? 1 : IOV_MAX));
+    msg_batch_init(&b->tx, b->batch, TX_CTRL_LEN);
+    msg_batch_init(&b->rx, b->batch, RX_CTRL_LEN);
+    ensure((b->tx_msg = calloc(b->batch, sizeof(*b->tx_msg))) != 0 &&
+               (b->rx_msg = calloc(b->batch, sizeof(*b->rx_msg))) != 0,
+           "cannot alloc %" PRIu32 " message headers", b->batch);
+
+    // these fields of the RX message headers never change
+    for (uint32_t j = 0; j < b->batch; j++)
+        *rx_hdr(b, j) = (struct msghdr){.msg_name = &b->rx.sa[j],
+                                        .msg_iov = &b->rx.iov[j],
+                                        .msg_iovlen = 1,
+                                        .msg_control =
+                                            &b->rx.ctrl[j * RX_CTRL_LEN]};
+}
+
+
 /// Initialize the warpcore socket backend for engine @p w. Sets up the extra
 /// buffers.
 ///
@@ -153,6 +343,11 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
         sq_insert_head(&w->iov, &w->bufs[i], next);
         ASAN_POISON_MEMORY_REGION(w->bufs[i].buf, max_buf_len(w));
     }
+#ifdef HAVE_ZEROCOPY
+    ensure((w->b->zc_ref = calloc(nbufs, sizeof(*w->b->zc_ref))) != 0,
+           "cannot alloc zero-copy refs");
+#endif
+    backend_batch(w, DEF_BATCH);
 
 #if defined(HAVE_KQUEUE)
     w->b->kq = kqueue();
@@ -183,10 +378,67 @@ void backend_cleanup(struct w_engine * const w)
 #endif
     free(w->mem);
     free(w->bufs);
+    free(w->b->gro_buf);
+    msg_batch_free(&w->b->tx);
+    msg_batch_free(&w->b->rx);
+    free(w->b->tx_msg);
+    free(w->b->rx_msg);
+    w->b->batch = 0;
+#ifdef HAVE_ZEROCOPY
+    free(w->b->zc_ref);
+    free(w->b->zc);
+#endif
     w->b->n = 0;
 }
 
 
+#ifdef HAVE_REUSEPORT_CBPF
+/// Attach a classic BPF program to the SO_REUSEPORT group of w_sock @p s that
+/// steers each packet to the socket at index (receiving CPU % @p shards).
+///
+/// @param      s       A w_sock bound with SO_REUSEPORT.
+/// @param[in]  shards  Number of sockets in the group.
+///
+static void __attribute__((nonnull))
+reuseport_steer(const struct w_sock * const s, const uint16_t shards)
+{
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, shards},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    const struct sock_fprog prog = {.len = sizeof(code) / sizeof(code[0]),
+                                    .filter = code};
+    if (unlikely(setsockopt((int)s->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                            &prog, sizeof(prog)) < 0))
+        warn(WRN, "cannot setsockopt SO_ATTACH_REUSEPORT_CBPF");
+}
+#endif
+
+
+#ifdef HAVE_BUSY_POLL
+/// Have the kernel busy-poll the NIC queue of w_sock @p s for up to the
+/// busy-poll budget of its engine, when a receive would otherwise block.
+///
+/// @param      s     The w_sock to configure.
+///
+static void __attribute__((nonnull))
+sock_busy_poll(const struct w_sock * const s)
+{
+    const int usec =
+        (int)MIN(INT32_MAX, NS_TO_US(s->w->busy_poll + NS_PER_US - 1));
+    if (unlikely(setsockopt((int)s->fd, SOL_SOCKET, SO_BUSY_POLL, &usec,
+                            sizeof(usec)) < 0))
+        warn(WRN, "cannot setsockopt SO_BUSY_POLL %d (%s)", usec,
+             strerror(errno));
+    if (unlikely(setsockopt((int)s->fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                            &(int){usec != 0}, sizeof(int)) < 0))
+        warn(WRN, "cannot setsockopt SO_PREFER_BUSY_POLL (%s)",
+             strerror(errno));
+}
+#endif
+
+
 /// Bind a warpcore socket-backend socket. Calls the underlying Socket API.
 ///
 /// @param      s     The w_sock to bind.
@@ -200,12 +452,29 @@ int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
     if (unlikely(s->fd < 0))
         return errno;
 
+#ifdef SO_REUSEPORT
+    if (opt && opt->enable_reuseport) {
+        // must be set before bind() to join the group of sockets on the port
+        ensure(setsockopt((int)s->fd, SOL_SOCKET, SO_REUSEPORT, &(int){1},
+                          sizeof(int)) >= 0,
+               "cannot setsockopt SO_REUSEPORT");
+        s->opt.enable_reuseport = true;
+    }
+#endif
+
     struct sockaddr_storage ss;
     to_sockaddr((struct sockaddr *)&ss, &s->ws_laddr, s->ws_lport, s->ws_scope);
     if (unlikely(bind((int)s->fd, (struct sockaddr *)&ss, sa_len(s->ws_af)) !=
                  0))
         return errno;
 
+#ifdef HAVE_REUSEPORT_CBPF
+    if (s->opt.enable_reuseport && opt->reuseport_shards) {
+        s->opt.reuseport_shards = opt->reuseport_shards;
+        reuseport_steer(s, s->opt.reuseport_shards);
+    }
+#endif
+
     // enable always receiving TOS information
     ensure(setsockopt((int)s->fd,
                       s->ws_af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6,
@@ -225,6 +494,13 @@ int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
            "cannot setsockopt IP_RECVTTL");
 #endif
 
+#ifdef SO_RXQ_OVFL
+    // learn how many datagrams the kernel dropped for a full receive buffer
+    if (setsockopt((int)s->fd, SOL_SOCKET, SO_RXQ_OVFL, &(int){1},
+                   sizeof(int)) < 0)
+        warn(WRN, "cannot setsockopt SO_RXQ_OVFL");
+#endif
+
 #if !defined(__APPLE__) && !defined(PARTICLE)
     if (s->ws_af == AF_INET) {
         // enable set DF
@@ -240,9 +516,21 @@ int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
     }
 #endif
 
+#ifdef HAVE_UDP_GSO
+    // see if the kernel supports UDP GSO (Linux 4.18+)
+    s->w->b->has_gso = setsockopt((int)s->fd, SOL_UDP, UDP_SEGMENT, &(int){0},
+                                  sizeof(int)) == 0;
+    s->opt.disable_udp_gso = s->w->b->has_gso == false;
+#endif
+
     if (opt)
         w_set_sockopt(s, opt);
 
+#ifdef HAVE_BUSY_POLL
+    if (s->w->busy_poll)
+        sock_busy_poll(s);
+#endif
+
     // if we're binding to a random port, find out what it is
     if (s->ws_lport == 0) {
         socklen_t len = sizeof(ss);
@@ -270,6 +558,32 @@ int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
 void backend_preconnect(struct w_sock * const s __attribute__((unused))) {}
 
 
+/// Apply the busy-poll budget of engine @p w. Only the epoll parameters are
+/// updated here; sockets pick up SO_BUSY_POLL in backend_bind().
+///
+/// @param      w     Backend engine.
+///
+void backend_busy_poll(struct w_engine * const w
+#if !defined(HAVE_EPOLL) || defined(HAVE_KQUEUE) || !defined(__linux__)
+                       __attribute__((unused))
+#endif
+)
+{
+#if defined(HAVE_EPOLL) && !defined(HAVE_KQUEUE) && defined(__linux__)
+    struct w_backend * const b = w->b;
+    const struct epoll_params p = {
+        .busy_poll_usecs =
+            (uint32_t)MIN(INT32_MAX, NS_TO_US(w->busy_poll + NS_PER_US - 1)),
+        .busy_poll_budget = (uint16_t)MIN(b->batch, 64), // NAPI_POLL_WEIGHT
+        .prefer_busy_poll = w->busy_poll != 0};
+    b->ep_busy_poll = ioctl(b->ep, EPIOCSPARAMS, &p) == 0 && w->busy_poll;
+    if (b->ep_busy_poll == false && w->busy_poll)
+        warn(INF, "no epoll busy-poll (%s), spinning in w_nic_rx() instead",
+             strerror(errno));
+#endif
+}
+
+
 /// The socket backend performs no operation here.
 ///
 /// @param      s     The w_sock to connect.
@@ -287,12 +601,158 @@ int backend_connect(struct w_sock * const s)
 }
 
 
+#ifdef HAVE_ZEROCOPY
+/// Record that the @p n w_iovs starting with @p v went out in the next
+/// MSG_ZEROCOPY send on w_sock @p s.
+///
+/// @param      s     The w_sock the send was made on.
+/// @param      v     First w_iov of the send.
+/// @param[in]  n     Number of w_iovs in the send.
+///
+static void __attribute__((nonnull))
+zc_track(struct w_sock * const s, struct w_iov * v, const size_t n)
+{
+    struct w_backend * const b = s->w->b;
+    const uint32_t seq = s->zc_seq++;
+    for (size_t j = 0; j < n; j++, v = sq_next(v, next)) {
+        if (unlikely(b->zc_head + b->zc_cnt == b->zc_cap)) {
+            if (b->zc_head) {
+                memmove(b->zc, &b->zc[b->zc_head], b->zc_cnt * sizeof(*b->zc));
+                b->zc_head = 0;
+            } else {
+                b->zc_cap = b->zc_cap ? 2 * b->zc_cap : 256;
+                ensure((b->zc = realloc(b->zc, b->zc_cap * sizeof(*b->zc))) !=
+                           0,
+                       "cannot realloc zero-copy list");
+            }
+        }
+        const uint32_t idx = w_iov_idx(v);
+        b->zc[b->zc_head + b->zc_cnt++] = (struct zc_pend){s, seq, idx};
+        b->zc_ref[idx]++;
+    }
+}
+
+
+/// Release the w_iov of zero-copy send entry @p e. If the application has
+/// already freed the w_iov and this was its last send in flight, return it to
+/// the free pool.
+///
+/// @param      w     Backend engine.
+/// @param      e     The entry to release.
+///
+static void __attribute__((nonnull))
+zc_release(struct w_engine * const w, struct zc_pend * const e)
+{
+    uint16_t * const ref = &w->b->zc_ref[e->idx];
+    e->s = 0;
+    if (--*ref == ZC_HELD) {
+        *ref = 0;
+        w_free_iov(&w->bufs[e->idx]);
+    }
+}
+
+
+/// Drop released entries from the head of the zero-copy list.
+///
+/// @param      b     Backend.
+///
+static void __attribute__((nonnull)) zc_pop(struct w_backend * const b)
+{
+    while (b->zc_cnt && b->zc[b->zc_head].s == 0) {
+        b->zc_head++;
+        b->zc_cnt--;
+    }
+    if (b->zc_cnt == 0)
+        b->zc_head = 0;
+}
+
+
+/// Read the zero-copy completion notifications from the error queue of w_sock
+/// @p s, and release the w_iovs of the completed sends.
+///
+/// @param      s     The w_sock to check.
+///
+static void __attribute__((nonnull)) zc_drain(struct w_sock * const s)
+{
+    struct w_backend * const b = s->w->b;
+    for (;;) {
+        __extension__ uint8_t ctrl[CMSG_SPACE(sizeof(struct sock_extended_err) +
+                                              sizeof(struct sockaddr_in6))];
+        struct msghdr msg = {.msg_control = ctrl,
+                             .msg_controllen = sizeof(ctrl)};
+        if (recvmsg((int)s->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            if (unlikely(errno != EAGAIN))
+                warn(ERR, "recvmsg MSG_ERRQUEUE returned %d (%s)", errno,
+                     strerror(errno));
+            return;
+        }
+
+        for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if ((cmsg->cmsg_level != SOL_IP ||
+                 cmsg->cmsg_type != IP_RECVERR) &&
+                (cmsg->cmsg_level != SOL_IPV6 ||
+                 cmsg->cmsg_type != IPV6_RECVERR))
+                continue;
+            const struct sock_extended_err * const ee =
+                (const void *)CMSG_DATA(cmsg);
+            if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+
+            // sends ee_info to ee_data (inclusive) have completed
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                warn(DBG, "kernel copied zero-copy sends %u-%u", ee->ee_info,
+                     ee->ee_data);
+            for (uint32_t i = b->zc_head; i < b->zc_head + b->zc_cnt; i++) {
+                struct zc_pend * const e = &b->zc[i];
+                if (e->s == s &&
+                    e->seq - ee->ee_info <= ee->ee_data - ee->ee_info)
+                    zc_release(s->w, e);
+            }
+        }
+    }
+}
+
+
+/// Process the zero-copy completion notifications of all w_socks with sends
+/// in flight.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) zc_reap(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    const struct w_sock * last = 0;
+    for (uint32_t i = b->zc_head; i < b->zc_head + b->zc_cnt; i++) {
+        struct w_sock * const s = b->zc[i].s;
+        if (s && s != last) {
+            zc_drain(s);
+            last = s;
+        }
+    }
+    zc_pop(b);
+}
+#endif
+
+
 /// Close the socket.
 ///
 /// @param      s     The w_sock to close.
 ///
 void backend_close(struct w_sock * const s)
 {
+#ifdef HAVE_ZEROCOPY
+    struct w_backend * const b = s->w->b;
+    if (unlikely(b->zc_cnt)) {
+        // release any w_iovs still in flight on s
+        zc_drain(s);
+        for (uint32_t i = b->zc_head; i < b->zc_head + b->zc_cnt; i++)
+            if (b->zc[i].s == s)
+                zc_release(s->w, &b->zc[i]);
+        zc_pop(b);
+    }
+#endif
+
 #if defined(HAVE_KQUEUE)
     struct kevent ev;
     EV_SET(&ev, s->fd, EVFILT_READ, EV_DELETE, 0, 0, s);
@@ -309,144 +769,371 @@ void backend_close(struct w_sock * const s)
 }
 
 
+#ifdef HAVE_UDP_GSO
+/// Return whether w_iov @p v can be appended to a UDP GSO super-buffer of
+/// w_iov @p prev, which was sent with the same destination and TOS byte.
+///
+/// @param[in]  s      w_sock socket to transmit over.
+/// @param[in]  prev   Last w_iov already in the super-buffer.
+/// @param[in]  v      Candidate w_iov.
+/// @param[in]  flags  DSCP + ECN of the super-buffer.
+///
+/// @return     True if @p v can be sent in the same super-buffer.
+///
+static inline bool __attribute__((nonnull))
+gso_ok(const struct w_sock * const s,
+       const struct w_iov * const prev,
+       const struct w_iov * const v,
+       const uint8_t flags)
+{
+    return v->flags == flags && v->txtime == prev->txtime && v->len &&
+           v->len <= prev->len &&
+           (w_connected(s) || w_sockaddr_cmp(&v->saddr, &prev->saddr));
+}
+#endif
+
+
+/// Set w_iov::ts of the w_iovs from @p v up to (but excluding) @p end to the
+/// current time.
+///
+/// @param      v     First w_iov handed to the kernel.
+/// @param      end   w_iov following the last one handed to the kernel.
+///
+static void __attribute__((nonnull(1)))
+tx_stamp(struct w_iov * v, const struct w_iov * const end)
+{
+    const uint64_t now = w_now(CLOCK_REALTIME);
+    for (; v != end; v = sq_next(v, next))
+        v->ts = now;
+}
+
+
 /// Loops over the w_iov structures in the tail queue @p o, sending them all
 /// over w_sock @p s. This backend uses the Socket API.
 ///
+/// Where the kernel supports UDP GSO, runs of up to UDP_MAX_SEGMENTS
+/// consecutive w_iovs with the same destination, TOS byte and w_iov::txtime
+/// are handed to the kernel as a single super-buffer with a UDP_SEGMENT control
+/// message, which the kernel (or NIC) segments into individual datagrams. All
+/// but the last w_iov of such a run must have the same length. If the kernel
+/// refuses GSO for this socket, it is disabled and the affected w_iovs are
+/// retransmitted individually.
+///
+/// If w_sockopt::enable_txtime is set, a non-zero w_iov::txtime is passed to
+/// the kernel in an SCM_TXTIME control message.
+///
 /// @param      s     w_sock socket to transmit over.
 /// @param      o     w_iov_sq to send.
 ///
-void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
+void backend_tx(struct w_sock * const s, struct w_iov_sq * const o)
 {
+    struct w_backend * const b = s->w->b;
 #ifdef HAVE_SENDMMSG
-// There is a tradeoff here in terms of how many messages we should try and
-// send. Preparing to handle longer sizes has preparation overheads, whereas
-// only handling shorter sizes may require multiple syscalls (and incur their
-// overheads). So we're picking a number out of a hat. We could allocate
-// dynamically for MAX(IOV_MAX, w_iov_sq_cnt(c)), but that seems overkill.
-#define SEND_SIZE MIN(64, IOV_MAX)
-    struct mmsghdr msgvec[SEND_SIZE];
+    struct mmsghdr * const msgvec = b->tx_msg;
 #else
-#define SEND_SIZE 1
-    struct msghdr msgvec[SEND_SIZE];
+    struct msghdr * const msgvec = b->tx_msg;
 #endif
-    struct iovec msg[SEND_SIZE];
-    struct sockaddr_storage sa[SEND_SIZE];
-#ifdef __linux__
-    // kernels below 4.9 can't deal with getting an uint8_t passed in, sigh
-    __extension__ uint8_t ctrl[SEND_SIZE][CMSG_SPACE(sizeof(int))];
-#else
-    __extension__ uint8_t ctrl[SEND_SIZE][CMSG_SPACE(sizeof(uint8_t))];
+    struct iovec * const msg = b->tx.iov;
+    struct sockaddr_storage * const sa = b->tx.sa;
+    struct w_iov ** const head = b->tx.v;
+    const size_t send_size = b->batch;
+    const uint64_t t0 = unlikely(s->w->hist) ? w_now(CLOCK_REALTIME) : 0;
+
+#ifdef HAVE_UDP_GSO
+    // the kernel refuses GSO on sockets without UDP checksums
+    bool gso = s->opt.disable_udp_gso == false &&
+               (s->ws_af != AF_INET ||
+                s->opt.enable_udp_zero_checksums == false);
+    const uint16_t gso_max_len = w_max_udp_payload(s);
+    const uint32_t gso_max_buf = UINT16_MAX - ip_hdr_len(s->ws_af) - 8;
+#endif
+#ifdef HAVE_ZEROCOPY
+    bool zc = s->opt.enable_zerocopy;
+    bool zc_batch = false;
 #endif
 
     struct w_iov * v = sq_first(o);
     do {
-        size_t i;
-        for (i = 0; i < SEND_SIZE && v; i++) {
-
-            // for sendmmsg, we populate the parameters
-            msg[i] = (struct iovec){.iov_base = v->buf, .iov_len = v->len};
+        size_t i = 0; // number of iovecs used
+        size_t m;     // number of messages used
+        for (m = 0; i < send_size && v; m++) {
+#ifdef HAVE_ZEROCOPY
+            // don't mix zero-copy and copied messages in one sendmmsg() call
+            const bool zc_v = zc && v->len >= s->opt.zerocopy_min_len;
+            if (m == 0)
+                zc_batch = zc_v;
+            else if (zc_v != zc_batch)
+                break;
+#endif
+#ifdef HAVE_SENDMMSG
+            struct msghdr * const hdr = &msgvec[m].msg_hdr;
+#else
+            struct msghdr * const hdr = &msgvec[m];
+#endif
             // if w_sock is disconnected, use destination IP and port from w_iov
             // instead of the one in the template header
             if (w_connected(s))
                 v->saddr = s->tup.remote;
             else
-                to_sockaddr((struct sockaddr *)&sa[i], &v->wv_addr, v->wv_port,
+                to_sockaddr((struct sockaddr *)&sa[m], &v->wv_addr, v->wv_port,
                             s->ws_scope);
-#ifdef HAVE_SENDMMSG
-            msgvec[i].msg_hdr =
-#else
-            msgvec[i] =
-#endif
-                (struct msghdr){
-                    .msg_name = w_connected(s) ? 0 : &sa[i],
-                    .msg_namelen = w_connected(s) ? 0 : sa_len(sa[i].ss_family),
-                    .msg_iov = &msg[i],
-                    .msg_iovlen = 1};
+            *hdr = (struct msghdr){
+                .msg_name = w_connected(s) ? 0 : &sa[m],
+                .msg_namelen = w_connected(s) ? 0 : sa_len(sa[m].ss_family),
+                .msg_iov = &msg[i],
+                .msg_iovlen = 1};
 
-            // set TOS from w_iov
-            if (v->flags) {
-#ifdef HAVE_SENDMMSG
-                msgvec[i].msg_hdr.msg_control = &ctrl[i];
-                msgvec[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
-                struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&msgvec[i].msg_hdr);
+            // for sendmmsg, we populate the parameters
+            const uint8_t flags = v->flags;
+            head[m] = v;
+            msg[i++] = (struct iovec){.iov_base = v->buf, .iov_len = v->len};
+            if (flags == 0 && s->opt.enable_ecn)
+                // make sure that the flags reflect what went out on the wire
+                v->flags = ECN_ECT0;
+
+#ifdef HAVE_UDP_GSO
+            // coalesce following w_iovs into this message, if possible
+            struct w_iov * prev = v;
+            v = sq_next(v, next);
+            if (gso && prev->len && prev->len <= gso_max_len) {
+                uint32_t buf_len = prev->len;
+                while (i < send_size && v && prev->len == head[m]->len &&
+                       buf_len + v->len <= gso_max_buf &&
+                       hdr->msg_iovlen < UDP_MAX_SEGMENTS &&
+#ifdef HAVE_ZEROCOPY
+                       (zc_batch == false || hdr->msg_iovlen < ZC_GSO_SEGS) &&
+#endif
+                       gso_ok(s, prev, v, flags)) {
+                    if (w_connected(s))
+                        v->saddr = s->tup.remote;
+                    msg[i++] =
+                        (struct iovec){.iov_base = v->buf, .iov_len = v->len};
+                    if (flags == 0 && s->opt.enable_ecn)
+                        v->flags = ECN_ECT0;
+                    buf_len += v->len;
+                    hdr->msg_iovlen++;
+                    prev = v;
+                    v = sq_next(v, next);
+                }
+            }
 #else
-                msgvec[i].msg_control = &ctrl[i];
-                msgvec[i].msg_controllen = sizeof(ctrl[i]);
-                struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&msgvec[i]);
+            v = sq_next(v, next);
 #endif
+
+            // set TOS from w_iov, and segment size for GSO
+            uint8_t * const ctrl = &b->tx.ctrl[m * TX_CTRL_LEN];
+            hdr->msg_control = ctrl;
+            hdr->msg_controllen = TX_CTRL_LEN;
+            size_t ctrl_len = 0;
+            struct cmsghdr * cmsg = CMSG_FIRSTHDR(hdr);
+            if (flags) {
                 cmsg->cmsg_level =
-                    v->wv_af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
-                cmsg->cmsg_type = v->wv_af == AF_INET ? IP_TOS : IPV6_TCLASS;
+                    s->ws_af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
+                cmsg->cmsg_type = s->ws_af == AF_INET ? IP_TOS : IPV6_TCLASS;
                 cmsg->cmsg_len =
 #ifdef __FreeBSD__
-                    CMSG_LEN(v->wv_af == AF_INET ? sizeof(char) : sizeof(int));
+                    CMSG_LEN(s->ws_af == AF_INET ? sizeof(char) : sizeof(int));
 #else
                     CMSG_LEN(sizeof(int));
 #endif
-                *(int *)(void *)CMSG_DATA(cmsg) = v->flags;
-            } else if (s->opt.enable_ecn)
-                // make sure that the flags reflect what went out on the wire
-                v->flags = ECN_ECT0;
-
-            v = sq_next(v, next);
+                *(int *)(void *)CMSG_DATA(cmsg) = flags;
+                ctrl_len += CMSG_SPACE(sizeof(int));
+#if defined(HAVE_UDP_GSO) || defined(HAVE_TXTIME)
+                cmsg = (struct cmsghdr *)(void *)&ctrl[ctrl_len];
+#endif
+            }
+#ifdef HAVE_UDP_GSO
+            if (hdr->msg_iovlen > 1) {
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                *(uint16_t *)(void *)CMSG_DATA(cmsg) = head[m]->len;
+                ctrl_len += CMSG_SPACE(sizeof(uint16_t));
+#ifdef HAVE_TXTIME
+                cmsg = (struct cmsghdr *)(void *)&ctrl[ctrl_len];
+#endif
+            }
+#endif
+#ifdef HAVE_TXTIME
+            if (s->opt.enable_txtime && head[m]->txtime) {
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_TXTIME;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+                memcpy(CMSG_DATA(cmsg), &head[m]->txtime, sizeof(uint64_t));
+                ctrl_len += CMSG_SPACE(sizeof(uint64_t));
+            }
+#endif
+            hdr->msg_controllen = ctrl_len;
+            if (ctrl_len == 0)
+                hdr->msg_control = 0;
         }
 
-        const ssize_t r =
 #if defined(HAVE_SENDMMSG)
-            sendmmsg((int)s->fd, msgvec, (unsigned int)i, 0);
+        size_t sent = 0;
+        int r;
+        do {
+#ifdef HAVE_ZEROCOPY
+            r = sendmmsg((int)s->fd, &msgvec[sent], (unsigned int)(m - sent),
+                         zc_batch ? MSG_ZEROCOPY : 0);
+            if (zc_batch)
+                for (int k = 0; k < r; k++)
+                    zc_track(s, head[sent + (size_t)k],
+                             msgvec[sent + (size_t)k].msg_hdr.msg_iovlen);
 #else
-            sendmsg((int)s->fd, msgvec, 0);
+            r = sendmmsg((int)s->fd, &msgvec[sent], (unsigned int)(m - sent),
+                         0);
+#endif
+            if (likely(r > 0))
+                sent += (size_t)r;
+        } while (r > 0 && sent < m);
+#else
+        const ssize_t r = sendmsg((int)s->fd, msgvec, 0);
+        const size_t sent = r >= 0 ? m : 0;
+#endif
+        struct w_iov * const end = sent < m ? head[sent] : v;
+        if (unlikely(s->opt.enable_timestamps) && sent)
+            tx_stamp(head[0], end);
+        for (const struct w_iov * x = head[0]; x != end;
+             x = sq_next(x, next)) {
+            count_tx(s, x->len);
+            trace_ev(s->w, W_TRACE_TX, tx, x->idx, x->len, 0);
+        }
+        if (unlikely(s->w->hist)) {
+            const uint64_t now = w_now(CLOCK_REALTIME);
+            for (const struct w_iov * x = head[0]; x != end;
+                 x = sq_next(x, next))
+                hist_add(s->w, W_HIST_TX, t0, now);
+        }
+
+        const enum w_drop why =
+            r < 0 && errno != EAGAIN ? W_DROP_TX_ERR : W_DROP_TX_FULL;
+        if (unlikely(r < 0 && errno != EAGAIN && errno != ETIMEDOUT)) {
+#ifdef HAVE_ZEROCOPY
+            if (zc_batch && errno == ENOBUFS) {
+                // out of optmem for zero-copy state, so copy for now
+                warn(NTE, "MSG_ZEROCOPY failed (%s), copying", strerror(errno));
+                zc = false;
+                v = head[sent];
+                continue;
+            }
+#endif
+#ifdef HAVE_UDP_GSO
+            if (msgvec[sent].msg_hdr.msg_iovlen > 1 &&
+                (errno == EIO || errno == EINVAL)) {
+                // the kernel refused GSO, so retransmit without it
+                warn(NTE, "disabling UDP GSO on socket (%s)", strerror(errno));
+                s->opt.disable_udp_gso = true;
+                gso = false;
+                v = head[sent];
+                continue;
+            }
 #endif
-        if (unlikely(r < 0 && errno != EAGAIN && errno != ETIMEDOUT))
             warn(ERR, "sendmsg/sendmmsg returned %d (%s)", errno,
                  strerror(errno));
+        }
+        // whatever the kernel did not take is lost
+        for (const struct w_iov * x = end; x != v; x = sq_next(x, next))
+            count_drop(s->w, s, why);
     } while (v);
 }
 
 
-/// Calls recvmsg() or recvmmsg() for all sockets associated with the engine,
-/// emulating the operation of netmap backend_rx() function. Appends all data to
-/// the w_sock::iv socket buffers of the respective w_sock structures.
+/// Extract the meta data of a received datagram from the sockaddr and control
+/// messages in @p hdr into w_iov @p v. Also counts the datagrams the kernel
+/// dropped on @p s since the last one.
 ///
-/// @param      s     w_sock for which the application would like to receive new
-///                   data.
-/// @param      i     w_iov tail queue to append new data to.
+/// @param      s     The w_sock the datagram was received on.
+/// @param      v     The w_iov to update.
+/// @param[in]  hdr   The msghdr the datagram was received with.
 ///
-void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
+/// @return     The UDP GRO segment size, or zero if @p hdr carried none.
+///
+static uint16_t __attribute__((nonnull))
+rx_meta(struct w_sock * const s,
+        struct w_iov * const v,
+        struct msghdr * const hdr)
 {
-#ifdef HAVE_RECVMMSG
-// There is a tradeoff here in terms of how many messages we should try and
-// receive. Preparing to handle longer sizes has preparation overheads, whereas
-// only handling shorter sizes may require multiple syscalls (and incur their
-// overheads). So we're picking a number out of a hat.
-#define RECV_SIZE MIN(64, IOV_MAX)
+    v->wv_port = sa_port(hdr->msg_name);
+    w_to_waddr(&v->wv_addr, (struct sockaddr *)hdr->msg_name);
+
+    // extract TOS byte (Particle uses recvfrom w/o cmsg support)
+    uint16_t gso_size = 0;
+    for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(hdr); cmsg;
+         cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP ||
+            cmsg->cmsg_level == IPPROTO_IPV6) {
+            if (cmsg->cmsg_type ==
+#ifdef __linux__
+                    IP_TOS
 #else
-#define RECV_SIZE 1
+                    IP_RECVTOS
 #endif
-    ssize_t n = 0;
-    do {
-        struct w_iov * v[RECV_SIZE];
-        struct iovec msg[RECV_SIZE];
-        struct sockaddr_storage sa[RECV_SIZE];
-        __extension__ uint8_t ctrl[RECV_SIZE][CMSG_SPACE(sizeof(uint8_t)) +
-                                              CMSG_SPACE(sizeof(uint8_t))];
-#ifdef HAVE_RECVMMSG
-        struct mmsghdr msgvec[RECV_SIZE];
+                || cmsg->cmsg_type == IPV6_TCLASS)
+                v->flags = *(uint8_t *)CMSG_DATA(cmsg);
+#ifndef PARTICLE
+            else if (cmsg->cmsg_type ==
+#ifdef __linux__
+                     IP_TTL
 #else
-        struct msghdr msgvec[RECV_SIZE];
+                     IP_RECVTTL
 #endif
-        ssize_t nbufs = 0;
-        for (int j = 0; likely(j < RECV_SIZE); j++, nbufs++) {
-            v[j] = w_alloc_iov(s->w, s->ws_af, 0, 0);
-            if (unlikely(v[j] == 0))
-                break;
-            msg[j] =
-                (struct iovec){.iov_base = v[j]->buf, .iov_len = v[j]->len};
-#ifdef HAVE_RECVMMSG
-            msgvec[j].msg_hdr =
-#else
-            msgvec[j] =
+            )
+                v->ttl = *(uint8_t *)CMSG_DATA(cmsg);
+#endif
+        }
+#ifdef HAVE_UDP_GRO
+        else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+            gso_size = (uint16_t) * (int *)(void *)CMSG_DATA(cmsg);
+#endif
+#ifdef SO_TIMESTAMPNS
+        else if (cmsg->cmsg_level == SOL_SOCKET &&
+                 cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            v->ts = (uint64_t)ts.tv_sec * NS_PER_S + (uint64_t)ts.tv_nsec;
+        }
 #endif
+#ifdef SO_RXQ_OVFL
+        else if (cmsg->cmsg_level == SOL_SOCKET &&
+                 cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t ovfl;
+            memcpy(&ovfl, CMSG_DATA(cmsg), sizeof(ovfl));
+            while (s->rx_ovfl != ovfl) {
+                s->rx_ovfl++;
+                count_drop(s->w, s, W_DROP_RX_FULL);
+            }
+        }
+#endif
+    }
+    return gso_size;
+}
+
+
+#ifdef HAVE_UDP_GRO
+/// Receive UDP GRO super-datagrams on w_sock @p s into the engine's staging
+/// area, and split them into one w_iov per original datagram, which are
+/// appended to @p i.
+///
+/// @param      s     w_sock for which the application would like to receive
+///                   new data.
+/// @param      i     w_iov tail queue to append new data to.
+///
+static void __attribute__((nonnull))
+w_rx_gro(struct w_sock * const s, struct w_iov_sq * const i)
+{
+    uint8_t * const gro_buf = s->w->b->gro_buf;
+    int n = 0;
+    bool nobufs = false;
+    do {
+        struct iovec msg[GRO_BATCH];
+        struct sockaddr_storage sa[GRO_BATCH];
+        __extension__ uint8_t
+            ctrl[GRO_BATCH][RX_CTRL_LEN + CMSG_SPACE(sizeof(int))];
+        struct mmsghdr msgvec[GRO_BATCH];
+        for (int j = 0; likely(j < GRO_BATCH); j++) {
+            msg[j] = (struct iovec){.iov_base = gro_buf + j * GRO_BUF_LEN,
+                                    .iov_len = GRO_BUF_LEN};
+            msgvec[j].msg_hdr =
                 (struct msghdr){.msg_name = &sa[j],
                                 .msg_namelen = sizeof(sa[j]),
                                 .msg_iov = &msg[j],
@@ -454,88 +1141,156 @@ void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
                                 .msg_control = &ctrl[j],
                                 .msg_controllen = sizeof(ctrl[j])};
         }
+
+        n = recvmmsg((int)s->fd, msgvec, GRO_BATCH, MSG_DONTWAIT, 0);
+        if (unlikely(n <= 0)) {
+            if (unlikely(n < 0 && errno != EAGAIN && errno != ETIMEDOUT))
+                warn(ERR, "recvmmsg returned %d (%s)", errno, strerror(errno));
+            return;
+        }
+
+        const uint64_t now = w_now(CLOCK_REALTIME);
+        for (int j = 0; likely(j < n); j++) {
+            struct w_iov meta = {.ts = now};
+            const uint32_t len = msgvec[j].msg_len;
+            uint16_t gso_size = rx_meta(s, &meta, &msgvec[j].msg_hdr);
+            if (gso_size == 0)
+                gso_size = (uint16_t)len;
+            const bool coalesced = len > gso_size;
+
+            // split the super-datagram into its original datagrams
+            const uint8_t * const buf = msg[j].iov_base;
+            for (uint32_t off = 0; off < len; off += gso_size) {
+                struct w_iov * const v = w_alloc_iov(s->w, s->ws_af, 0, 0);
+                if (unlikely(v == 0)) {
+                    // the rest of this batch has already been read, so is lost
+                    if (nobufs == false)
+                        warn(CRT, "no more bufs");
+                    nobufs = true;
+                    count_drop(s->w, s, W_DROP_NO_BUFS);
+                    continue;
+                }
+                const uint32_t seg = MIN(gso_size, len - off);
+                if (unlikely(seg > v->len)) {
+                    // do not hand out a truncated datagram
+                    w_free_iov(v);
+                    count_drop(s->w, s, W_DROP_TRUNC);
+                    continue;
+                }
+                v->len = (uint16_t)seg;
+                memcpy(v->buf, buf + off, v->len);
+                v->saddr = meta.saddr;
+                v->flags = meta.flags;
+                v->ttl = meta.ttl;
+                v->ts = meta.ts;
+                sq_insert_tail(i, v, next);
+                count_rx(s, v->len);
+                if (coalesced) {
+                    s->stats.rx_gro_pkts++;
+                    s->w->stats.rx_gro_pkts++;
+                }
+                trace_ev(s->w, W_TRACE_RX, rx, v->idx, v->len, 0);
+            }
+        }
+    } while (n == GRO_BATCH && nobufs == false);
+}
+#endif
+
+
+/// Calls recvmsg() or recvmmsg() for all sockets associated with the engine,
+/// emulating the operation of netmap backend_rx() function. Appends all data to
+/// the w_sock::iv socket buffers of the respective w_sock structures.
+///
+/// @param      s     w_sock for which the application would like to receive new
+///                   data.
+/// @param      i     w_iov tail queue to append new data to.
+///
+void backend_rx(struct w_sock * const s, struct w_iov_sq * const i)
+{
+#ifdef HAVE_UDP_GRO
+    if (s->opt.enable_udp_gro) {
+        w_rx_gro(s, i);
+        return;
+    }
+#endif
+
+    struct w_backend * const b = s->w->b;
+    struct msg_batch * const r = &b->rx;
+    ssize_t n = 0;
+    do {
+        // post fresh buffers into the slots that the last call consumed
+        uint32_t nbufs = 0;
+        for (; likely(nbufs < b->batch); nbufs++) {
+            if (likely(r->v[nbufs]))
+                continue;
+            struct w_iov * const v = w_alloc_iov(s->w, s->ws_af, 0, 0);
+            if (unlikely(v == 0))
+                break;
+            r->v[nbufs] = v;
+            r->iov[nbufs] =
+                (struct iovec){.iov_base = v->buf, .iov_len = v->len};
+            struct msghdr * const hdr = rx_hdr(b, nbufs);
+            hdr->msg_namelen = sizeof(r->sa[nbufs]);
+            hdr->msg_controllen = RX_CTRL_LEN;
+        }
         if (unlikely(nbufs == 0)) {
             warn(CRT, "no more bufs");
             return;
         }
 #if defined(HAVE_RECVMMSG)
-        n = (ssize_t)recvmmsg((int)s->fd, msgvec, (unsigned int)nbufs,
+        n = (ssize_t)recvmmsg((int)s->fd, b->rx_msg, (unsigned int)nbufs,
                               MSG_DONTWAIT, 0);
 #else
-        n = recvmsg((int)s->fd, msgvec, MSG_DONTWAIT);
+        n = recvmsg((int)s->fd, b->rx_msg, MSG_DONTWAIT);
 #endif
         if (likely(n > 0)) {
-            for (int j = 0; likely(j < MIN(n, nbufs)); j++) {
-                v[j]->wv_port = sa_port(&sa[j]);
-                w_to_waddr(&v[j]->wv_addr, (struct sockaddr *)&sa[j]);
-
-#ifdef HAVE_RECVMMSG
-                v[j]->len = (uint16_t)msgvec[j].msg_len;
-#else
-                v[j]->len = (uint16_t)n;
-                // recvmsg returns number of bytes, we need number of
-                // messages for the return loop below
-                n = 1;
+#ifndef HAVE_RECVMMSG
+            // recvmsg returns number of bytes, we need number of messages
+            const uint16_t len = (uint16_t)n;
+            n = 1;
 #endif
-
-                // extract TOS byte (Particle uses recvfrom w/o cmsg support)
+            // without kernel timestamps, use the time the data was received
+            const uint64_t now = w_now(CLOCK_REALTIME);
+            for (ssize_t j = 0; likely(j < n); j++) {
+                struct w_iov * const v = r->v[j];
+                r->v[j] = 0;
+                v->ts = now;
 #ifdef HAVE_RECVMMSG
-                for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msgvec[j].msg_hdr);
-                     cmsg; cmsg = CMSG_NXTHDR(&msgvec[j].msg_hdr, cmsg)) {
-#else
-                for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msgvec[j]); cmsg;
-                     cmsg = CMSG_NXTHDR(&msgvec[j], cmsg)) {
-#endif
-                    if (cmsg->cmsg_level == IPPROTO_IP ||
-                        cmsg->cmsg_level == IPPROTO_IPV6) {
-                        if (cmsg->cmsg_type ==
-#ifdef __linux__
-                                IP_TOS
+                v->len = (uint16_t)b->rx_msg[j].msg_len;
 #else
-                                IP_RECVTOS
-#endif
-                            || cmsg->cmsg_type == IPV6_TCLASS)
-                            v[j]->flags = *(uint8_t *)CMSG_DATA(cmsg);
-#ifndef PARTICLE
-                        else if (cmsg->cmsg_type ==
-#ifdef __linux__
-                                 IP_TTL
-#else
-                                 IP_RECVTTL
-#endif
-                        )
-                            v[j]->ttl = *(uint8_t *)CMSG_DATA(cmsg);
+                v->len = len;
 #endif
-                    }
-                }
+                rx_meta(s, v, rx_hdr(b, j));
+
                 // add the iov to the tail of the result
-                sq_insert_tail(i, v[j], next);
+                sq_insert_tail(i, v, next);
+                count_rx(s, v->len);
+                trace_ev(s->w, W_TRACE_RX, rx, v->idx, v->len, 0);
             }
-        } else {
-            if (unlikely(n < 0 && errno != EAGAIN && errno != ETIMEDOUT))
-                warn(ERR, "recvmsg/recvmmsg returned %d (%s)", errno,
-                     strerror(errno));
-            n = 0;
-        }
-
-        // return any unused buffers
-        for (ssize_t j = n; likely(j < nbufs); j++)
-            w_free_iov(v[j]);
-    } while (
-#ifdef HAVE_RECVMMSG
-        n == RECV_SIZE
-#else
-        n == 1
-#endif
-    );
+        } else if (unlikely(n < 0 && errno != EAGAIN && errno != ETIMEDOUT))
+            warn(ERR, "recvmsg/recvmmsg returned %d (%s)", errno,
+                 strerror(errno));
+    } while (n == (ssize_t)b->batch);
 }
 
 
-/// The sock backend performs no operation here.
+/// The sock backend performs no operation here, except for processing the
+/// completions of zero-copy sends, which returns the w_iovs the application
+/// freed while they were in flight to the free pool.
 ///
 /// @param[in]  w     Backend engine.
 ///
-void w_nic_tx(struct w_engine * const w __attribute__((unused))) {}
+void backend_nic_tx(struct w_engine * const w
+#ifndef HAVE_ZEROCOPY
+                    __attribute__((unused))
+#endif
+)
+{
+#ifdef HAVE_ZEROCOPY
+    if (w->b->zc_cnt)
+        zc_reap(w);
+#endif
+}
 
 
 /// Check/wait until any data has been received.
@@ -546,21 +1301,47 @@ void w_nic_tx(struct w_engine * const w __attribute__((unused))) {}
 ///
 /// @return     Whether any data is ready for reading.
 ///
-bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
+bool backend_nic_rx(struct w_engine * const w, const int64_t nsec)
 {
     struct w_backend * const b = w->b;
+    int64_t t = nsec;
 
 #if defined(HAVE_KQUEUE)
-    b->n = kevent(b->kq, 0, 0, b->ev, sizeof(b->ev) / sizeof(b->ev[0]),
-                  nsec == -1
-                      ? 0
-                      : &(struct timespec){(uint64_t)nsec / NS_PER_S,
-                                           (long)((uint64_t)nsec % NS_PER_S)});
+    const int nev = sizeof(b->ev) / sizeof(b->ev[0]);
+    if (spin_rx(w, t,
+                (b->n = kevent(b->kq, 0, 0, b->ev, nev,
+                               &(struct timespec){0, 0})) > 0) == false)
+        b->n = kevent(b->kq, 0, 0, b->ev, nev,
+                      to_timespec(t, &(struct timespec){0, 0}));
     return b->n > 0;
 
 #elif defined(HAVE_EPOLL)
-    b->n = epoll_wait(b->ep, b->ev, sizeof(b->ev) / sizeof(b->ev[0]),
-                      nsec == -1 ? -1 : (int)(nsec / NS_PER_MS));
+    // if the kernel busy-polls in epoll_wait(), leave the spinning to it
+    const int nev = sizeof(b->ev) / sizeof(b->ev[0]);
+    if (b->ep_busy_poll ||
+        spin_rx(w, t, (b->n = epoll_wait(b->ep, b->ev, nev, 0)) > 0) == false) {
+#ifdef HAVE_EPOLL_PWAIT2
+        // epoll_pwait2() needs Linux 5.11+, fall back to epoll_wait() before
+        if (likely(b->ep_no_pwait2 == false)) {
+            b->n = epoll_pwait2(b->ep, b->ev, nev,
+                                to_timespec(t, &(struct timespec){0, 0}), 0);
+            b->ep_no_pwait2 = b->n == -1 && errno == ENOSYS;
+        }
+        if (unlikely(b->ep_no_pwait2))
+#endif
+            b->n = epoll_wait(b->ep, b->ev, nev, to_msec(t));
+    }
+#ifdef HAVE_ZEROCOPY
+    if (b->zc_cnt) {
+        // zero-copy completions raise EPOLLERR, so process and drop those
+        zc_reap(w);
+        int n = 0;
+        for (int i = 0; i < b->n; i++)
+            if (b->ev[i].events & EPOLLIN)
+                b->ev[n++] = b->ev[i];
+        b->n = n;
+    }
+#endif
     return b->n > 0;
 
 #else
@@ -584,7 +1365,8 @@ bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
         i++;
     }
 
-    return poll(b->fds, (nfds_t)i, nsec == -1 ? -1 : (int)NS_TO_MS(nsec)) > 0;
+    return spin_rx(w, t, poll(b->fds, (nfds_t)i, 0) > 0) ||
+           poll_ns(b->fds, (nfds_t)i, t) > 0;
 #endif
 }
 
@@ -601,7 +1383,8 @@ bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
 ///
 /// @return     Number of connections that are ready for reading.
 ///
-uint32_t w_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
+uint32_t backend_rx_ready(struct w_engine * const w,
+                          struct w_sock_slist * const sl)
 {
     struct w_backend * const b = w->b;
 
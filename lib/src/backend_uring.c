@@ -0,0 +1,806 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+#ifdef HAVE_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+#include "backend.h"
+#include "hist.h"
+#include "ifaddr.h"
+
+
+// Number of SQ entries, which also bounds the number of TX messages that can
+// be in flight. CQ entries are sized for bursts of multishot RX completions.
+#define URING_SQ_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+
+// Maximum number of buffers posted to the provided buffer ring.
+#define URING_BR_ENTRIES 4096
+
+// Buffer group ID of the provided buffer ring.
+#define URING_BGID 0
+
+// CQE user_data values for TX and cancel SQEs. Multishot RX SQEs carry a
+// pointer to their w_sock, which is aligned and so can never take these
+// values. TX SQEs also carry the index of their uring_tx above the tag bits.
+#define URING_TAG_TX 1
+#define URING_TAG_CANCEL 2
+#define URING_TAG_BITS 3
+
+
+/// Message header of a queued TX SQE, which needs to stay valid until the
+/// kernel has consumed it.
+struct uring_tx {
+    struct msghdr hdr;
+    struct iovec iov;
+    struct sockaddr_storage sa;
+    // kernels below 4.9 can't deal with getting an uint8_t passed in, sigh
+    __extension__ uint8_t ctrl[CMSG_SPACE(sizeof(int))];
+    uint64_t t;   // time of w_tx(), for the TX latency histogram
+    uint32_t idx; // index of the w_iov in w_engine::bufs
+    uint32_t : 32;
+};
+
+
+static inline int
+sys_io_uring_setup(const uint32_t entries, struct io_uring_params * const p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static inline int sys_io_uring_register(const int fd,
+                                        const unsigned int op,
+                                        void * const arg,
+                                        const unsigned int nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr_args);
+}
+
+
+/// Submit all queued SQEs and optionally wait for completions.
+///
+/// @param      b             Backend.
+/// @param[in]  min_complete  Number of CQEs to wait for.
+/// @param[in]  nsec          Timeout in nanoseconds when waiting. Pass -1 for
+///                           infinite wait.
+///
+static void __attribute__((nonnull))
+uring_enter(struct w_backend * const b,
+            const uint32_t min_complete,
+            const int64_t nsec)
+{
+    const uint32_t to_submit =
+        b->sq_tail - __atomic_load_n(b->sq_khead, __ATOMIC_ACQUIRE);
+    __atomic_store_n(b->sq_ktail, b->sq_tail, __ATOMIC_RELEASE);
+
+    struct __kernel_timespec ts = {.tv_sec = nsec / (int64_t)NS_PER_S,
+                                   .tv_nsec = nsec % (int64_t)NS_PER_S};
+    struct io_uring_getevents_arg arg = {.ts = (uint64_t)(uintptr_t)&ts};
+    const bool timed = min_complete && nsec >= 0;
+
+    const int r = (int)syscall(
+        __NR_io_uring_enter, b->fd, to_submit, min_complete,
+        IORING_ENTER_GETEVENTS | (timed ? IORING_ENTER_EXT_ARG : 0),
+        timed ? &arg : 0, timed ? sizeof(arg) : 0);
+    if (unlikely(r < 0 && errno != EINTR && errno != ETIME && errno != EBUSY))
+        warn(ERR, "io_uring_enter returned %d (%s)", errno, strerror(errno));
+}
+
+
+/// Return a free SQE, submitting queued SQEs first if the SQ is full.
+///
+/// @param      b     Backend.
+///
+/// @return     Zeroed SQE, which will be submitted during the next
+///             uring_enter().
+///
+static struct io_uring_sqe * __attribute__((nonnull))
+uring_sqe(struct w_backend * const b)
+{
+    if (unlikely(b->sq_tail - __atomic_load_n(b->sq_khead, __ATOMIC_ACQUIRE) ==
+                 b->sq_entries))
+        uring_enter(b, 0, 0);
+
+    const uint32_t idx = b->sq_tail++ & b->sq_mask;
+    b->sq_array[idx] = idx;
+    struct io_uring_sqe * const sqe = &b->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+
+/// Queue a multishot recvmsg SQE for w_sock @p s, which selects its buffers
+/// from the provided buffer ring.
+///
+/// @param      s     w_sock to receive on.
+///
+static void __attribute__((nonnull)) uring_arm_rx(struct w_sock * const s)
+{
+    struct w_backend * const b = s->w->b;
+    struct io_uring_sqe * const sqe = uring_sqe(b);
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = (int)s->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&b->rx_hdr;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = (uint64_t)(uintptr_t)s;
+}
+
+
+static void __attribute__((nonnull))
+vec_add(struct sock_vec * const v, struct w_sock * const s)
+{
+    if (unlikely(v->n == v->cap)) {
+        v->cap = v->cap ? v->cap * 2 : 64; // arbitrary value
+        ensure((v->s = realloc(v->s, v->cap * sizeof(*v->s))) != 0,
+               "cannot realloc %" PRIu32 " sockets", v->cap);
+    }
+    v->s[v->n++] = s;
+}
+
+
+static bool __attribute__((nonnull))
+vec_rem(struct sock_vec * const v, const struct w_sock * const s)
+{
+    for (uint32_t i = 0; i < v->n; i++)
+        if (v->s[i] == s) {
+            v->s[i] = v->s[--v->n];
+            return true;
+        }
+    return false;
+}
+
+
+/// Post spare w_iovs to the provided buffer ring, and re-arm the multishot
+/// recvmsg of sockets that ran out of buffers.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) uring_refill(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    const uint16_t len = max_buf_len(w);
+    uint16_t tail = b->br_tail;
+    while (b->br_cnt <= b->br_mask) {
+        struct w_iov * const v = w_alloc_iov_base(w);
+        if (unlikely(v == 0))
+            break;
+        const uint16_t bid = tail & b->br_mask;
+        b->br_iov[bid] = v;
+        b->br->bufs[bid] = (struct io_uring_buf){
+            .addr = (uint64_t)(uintptr_t)v->base, .len = len, .bid = bid};
+        tail++;
+        b->br_cnt++;
+    }
+    if (tail != b->br_tail) {
+        b->br_tail = tail;
+        __atomic_store_n(&b->br->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if (likely(b->rearm.n == 0) || unlikely(b->br_cnt == 0))
+        return;
+    for (uint32_t i = 0; i < b->rearm.n; i++)
+        uring_arm_rx(b->rearm.s[i]);
+    b->rearm.n = 0;
+}
+
+
+/// Extract the meta data and payload of a datagram received via multishot
+/// recvmsg into w_iov @p v, whose buffer starts with an io_uring_recvmsg_out.
+///
+/// @param      v     The w_iov to update.
+/// @param[in]  hdr   The msghdr template the recvmsg was armed with.
+///
+/// @return     False if the datagram did not fit into @p v and was truncated.
+///
+static bool __attribute__((nonnull))
+rx_meta(struct w_iov * const v, const struct msghdr * const hdr)
+{
+    const struct io_uring_recvmsg_out * const out = (void *)v->base;
+    uint8_t * const name = v->base + sizeof(*out);
+
+    if (unlikely(out->flags & MSG_TRUNC ||
+                 out->payloadlen > max_buf_len(v->w) - URING_RX_HDR))
+        return false;
+
+    v->buf = v->base + URING_RX_HDR;
+    v->len = (uint16_t)out->payloadlen;
+    v->wv_port = sa_port(name);
+    w_to_waddr(&v->wv_addr, (struct sockaddr *)(void *)name);
+
+    // extract TOS byte and TTL
+    struct msghdr m = {.msg_control = name + hdr->msg_namelen,
+                       .msg_controllen = out->controllen};
+    for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&m); cmsg;
+         cmsg = CMSG_NXTHDR(&m, cmsg)) {
+        if (cmsg->cmsg_level != IPPROTO_IP && cmsg->cmsg_level != IPPROTO_IPV6)
+            continue;
+        if (cmsg->cmsg_type == IP_TOS || cmsg->cmsg_type == IPV6_TCLASS)
+            v->flags = *(uint8_t *)CMSG_DATA(cmsg);
+        else if (cmsg->cmsg_type == IP_TTL)
+            v->ttl = *(uint8_t *)CMSG_DATA(cmsg);
+    }
+    return true;
+}
+
+
+/// Process a CQE of a multishot recvmsg SQE.
+///
+/// @param      w     Backend engine.
+/// @param[in]  cqe   The CQE.
+/// @param[in]  ts    Time the CQE was reaped, for w_iov::ts.
+///
+/// @return     Whether a datagram was appended to w_sock::iv.
+///
+static bool __attribute__((nonnull))
+uring_rx_cqe(struct w_engine * const w,
+             const struct io_uring_cqe * const cqe,
+             const uint64_t ts)
+{
+    struct w_backend * const b = w->b;
+    struct w_sock * const s = (struct w_sock *)(uintptr_t)cqe->user_data;
+    bool rx = false;
+
+    if (likely(cqe->flags & IORING_CQE_F_BUFFER)) {
+        const uint16_t bid =
+            (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) & b->br_mask;
+        struct w_iov * const v = b->br_iov[bid];
+        b->br_iov[bid] = 0;
+        b->br_cnt--;
+        if (unlikely(cqe->res < 0 || s == b->closing))
+            w_free_iov(v);
+        else if (unlikely(rx_meta(v, &b->rx_hdr) == false)) {
+            // do not hand out a truncated datagram
+            w_free_iov(v);
+            count_drop(w, s, W_DROP_TRUNC);
+        } else {
+            v->ts = ts;
+            sq_insert_tail(&s->iv, v, next);
+            count_rx(s, v->len);
+            trace_ev(w, W_TRACE_RX, rx, v->idx, v->len, 0);
+            rx = true;
+        }
+    }
+
+    if (likely(cqe->flags & IORING_CQE_F_MORE))
+        return rx;
+
+    // the multishot recvmsg has terminated
+    if (s == b->closing) {
+        b->closing = 0;
+        return rx;
+    }
+    ensure(cqe->res != -EINVAL, "kernel lacks multishot recvmsg (need 6.0+)");
+    if (unlikely(cqe->res < 0 && cqe->res != -ENOBUFS))
+        warn(ERR, "recvmsg returned %d (%s)", -cqe->res, strerror(-cqe->res));
+    vec_add(&b->rearm, s);
+    return rx;
+}
+
+
+/// Process a CQE of a sendmsg SQE. Frees its slot in w_backend::tx, and if the
+/// application has already freed the w_iov and this was its last send in
+/// flight, returns the w_iov to the free pool.
+///
+/// @param      w     Backend engine.
+/// @param[in]  cqe   The CQE.
+/// @param[in]  now   Time the CQE was reaped.
+///
+static void __attribute__((nonnull))
+uring_tx_cqe(struct w_engine * const w,
+             const struct io_uring_cqe * const cqe,
+             const uint64_t now)
+{
+    struct w_backend * const b = w->b;
+    const uint32_t slot = (uint32_t)(cqe->user_data >> URING_TAG_BITS);
+    const struct uring_tx * const t = &b->tx[slot];
+    if (unlikely(w->hist) && t->t)
+        hist_add(w, W_HIST_TX, t->t, now);
+
+    if (unlikely(cqe->res < 0)) {
+        warn(ERR, "sendmsg returned %d (%s)", -cqe->res, strerror(-cqe->res));
+        // the SQE does not identify the w_sock
+        count_drop(w, 0,
+                   cqe->res == -EAGAIN ? W_DROP_TX_FULL : W_DROP_TX_ERR);
+    }
+
+    uint16_t * const ref = &b->tx_ref[t->idx];
+    if (--*ref == TX_HELD) {
+        *ref = 0;
+        w_free_iov(&w->bufs[t->idx]);
+    }
+    b->tx_free[b->tx_nfree++] = slot;
+}
+
+
+/// Process all available CQEs, without entering the kernel.
+///
+/// @param      w     Backend engine.
+///
+/// @return     Number of datagrams received.
+///
+static uint32_t __attribute__((nonnull)) uring_reap(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    uint32_t head = *b->cq_khead;
+    const uint32_t tail = __atomic_load_n(b->cq_ktail, __ATOMIC_ACQUIRE);
+    const uint64_t now = tail != head ? w_now(CLOCK_REALTIME) : 0;
+
+    uint32_t n = 0;
+    for (; head != tail; head++) {
+        const struct io_uring_cqe * const cqe = &b->cqes[head & b->cq_mask];
+        const uint64_t tag =
+            cqe->user_data & ((UINT64_C(1) << URING_TAG_BITS) - 1);
+        switch (tag) {
+        case URING_TAG_TX:
+            uring_tx_cqe(w, cqe, now);
+            break;
+        case URING_TAG_CANCEL:
+            break;
+        default:
+            n += uring_rx_cqe(w, cqe, now);
+        }
+    }
+
+    __atomic_store_n(b->cq_khead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+
+/// Set the socket options.
+///
+/// @param      s     The w_sock to change options for.
+/// @param[in]  opt   Socket options for this socket.
+///
+void w_set_sockopt(struct w_sock * const s, const struct w_sockopt * const opt)
+{
+    if (s->ws_af == AF_INET &&
+        s->opt.enable_udp_zero_checksums != opt->enable_udp_zero_checksums) {
+        s->opt.enable_udp_zero_checksums = opt->enable_udp_zero_checksums;
+        ensure(setsockopt((int)s->fd, SOL_SOCKET, SO_NO_CHECK,
+                          &(int){s->opt.enable_udp_zero_checksums},
+                          sizeof(int)) >= 0,
+               "cannot setsockopt SO_NO_CHECK");
+    }
+
+    if (s->opt.enable_ecn != opt->enable_ecn) {
+        s->opt.enable_ecn = opt->enable_ecn;
+        const int ret = setsockopt(
+            (int)s->fd, s->ws_af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6,
+            s->ws_af == AF_INET ? IP_TOS : IPV6_TCLASS,
+            &(int){s->opt.enable_ecn ? ECN_ECT0 : ECN_NOT}, sizeof(int));
+        if (unlikely(ret < 0))
+            warn(WRN, "cannot setsockopt IP_TOS/IPV6_TCLASS; running on WSL?");
+    }
+
+    s->opt.user_1 = opt->user_1;
+    s->opt.user_2 = opt->user_2;
+    s->opt.user_3 = opt->user_3;
+}
+
+
+/// Initialize the warpcore io_uring backend for engine @p w. Sets up the
+/// rings, and registers a provided buffer ring that is filled from the engine
+/// buffers.
+///
+/// @param      w      Backend engine.
+/// @param[in]  nbufs  Number of packet buffers to allocate.
+///
+void backend_init(struct w_engine * const w, const uint32_t nbufs)
+{
+    struct w_backend * const b = w->b;
+
+    backend_addr_config(w); // do this first so w->mtu is set for max_buf_len
+    // some interfaces can have huge MTUs, so cap to something more sensible
+    w->mtu = MIN(w->mtu, (uint16_t)getpagesize() / 2);
+
+    ensure((w->mem = calloc(nbufs, max_buf_len(w))) != 0,
+           "cannot alloc %" PRIu32 " * %u buf mem", nbufs, max_buf_len(w));
+    ensure((w->bufs = calloc(nbufs, sizeof(*w->bufs))) != 0,
+           "cannot alloc bufs");
+    w->backend_name = "io_uring";
+    w->backend_variant = "multishot/pbuf";
+
+    for (uint32_t i = 0; i < nbufs; i++) {
+        init_iov(w, &w->bufs[i], i);
+        sq_insert_head(&w->iov, &w->bufs[i], next);
+        ASAN_POISON_MEMORY_REGION(w->bufs[i].buf, max_buf_len(w));
+    }
+
+    struct io_uring_params p = {
+        .flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL |
+                 IORING_SETUP_COOP_TASKRUN,
+        .cq_entries = URING_CQ_ENTRIES};
+    ensure((b->fd = sys_io_uring_setup(URING_SQ_ENTRIES, &p)) >= 0,
+           "io_uring_setup");
+    ensure(p.features & IORING_FEAT_SINGLE_MMAP &&
+               p.features & IORING_FEAT_EXT_ARG,
+           "kernel io_uring lacks needed features");
+
+    b->ring_len =
+        MAX(p.sq_off.array + p.sq_entries * sizeof(uint32_t),
+            p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+    b->ring = mmap(0, b->ring_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, b->fd, IORING_OFF_SQ_RING);
+    ensure(b->ring != MAP_FAILED, "cannot mmap io_uring");
+    b->sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, b->fd,
+                   IORING_OFF_SQES);
+    ensure(b->sqes != MAP_FAILED, "cannot mmap io_uring SQEs");
+
+    uint8_t * const r = b->ring;
+    b->sq_khead = (uint32_t *)(void *)(r + p.sq_off.head);
+    b->sq_ktail = (uint32_t *)(void *)(r + p.sq_off.tail);
+    b->sq_array = (uint32_t *)(void *)(r + p.sq_off.array);
+    b->sq_mask = *(uint32_t *)(void *)(r + p.sq_off.ring_mask);
+    b->sq_entries = p.sq_entries;
+    b->sq_tail = *b->sq_ktail;
+    b->cq_khead = (uint32_t *)(void *)(r + p.cq_off.head);
+    b->cq_ktail = (uint32_t *)(void *)(r + p.cq_off.tail);
+    b->cqes = (struct io_uring_cqe *)(void *)(r + p.cq_off.cqes);
+    b->cq_mask = *(uint32_t *)(void *)(r + p.cq_off.ring_mask);
+
+    ensure((b->tx = calloc(p.sq_entries, sizeof(*b->tx))) != 0,
+           "cannot alloc TX headers");
+    ensure((b->tx_free = calloc(p.sq_entries, sizeof(*b->tx_free))) != 0,
+           "cannot alloc TX slot list");
+    for (uint32_t i = 0; i < p.sq_entries; i++)
+        b->tx_free[b->tx_nfree++] = p.sq_entries - 1 - i;
+    ensure((b->tx_ref = calloc(nbufs, sizeof(*b->tx_ref))) != 0,
+           "cannot alloc TX refs");
+
+    // use at most half the buffers for RX, rounded down to a power of two
+    uint32_t br_entries = URING_BR_ENTRIES;
+    while (br_entries > 1 && br_entries > nbufs / 2)
+        br_entries >>= 1;
+    b->br_mask = (uint16_t)(br_entries - 1);
+    b->br = mmap(0, br_entries * sizeof(struct io_uring_buf),
+                 PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    ensure(b->br != MAP_FAILED, "cannot mmap buffer ring");
+    ensure((b->br_iov = calloc(br_entries, sizeof(*b->br_iov))) != 0,
+           "cannot alloc buffer ring w_iovs");
+    struct io_uring_buf_reg reg = {.ring_addr = (uint64_t)(uintptr_t)b->br,
+                                   .ring_entries = br_entries,
+                                   .bgid = URING_BGID};
+    ensure(sys_io_uring_register(b->fd, IORING_REGISTER_PBUF_RING, &reg, 1) ==
+               0,
+           "cannot register buffer ring (need Linux 5.19+)");
+    uring_refill(w);
+
+    b->rx_hdr = (struct msghdr){.msg_namelen = URING_NAME_LEN,
+                                .msg_controllen = URING_CTRL_LEN};
+
+    warn(DBG, "%s backend using %s, %u SQEs, %u CQEs, %" PRIu32 " RX bufs",
+         w->backend_name, w->backend_variant, p.sq_entries, p.cq_entries,
+         br_entries);
+}
+
+
+/// Shut a warpcore io_uring engine down cleanly. Closing the ring cancels all
+/// outstanding requests.
+///
+/// @param      w     Backend engine.
+///
+void backend_cleanup(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    ensure(close(b->fd) == 0, "close");
+    munmap(b->br, ((uint32_t)b->br_mask + 1) * sizeof(struct io_uring_buf));
+    munmap(b->sqes, b->sq_entries * sizeof(struct io_uring_sqe));
+    munmap(b->ring, b->ring_len);
+    free(b->br_iov);
+    free(b->tx);
+    free(b->tx_free);
+    free(b->tx_ref);
+    free(b->socks.s);
+    free(b->rearm.s);
+    free(w->mem);
+    free(w->bufs);
+}
+
+
+/// Bind a warpcore io_uring-backend socket, and arm a multishot recvmsg on it.
+///
+/// @param      s     The w_sock to bind.
+/// @param[in]  opt   Socket options for this socket. Can be zero.
+///
+/// @return     Zero on success, @p errno otherwise.
+///
+int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
+{
+    s->fd = socket(s->ws_af, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (unlikely(s->fd < 0))
+        return errno;
+
+    struct sockaddr_storage ss;
+    to_sockaddr((struct sockaddr *)&ss, &s->ws_laddr, s->ws_lport, s->ws_scope);
+    if (unlikely(bind((int)s->fd, (struct sockaddr *)&ss, sa_len(s->ws_af)) !=
+                 0)) {
+        const int e = errno;
+        close((int)s->fd);
+        return e;
+    }
+
+    // enable always receiving TOS and TTL information
+    ensure(setsockopt((int)s->fd,
+                      s->ws_af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6,
+                      s->ws_af == AF_INET ? IP_RECVTOS : IPV6_RECVTCLASS,
+                      &(int){1}, sizeof(int)) >= 0,
+           "cannot setsockopt IP_RECVTOS/IPV6_RECVTCLASS");
+    ensure(setsockopt((int)s->fd, IPPROTO_IP, IP_RECVTTL, &(int){1},
+                      sizeof(int)) >= 0,
+           "cannot setsockopt IP_RECVTTL");
+
+    if (s->ws_af == AF_INET)
+        // enable set DF
+        ensure(setsockopt((int)s->fd, IPPROTO_IP, IP_MTU_DISCOVER,
+                          &(int){IP_PMTUDISC_DO}, sizeof(int)) >= 0,
+               "cannot setsockopt IP_MTU_DISCOVER");
+
+    if (opt)
+        w_set_sockopt(s, opt);
+
+    // if we're binding to a random port, find out what it is
+    if (s->ws_lport == 0) {
+        socklen_t len = sizeof(ss);
+        ensure(getsockname((int)s->fd, (struct sockaddr *)&ss, &len) >= 0,
+               "getsockname");
+        s->ws_lport = sa_port(&ss);
+    }
+
+    vec_add(&s->w->b->socks, s);
+    uring_arm_rx(s);
+    return 0;
+}
+
+
+void backend_preconnect(struct w_sock * const s __attribute__((unused))) {}
+
+
+/// Nothing to do for io_uring; w_nic_rx() spins on the completion queue.
+///
+/// @param      w     Backend engine.
+///
+void backend_busy_poll(struct w_engine * const w __attribute__((unused))) {}
+
+
+/// Connect the underlying socket.
+///
+/// @param      s     The w_sock to connect.
+///
+/// @return     Zero on success, @p errno otherwise.
+///
+int backend_connect(struct w_sock * const s)
+{
+    struct sockaddr_storage ss;
+    to_sockaddr((struct sockaddr *)&ss, &s->ws_raddr, s->ws_rport, s->ws_scope);
+    if (unlikely(connect((int)s->fd, (struct sockaddr *)&ss,
+                         sa_len(ss.ss_family)) != 0))
+        return errno;
+    return 0;
+}
+
+
+/// Close the socket. Cancels its multishot recvmsg and waits for the final
+/// CQE, so that no CQE refers to @p s after it has been freed. Any unread data
+/// is returned to the engine.
+///
+/// @param      s     The w_sock to close.
+///
+void backend_close(struct w_sock * const s)
+{
+    struct w_engine * const w = s->w;
+    struct w_backend * const b = w->b;
+
+    vec_rem(&b->socks, s);
+    if (vec_rem(&b->rearm, s) == false) {
+        struct io_uring_sqe * const sqe = uring_sqe(b);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = (uint64_t)(uintptr_t)s;
+        sqe->user_data = URING_TAG_CANCEL;
+        b->closing = s;
+        while (b->closing) {
+            uring_enter(b, 1, -1);
+            uring_reap(w);
+        }
+    } else if (b->sq_tail != *b->sq_khead)
+        // make sure no queued SQE refers to the descriptor after close
+        uring_enter(b, 0, 0);
+
+    w_free(&s->iv);
+    ensure(close((int)s->fd) == 0, "close");
+}
+
+
+/// Queue SQEs that send the w_iov structures in the tail queue @p o over
+/// w_sock @p s. The SQEs are not linked, so that the failure of one datagram
+/// does not cancel the others. They are submitted by w_nic_tx() or w_nic_rx(),
+/// and the w_iovs must not be modified while w_tx_pending() is true for them.
+/// Freeing them is safe.
+///
+/// @param      s     w_sock socket to transmit over.
+/// @param      o     w_iov_sq to send.
+///
+void backend_tx(struct w_sock * const s, struct w_iov_sq * const o)
+{
+    struct w_backend * const b = s->w->b;
+    const uint64_t t0 = unlikely(s->w->hist) ? w_now(CLOCK_REALTIME) : 0;
+    struct w_iov * v;
+    sq_foreach (v, o, next) {
+        // if out of headers, wait for a send to complete
+        while (unlikely(b->tx_nfree == 0)) {
+            uring_enter(b, 1, -1);
+            uring_reap(s->w);
+        }
+        struct uring_tx * const t = &b->tx[b->tx_free[--b->tx_nfree]];
+
+        // if w_sock is disconnected, use destination IP and port from w_iov
+        // instead of the one in the template header
+        if (w_connected(s))
+            v->saddr = s->tup.remote;
+        else
+            to_sockaddr((struct sockaddr *)&t->sa, &v->wv_addr, v->wv_port,
+                        s->ws_scope);
+        t->iov = (struct iovec){.iov_base = v->buf, .iov_len = v->len};
+        t->t = t0;
+        t->idx = w_iov_idx(v);
+        t->hdr = (struct msghdr){
+            .msg_name = w_connected(s) ? 0 : &t->sa,
+            .msg_namelen = w_connected(s) ? 0 : sa_len(t->sa.ss_family),
+            .msg_iov = &t->iov,
+            .msg_iovlen = 1};
+
+        // set TOS from w_iov
+        if (v->flags) {
+            t->hdr.msg_control = t->ctrl;
+            t->hdr.msg_controllen = sizeof(t->ctrl);
+            struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&t->hdr);
+            cmsg->cmsg_level = s->ws_af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
+            cmsg->cmsg_type = s->ws_af == AF_INET ? IP_TOS : IPV6_TCLASS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            *(int *)(void *)CMSG_DATA(cmsg) = v->flags;
+        } else if (s->opt.enable_ecn)
+            // make sure that the flags reflect what went out on the wire
+            v->flags = ECN_ECT0;
+
+        struct io_uring_sqe * const sqe = uring_sqe(b);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = (int)s->fd;
+        sqe->addr = (uint64_t)(uintptr_t)&t->hdr;
+        sqe->len = 1;
+        sqe->user_data = URING_TAG_TX |
+                         (uint64_t)(t - b->tx) << URING_TAG_BITS;
+        b->tx_ref[t->idx]++;
+        count_tx(s, v->len);
+        trace_ev(s->w, W_TRACE_TX, tx, t - b->tx, v->len, 0);
+    }
+}
+
+
+/// Submit all queued SQEs, and reap the completions that are available,
+/// without waiting for the sends still in flight.
+///
+/// @param[in]  w     Backend engine.
+///
+void backend_nic_tx(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    if (b->tx_nfree == b->sq_entries && b->sq_tail == *b->sq_khead)
+        return;
+    uring_enter(b, 0, 0);
+    uring_reap(w);
+}
+
+
+/// Check/wait until any data has been received. Replenishes the provided
+/// buffer ring, submits all queued SQEs and waits for completions in a single
+/// io_uring_enter() call, and then reaps the CQEs that it made available.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
+///                   for infinite wait.
+///
+/// @return     Whether any data is ready for reading.
+///
+bool backend_nic_rx(struct w_engine * const w, const int64_t nsec)
+{
+    struct w_backend * const b = w->b;
+
+    uring_refill(w);
+    bool pending =
+        *b->cq_khead != __atomic_load_n(b->cq_ktail, __ATOMIC_ACQUIRE);
+    int64_t t = nsec;
+    if (pending == false)
+        // with IORING_SETUP_COOP_TASKRUN, completions are only posted while
+        // we are in io_uring_enter(), so enter without waiting while spinning
+        pending = spin_rx(w, t,
+                          (uring_enter(b, 0, 0),
+                           *b->cq_khead != __atomic_load_n(b->cq_ktail,
+                                                           __ATOMIC_ACQUIRE)));
+    uring_enter(b, pending || t == 0 ? 0 : 1, t);
+    return uring_reap(w) != 0;
+}
+
+
+/// Fill a w_sock_slist with pointers to sockets with pending inbound data.
+/// Data can be obtained via w_rx() on each w_sock in the list.
+///
+/// @param[in]  w     Backend engine.
+/// @param      sl    Empty and initialized w_sock_slist.
+///
+/// @return     Number of connections that are ready for reading.
+///
+uint32_t backend_rx_ready(struct w_engine * const w,
+                          struct w_sock_slist * const sl)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < w->b->socks.n; i++) {
+        struct w_sock * const s = w->b->socks.s[i];
+        if (!sq_empty(&s->iv)) {
+            sl_insert_head(sl, s, next);
+            n++;
+        }
+    }
+    return n;
+}
+
+
+/// Return the data received on w_sock @p s, which w_nic_rx() has appended to
+/// w_sock::iv.
+///
+/// @param      s     w_sock for which the application would like to receive
+///                   new data.
+/// @param      i     w_iov tail queue to append new data to.
+///
+void backend_rx(struct w_sock * const s, struct w_iov_sq * const i)
+{
+    sq_concat(i, &s->iv);
+}
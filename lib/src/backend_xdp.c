@@ -0,0 +1,483 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+#ifdef HAVE_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+#include "backend.h"
+#include "eth.h"
+#include "hist.h"
+#include "ifaddr.h"
+#include "neighbor.h"
+
+
+// Number of entries in each of the RX, TX, fill and completion rings.
+#define XSK_RING_SIZE 2048
+
+
+static int bpf(const int cmd, union bpf_attr * const attr)
+{
+    return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+
+/// Map one of the rings of the AF_XDP socket @p fd into memory.
+///
+/// @param      r          The ring to map.
+/// @param[in]  fd         AF_XDP socket.
+/// @param[in]  off        Offsets of the ring members, from XDP_MMAP_OFFSETS.
+/// @param[in]  desc_size  Size of a ring entry.
+/// @param[in]  pgoff      mmap() offset selecting the ring.
+///
+static void __attribute__((nonnull))
+xsk_ring_map(struct xsk_ring * const r,
+             const int fd,
+             const struct xdp_ring_offset * const off,
+             const size_t desc_size,
+             const off_t pgoff)
+{
+    r->map_len = off->desc + XSK_RING_SIZE * desc_size;
+    r->map = mmap(0, r->map_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    ensure(r->map != MAP_FAILED, "cannot mmap AF_XDP ring");
+    uint8_t * const m = r->map;
+    r->prod = (uint32_t *)(void *)(m + off->producer);
+    r->cons = (uint32_t *)(void *)(m + off->consumer);
+    r->flags = (uint32_t *)(void *)(m + off->flags);
+    r->desc = m + off->desc;
+    r->mask = XSK_RING_SIZE - 1;
+}
+
+
+/// Reclaim the UMEM frames of transmitted w_iovs from the completion ring, and
+/// swap them back into their w_iovs. Records their W_HIST_TX latency, if
+/// enabled.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) xsk_complete(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    const uint32_t prod = __atomic_load_n(b->cr.prod, __ATOMIC_ACQUIRE);
+    if (prod == b->cr.cached)
+        return;
+
+    const uint64_t now = unlikely(w->hist) ? w_now(CLOCK_REALTIME) : 0;
+    for (; b->cr.cached != prod; b->cr.cached++) {
+        const uint64_t addr =
+            ((uint64_t *)b->cr.desc)[b->cr.cached & b->cr.mask];
+        const uint32_t f = (uint32_t)(addr >> XSK_FRAME_SHIFT);
+        if (unlikely(now) && b->tx_t[f])
+            hist_add(w, W_HIST_TX, b->tx_t[f], now);
+        struct w_iov * const v = b->tx_iov[f];
+        b->tx_iov[f] = 0;
+        b->tx_spare[b->tx_spare_cnt++] = v->idx;
+        v->idx = f;
+    }
+    __atomic_store_n(b->cr.cons, b->cr.cached, __ATOMIC_RELEASE);
+}
+
+
+/// Load an XDP program that redirects all frames arriving on an RX queue to
+/// the AF_XDP socket in @p b->map_fd for that queue (or passes them to the
+/// kernel if there is none), and attach it to interface @p ifindex.
+///
+/// @param      b        Backend.
+/// @param[in]  ifindex  Interface index.
+///
+/// @return     Whether the program was attached in driver mode.
+///
+static bool __attribute__((nonnull))
+xsk_attach_prog(struct w_backend * const b, const uint32_t ifindex)
+{
+    union bpf_attr attr = {.map_type = BPF_MAP_TYPE_XSKMAP,
+                           .key_size = sizeof(uint32_t),
+                           .value_size = sizeof(int),
+                           .max_entries = 1};
+    ensure((b->map_fd = bpf(BPF_MAP_CREATE, &attr)) >= 0,
+           "cannot create XSKMAP");
+
+    // return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+    const struct bpf_insn prog[] = {
+        {.code = BPF_LDX | BPF_W | BPF_MEM,
+         .dst_reg = BPF_REG_2,
+         .src_reg = BPF_REG_1,
+         .off = offsetof(struct xdp_md, rx_queue_index)},
+        {.code = BPF_LD | BPF_DW | BPF_IMM,
+         .dst_reg = BPF_REG_1,
+         .src_reg = BPF_PSEUDO_MAP_FD,
+         .imm = b->map_fd},
+        {.code = 0}, // second half of the 64-bit immediate load
+        {.code = BPF_ALU64 | BPF_MOV | BPF_K,
+         .dst_reg = BPF_REG_3,
+         .imm = XDP_PASS},
+        {.code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map},
+        {.code = BPF_JMP | BPF_EXIT}};
+    attr = (union bpf_attr){.prog_type = BPF_PROG_TYPE_XDP,
+                            .insns = (uint64_t)(uintptr_t)prog,
+                            .insn_cnt = sizeof(prog) / sizeof(prog[0]),
+                            .license = (uint64_t)(uintptr_t) "GPL"};
+    ensure((b->prog_fd = bpf(BPF_PROG_LOAD, &attr)) >= 0,
+           "cannot load XDP program");
+
+    // prefer driver mode, fall back to generic (skb) mode
+    attr = (union bpf_attr){.link_create = {.prog_fd = (uint32_t)b->prog_fd,
+                                            .target_ifindex = ifindex,
+                                            .attach_type = BPF_XDP,
+                                            .flags = XDP_FLAGS_DRV_MODE}};
+    if ((b->link_fd = bpf(BPF_LINK_CREATE, &attr)) >= 0)
+        return true;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    ensure((b->link_fd = bpf(BPF_LINK_CREATE, &attr)) >= 0,
+           "cannot attach XDP program");
+    return false;
+}
+
+
+/// Initialize the warpcore AF_XDP backend for engine @p w. This sets up a UMEM
+/// holding the warpcore buffers, the AF_XDP socket and its rings, and an XDP
+/// program that redirects all inbound frames on queue 0 of the interface to
+/// the socket.
+///
+/// The UMEM holds @p nbufs frames for the w_iovs, followed by the frames that
+/// initially populate the fill ring, followed by the spare frames that are
+/// swapped into w_iovs while their frames are in the TX ring.
+///
+/// @param      w      Backend engine.
+/// @param[in]  nbufs  Number of packet buffers to allocate.
+///
+void backend_init(struct w_engine * const w, const uint32_t nbufs)
+{
+    struct w_backend * const b = w->b;
+
+    backend_addr_config(w);
+    w->mtu = MIN(w->mtu, XSK_FRAME_SIZE - XDP_PACKET_HEADROOM -
+                             sizeof(struct eth_hdr));
+
+    b->nframes = nbufs + 2 * XSK_RING_SIZE;
+    const size_t mem_len = (size_t)b->nframes << XSK_FRAME_SHIFT;
+    w->mem = mmap(0, mem_len, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | PLAT_MMFLAGS, -1, 0);
+    ensure(w->mem != MAP_FAILED, "cannot mmap %" PRIu32 " UMEM frames",
+           b->nframes);
+    ensure((w->bufs = calloc(nbufs, sizeof(*w->bufs))) != 0,
+           "cannot alloc bufs");
+    for (uint32_t i = 0; i < nbufs; i++) {
+        init_iov(w, &w->bufs[i], i);
+        sq_insert_head(&w->iov, &w->bufs[i], next);
+        ASAN_POISON_MEMORY_REGION(w->bufs[i].buf, max_buf_len(w));
+    }
+    edt_init(w, nbufs);
+
+    // create the AF_XDP socket and register the UMEM
+    ensure((b->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0)) >= 0,
+           "cannot create AF_XDP socket");
+    const struct xdp_umem_reg reg = {.addr = (uint64_t)(uintptr_t)w->mem,
+                                     .len = mem_len,
+                                     .chunk_size = XSK_FRAME_SIZE};
+    ensure(setsockopt(b->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) == 0,
+           "cannot register UMEM");
+    static const int rings[] = {XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING,
+                                XDP_RX_RING, XDP_TX_RING};
+    for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++)
+        ensure(setsockopt(b->fd, SOL_XDP, rings[i], &(int){XSK_RING_SIZE},
+                          sizeof(int)) == 0,
+               "cannot size AF_XDP ring");
+
+    struct xdp_mmap_offsets off;
+    ensure(getsockopt(b->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off,
+                      &(socklen_t){sizeof(off)}) == 0,
+           "cannot get AF_XDP ring offsets");
+    xsk_ring_map(&b->rx, b->fd, &off.rx, sizeof(struct xdp_desc),
+                 XDP_PGOFF_RX_RING);
+    xsk_ring_map(&b->tx, b->fd, &off.tx, sizeof(struct xdp_desc),
+                 XDP_PGOFF_TX_RING);
+    xsk_ring_map(&b->fr, b->fd, &off.fr, sizeof(uint64_t),
+                 XDP_UMEM_PGOFF_FILL_RING);
+    xsk_ring_map(&b->cr, b->fd, &off.cr, sizeof(uint64_t),
+                 XDP_UMEM_PGOFF_COMPLETION_RING);
+
+    // populate the fill ring, and set aside the TX spare frames
+    for (uint32_t f = nbufs; f < nbufs + XSK_RING_SIZE; f++)
+        ((uint64_t *)b->fr.desc)[b->fr.cached++ & b->fr.mask] =
+            (uint64_t)f << XSK_FRAME_SHIFT;
+    __atomic_store_n(b->fr.prod, b->fr.cached, __ATOMIC_RELEASE);
+    ensure((b->tx_spare = calloc(XSK_RING_SIZE, sizeof(*b->tx_spare))) != 0,
+           "cannot alloc TX spare frames");
+    for (uint32_t f = nbufs + XSK_RING_SIZE; f < b->nframes; f++)
+        b->tx_spare[b->tx_spare_cnt++] = f;
+    ensure((b->tx_iov = calloc(b->nframes, sizeof(*b->tx_iov))) != 0,
+           "cannot alloc TX w_iov pointers");
+    ensure((b->tx_t = calloc(b->nframes, sizeof(*b->tx_t))) != 0,
+           "cannot alloc TX times");
+
+    // steer the interface to the socket; use zero-copy if the driver can
+    const uint32_t ifindex = if_nametoindex(w->ifname);
+    ensure(ifindex, "%s: cannot get interface index", w->ifname);
+    const bool drv = xsk_attach_prog(b, ifindex);
+    struct sockaddr_xdp sxdp = {.sxdp_family = AF_XDP,
+                                .sxdp_flags =
+                                    XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP,
+                                .sxdp_ifindex = ifindex,
+                                .sxdp_queue_id = 0};
+    bool zc = drv && bind(b->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) == 0;
+    if (zc == false) {
+        sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+        ensure(bind(b->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) == 0,
+               "%s: cannot bind AF_XDP socket", w->ifname);
+    }
+    union bpf_attr attr = {.map_fd = (uint32_t)b->map_fd,
+                           .key = (uint64_t)(uintptr_t) & (uint32_t){0},
+                           .value = (uint64_t)(uintptr_t)&b->fd};
+    ensure(bpf(BPF_MAP_UPDATE_ELEM, &attr) == 0, "cannot update XSKMAP");
+
+    w->backend_name = "xdp";
+    w->backend_variant = drv ? (zc ? "driver/zero-copy" : "driver/copy")
+                             : "generic/copy";
+    warn(DBG, "%s backend using %s mode", w->backend_name, w->backend_variant);
+}
+
+
+/// Shut a warpcore AF_XDP engine down cleanly. This detaches the XDP program
+/// from the interface and frees the UMEM.
+///
+/// @param      w     Backend engine.
+///
+void backend_cleanup(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+
+    // close all sockets, and free the state of the userspace stack
+    eth_cleanup(w);
+
+    // closing the link detaches the XDP program
+    ensure(close(b->link_fd) != -1, "cannot close XDP link");
+    ensure(close(b->prog_fd) != -1, "cannot close XDP program");
+    ensure(close(b->map_fd) != -1, "cannot close XSKMAP");
+
+    struct xsk_ring * const rings[] = {&b->rx, &b->tx, &b->fr, &b->cr};
+    for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++)
+        ensure(munmap(rings[i]->map, rings[i]->map_len) != -1,
+               "cannot munmap AF_XDP ring");
+    ensure(close(b->fd) != -1, "cannot close AF_XDP socket");
+    ensure(munmap(w->mem, (size_t)b->nframes << XSK_FRAME_SHIFT) != -1,
+           "cannot munmap UMEM");
+
+    free(w->bufs);
+    free(b->tx_iov);
+    free(b->tx_spare);
+}
+
+
+/// Places an Ethernet frame into the TX ring. The Ethernet frame is contained
+/// in the w_iov @p v, whose UMEM frame is handed to the kernel as-is. A spare
+/// frame is swapped into @p v until w_nic_tx() reaps the completion.
+///
+/// @param      v     The w_iov containing the Ethernet frame to transmit.
+///
+/// @return     True if the buffer was placed into the TX ring, false otherwise.
+///
+bool eth_tx(struct w_iov * const v)
+{
+    struct w_backend * const b = v->w->b;
+
+    if (unlikely(b->tx_spare_cnt == 0)) {
+        xsk_complete(v->w);
+        if (b->tx_spare_cnt == 0) {
+            warn(NTE, "tx ring is full");
+            return false;
+        }
+    }
+
+    // there is one spare frame per TX ring entry, so there is ring space
+    trace_ev(v->w, W_TRACE_TX, tx, b->tx.cached & b->tx.mask, v->len, 0);
+    struct xdp_desc * const d =
+        &((struct xdp_desc *)b->tx.desc)[b->tx.cached++ & b->tx.mask];
+    d->addr = (uint64_t)(v->base - (uint8_t *)v->w->mem);
+    d->len = v->len + sizeof(struct eth_hdr);
+    d->options = 0;
+    cap_tap(v->w, v->base, d->len);
+
+    warn(DBG, "Eth %s -> %s, type 0x%04x, len %u",
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->src, eth_tmp,
+                  ETH_STRLEN),
+         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->dst, eth_tmp,
+                  ETH_STRLEN),
+         bswap16(((struct eth_hdr *)(void *)v->base)->type), d->len);
+
+    // temporarily swap a spare frame into v
+    b->tx_iov[v->idx] = v;
+    if (unlikely(v->w->hist))
+        b->tx_t[v->idx] = w_now(CLOCK_REALTIME);
+    v->idx = b->tx_spare[--b->tx_spare_cnt];
+    return true;
+}
+
+
+/// Have the kernel busy-poll the NIC queue bound to the AF_XDP socket of
+/// engine @p w, when w_nic_rx() kicks it during its spin budget.
+///
+/// @param      w     Backend engine.
+///
+void backend_busy_poll(struct w_engine * const w
+#ifndef SO_PREFER_BUSY_POLL
+                       __attribute__((unused))
+#endif
+)
+{
+#ifdef SO_PREFER_BUSY_POLL
+    const int fd = w->b->fd;
+    const int usec =
+        (int)MIN(INT32_MAX, NS_TO_US(w->busy_poll + NS_PER_US - 1));
+    if (unlikely(setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                            &(int){usec != 0}, sizeof(int)) < 0 ||
+                 setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec,
+                            sizeof(usec)) < 0 ||
+                 setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &(int){64},
+                            sizeof(int)) < 0))
+        warn(WRN, "cannot configure AF_XDP busy-polling (%s)", strerror(errno));
+#endif
+}
+
+
+/// Kick the AF_XDP socket of backend @p b, which busy-polls its NIC queue if
+/// busy-polling is configured, and check the RX ring for new frames.
+///
+/// @param      b     Backend.
+///
+/// @return     Whether the RX ring holds new frames.
+///
+static bool __attribute__((nonnull)) xsk_rx_poll(struct w_backend * const b)
+{
+    recvfrom(b->fd, 0, 0, MSG_DONTWAIT, 0, 0);
+    return __atomic_load_n(b->rx.prod, __ATOMIC_ACQUIRE) != b->rx.cached;
+}
+
+
+/// Trigger the kernel to make new received data available to w_rx(). Iterates
+/// over any new frames in the RX ring, calling eth_rx() for each, and returns
+/// their frames to the fill ring.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
+///                   for infinite wait.
+///
+/// @return     Whether any data is ready for reading.
+///
+bool backend_nic_rx(struct w_engine * const w, const int64_t nsec)
+{
+    struct w_backend * const b = w->b;
+    struct pollfd fds = {.fd = b->fd, .events = POLLIN};
+    int64_t t = nsec;
+again:
+    if (__atomic_load_n(b->rx.prod, __ATOMIC_ACQUIRE) == b->rx.cached &&
+        spin_rx(w, t, xsk_rx_poll(b)) == false &&
+        ((w->spin && t == 0) || poll_ns(&fds, 1, t) == 0))
+        return false;
+
+    bool rx = false;
+    const uint32_t prod = __atomic_load_n(b->rx.prod, __ATOMIC_ACQUIRE);
+    // AF_XDP descriptors carry no timestamp, so use the time of this poll
+    const uint64_t ts = w_now(CLOCK_REALTIME);
+    for (; b->rx.cached != prod; b->rx.cached++) {
+        const struct xdp_desc * const d =
+            &((struct xdp_desc *)b->rx.desc)[b->rx.cached & b->rx.mask];
+        struct w_slot s = {.buf_idx = (uint32_t)(d->addr >> XSK_FRAME_SHIFT),
+                           .len = (uint16_t)d->len,
+                           .ts = ts};
+        rx |= eth_rx(w, &s, (uint8_t *)w->mem + d->addr);
+
+        // return the frame (or the spare that udp_rx() swapped in) to the
+        // fill ring; every RX entry consumed a fill entry, so there is space
+        ((uint64_t *)b->fr.desc)[b->fr.cached++ & b->fr.mask] =
+            (uint64_t)s.buf_idx << XSK_FRAME_SHIFT;
+    }
+    __atomic_store_n(b->rx.cons, b->rx.cached, __ATOMIC_RELEASE);
+    __atomic_store_n(b->fr.prod, b->fr.cached, __ATOMIC_RELEASE);
+    if (*b->fr.flags & XDP_RING_NEED_WAKEUP)
+        recvfrom(b->fd, 0, 0, MSG_DONTWAIT, 0, 0);
+
+    if (rx == false && nsec == -1)
+        goto again;
+
+    return rx;
+}
+
+
+/// Push data placed in the TX ring via udp_tx() and similar methods out onto
+/// the link. Also move any transmitted frames back into the original w_iovs.
+/// Due w_iovs from the EDT queue are placed into the TX ring first.
+///
+/// @param[in]  w     Backend engine.
+///
+void backend_nic_tx(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+
+    edt_tx(w);
+    __atomic_store_n(b->tx.prod, b->tx.cached, __ATOMIC_RELEASE);
+
+    // in copy mode, the kernel only transmits a limited batch per kick
+    uint32_t cons = __atomic_load_n(b->tx.cons, __ATOMIC_ACQUIRE);
+    while (cons != b->tx.cached) {
+        if (sendto(b->fd, 0, 0, MSG_DONTWAIT, 0, 0) == -1 && errno != EAGAIN &&
+            errno != EBUSY && errno != ENOBUFS) {
+            warn(ERR, "cannot kick tx ring: %s", strerror(errno));
+            break;
+        }
+        const uint32_t prev = cons;
+        cons = __atomic_load_n(b->tx.cons, __ATOMIC_ACQUIRE);
+        if (cons == prev)
+            // no progress, try again on the next call
+            break;
+    }
+
+    xsk_complete(w);
+    edt_free(w);
+}
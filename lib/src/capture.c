@@ -0,0 +1,482 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+#include "capture.h"
+
+
+#define CAP_SIZE (64 * 1024 * 1024) ///< Default capture file size.
+
+// classic BPF opcode fields, as in <net/bpf.h> and <linux/filter.h>
+#define BPF_CLASS(c) ((c)&0x07)
+#define BPF_LD 0x00
+#define BPF_LDX 0x01
+#define BPF_ST 0x02
+#define BPF_STX 0x03
+#define BPF_ALU 0x04
+#define BPF_JMP 0x05
+#define BPF_RET 0x06
+#define BPF_MISC 0x07
+
+#define BPF_SIZE(c) ((c)&0x18)
+#define BPF_W 0x00
+#define BPF_H 0x08
+#define BPF_B 0x10
+
+#define BPF_MODE(c) ((c)&0xe0)
+#define BPF_IMM 0x00
+#define BPF_ABS 0x20
+#define BPF_IND 0x40
+#define BPF_MEM 0x60
+#define BPF_LEN 0x80
+#define BPF_MSH 0xa0
+
+#define BPF_OP(c) ((c)&0xf0)
+#define BPF_ADD 0x00
+#define BPF_SUB 0x10
+#define BPF_MUL 0x20
+#define BPF_DIV 0x30
+#define BPF_OR 0x40
+#define BPF_AND 0x50
+#define BPF_LSH 0x60
+#define BPF_RSH 0x70
+#define BPF_NEG 0x80
+#define BPF_MOD 0x90
+#define BPF_XOR 0xa0
+
+#define BPF_JA 0x00
+#define BPF_JEQ 0x10
+#define BPF_JGT 0x20
+#define BPF_JGE 0x30
+#define BPF_JSET 0x40
+
+#define BPF_SRC(c) ((c)&0x08)
+#define BPF_K 0x00
+#define BPF_X 0x08
+
+#define BPF_RVAL(c) ((c)&0x18)
+#define BPF_A 0x10
+
+#define BPF_MISCOP(c) ((c)&0xf8)
+#define BPF_TAX 0x00
+#define BPF_TXA 0x80
+
+#define BPF_MEMWORDS 16
+
+
+/// Load @p size bytes at offset @p off from packet @p buf, in host byte order.
+///
+/// @param[in]  buf   Packet.
+/// @param[in]  len   Length of @p buf.
+/// @param[in]  off   Offset of the load.
+/// @param[in]  size  BPF_W, BPF_H or BPF_B.
+/// @param      val   Loaded value.
+///
+/// @return     False if the load is out of bounds, true otherwise.
+///
+static bool __attribute__((nonnull)) bpf_load(const uint8_t * const buf,
+                                              const uint32_t len,
+                                              const uint32_t off,
+                                              const uint16_t size,
+                                              uint32_t * const val)
+{
+    const uint32_t n = size == BPF_W ? 4 : size == BPF_H ? 2 : 1;
+    if (off >= len || len - off < n)
+        return false;
+    const uint8_t * const p = &buf[off];
+    *val = n == 4   ? (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+                        (uint32_t)p[2] << 8 | p[3]
+           : n == 2 ? (uint32_t)p[0] << 8 | p[1]
+                    : p[0];
+    return true;
+}
+
+
+/// Run classic BPF program @p p against packet @p buf. Out-of-bounds loads and
+/// division by zero reject the packet, as in the kernel.
+///
+/// @param[in]  p     BPF program, validated by bpf_check().
+/// @param[in]  buf   Packet.
+/// @param[in]  len   Length of @p buf.
+///
+/// @return     Number of bytes of @p buf to accept, zero to reject it.
+///
+static uint32_t __attribute__((nonnull))
+bpf_run(const struct w_bpf_insn * const p,
+        const uint8_t * const buf,
+        const uint32_t len)
+{
+    uint32_t a = 0;
+    uint32_t x = 0;
+    uint32_t m[BPF_MEMWORDS] = {0};
+
+    for (const struct w_bpf_insn * i = p;; i++) {
+        const uint32_t k = i->k;
+        switch (BPF_CLASS(i->code)) {
+        case BPF_LD:
+            switch (BPF_MODE(i->code)) {
+            case BPF_IMM:
+                a = k;
+                break;
+            case BPF_ABS:
+                if (bpf_load(buf, len, k, BPF_SIZE(i->code), &a) == false)
+                    return 0;
+                break;
+            case BPF_IND:
+                if (bpf_load(buf, len, x + k, BPF_SIZE(i->code), &a) == false)
+                    return 0;
+                break;
+            case BPF_MEM:
+                a = m[k];
+                break;
+            case BPF_LEN:
+                a = len;
+                break;
+            }
+            break;
+
+        case BPF_LDX:
+            switch (BPF_MODE(i->code)) {
+            case BPF_IMM:
+                x = k;
+                break;
+            case BPF_MEM:
+                x = m[k];
+                break;
+            case BPF_LEN:
+                x = len;
+                break;
+            case BPF_MSH:
+                // IP header length
+                if (bpf_load(buf, len, k, BPF_B, &x) == false)
+                    return 0;
+                x = (x & 0xf) << 2;
+                break;
+            }
+            break;
+
+        case BPF_ST:
+            m[k] = a;
+            break;
+
+        case BPF_STX:
+            m[k] = x;
+            break;
+
+        case BPF_ALU:;
+            const uint32_t v = BPF_SRC(i->code) == BPF_X ? x : k;
+            switch (BPF_OP(i->code)) {
+            case BPF_ADD:
+                a += v;
+                break;
+            case BPF_SUB:
+                a -= v;
+                break;
+            case BPF_MUL:
+                a *= v;
+                break;
+            case BPF_DIV:
+                if (v == 0)
+                    return 0;
+                a /= v;
+                break;
+            case BPF_MOD:
+                if (v == 0)
+                    return 0;
+                a %= v;
+                break;
+            case BPF_OR:
+                a |= v;
+                break;
+            case BPF_AND:
+                a &= v;
+                break;
+            case BPF_XOR:
+                a ^= v;
+                break;
+            case BPF_LSH:
+                a = v < 32 ? a << v : 0;
+                break;
+            case BPF_RSH:
+                a = v < 32 ? a >> v : 0;
+                break;
+            case BPF_NEG:
+                a = -a;
+                break;
+            }
+            break;
+
+        case BPF_JMP:;
+            const uint32_t c = BPF_SRC(i->code) == BPF_X ? x : k;
+            switch (BPF_OP(i->code)) {
+            case BPF_JA:
+                i += k;
+                break;
+            case BPF_JEQ:
+                i += a == c ? i->jt : i->jf;
+                break;
+            case BPF_JGT:
+                i += a > c ? i->jt : i->jf;
+                break;
+            case BPF_JGE:
+                i += a >= c ? i->jt : i->jf;
+                break;
+            case BPF_JSET:
+                i += a & c ? i->jt : i->jf;
+                break;
+            }
+            break;
+
+        case BPF_RET:
+            return BPF_RVAL(i->code) == BPF_A   ? a
+                   : BPF_RVAL(i->code) == BPF_X ? x
+                                                : k;
+
+        case BPF_MISC:
+            if (BPF_MISCOP(i->code) == BPF_TAX)
+                x = a;
+            else
+                a = x;
+            break;
+        }
+    }
+}
+
+
+/// Check that classic BPF program @p p only uses supported instructions, does
+/// not access memory out of bounds, and cannot run past its end.
+///
+/// @param[in]  p     BPF program.
+/// @param[in]  n     Number of instructions in @p p.
+///
+/// @return     Whether @p p is valid.
+///
+static bool __attribute__((nonnull))
+bpf_check(const struct w_bpf_insn * const p, const uint16_t n)
+{
+    if (n == 0 || BPF_CLASS(p[n - 1].code) != BPF_RET)
+        return false;
+
+    for (uint32_t j = 0; j < n; j++) {
+        const struct w_bpf_insn * const i = &p[j];
+        const uint16_t mode = BPF_MODE(i->code);
+        switch (BPF_CLASS(i->code)) {
+        case BPF_LD:
+            if (mode == BPF_MEM && i->k >= BPF_MEMWORDS)
+                return false;
+            if ((mode == BPF_ABS || mode == BPF_IND) &&
+                BPF_SIZE(i->code) == 0x18)
+                return false;
+            if (mode > BPF_LEN)
+                return false;
+            break;
+        case BPF_LDX:
+            if (mode == BPF_MEM && i->k >= BPF_MEMWORDS)
+                return false;
+            if (mode == BPF_ABS || mode == BPF_IND || mode > BPF_MSH)
+                return false;
+            break;
+        case BPF_ST:
+        case BPF_STX:
+            if (i->k >= BPF_MEMWORDS)
+                return false;
+            break;
+        case BPF_ALU:
+            if (BPF_OP(i->code) > BPF_XOR)
+                return false;
+            break;
+        case BPF_JMP:
+            if (BPF_OP(i->code) > BPF_JSET)
+                return false;
+            if (BPF_OP(i->code) == BPF_JA ? i->k >= n - j - 1
+                                          : MAX(i->jt, i->jf) >= n - j - 1)
+                return false;
+            break;
+        case BPF_RET:
+            if (BPF_RVAL(i->code) == 0x18)
+                return false;
+            break;
+        case BPF_MISC:
+            if (BPF_MISCOP(i->code) != BPF_TAX &&
+                BPF_MISCOP(i->code) != BPF_TXA)
+                return false;
+            break;
+        }
+    }
+    return true;
+}
+
+
+/// Append the Ethernet frame in @p buf to the capture file of tap @p c, unless
+/// its filter rejects the frame. Use cap_tap() instead, which checks whether a
+/// tap is enabled.
+///
+/// @param      c     Capture tap.
+/// @param[in]  buf   Ethernet frame.
+/// @param[in]  len   Length of @p buf.
+///
+void cap_frame(struct w_capture * const c,
+               const uint8_t * const buf,
+               const uint32_t len)
+{
+    uint32_t snap = MIN(len, c->snaplen);
+    if (c->filter_len) {
+        const uint32_t accept = bpf_run(c->filter, buf, len);
+        if (accept == 0)
+            return;
+        snap = MIN(snap, accept);
+    }
+
+    if (unlikely(c->len + sizeof(struct pcap_rec) + snap > c->size)) {
+        c->lost++;
+        return;
+    }
+
+    const uint64_t now = w_now(CLOCK_REALTIME);
+    const struct pcap_rec r = {.sec = (uint32_t)NS_TO_S(now),
+                               .nsec = (uint32_t)(now % NS_PER_S),
+                               .incl_len = snap,
+                               .orig_len = len};
+    memcpy(&c->map[c->len], &r, sizeof(r));
+    memcpy(&c->map[c->len + sizeof(r)], buf, snap);
+    c->len += sizeof(r) + snap;
+}
+
+
+/// Open a capture tap, which writes frames into a preallocated and
+/// memory-mapped pcap file at @p path. See w_set_capture().
+///
+/// @param[out] cap   The capture tap.
+/// @param[in]  path  Capture file.
+/// @param[in]  opt   Capture options, or zero for the defaults.
+///
+/// @return     Zero on success, @p errno otherwise.
+///
+int cap_open(struct w_capture ** const cap,
+             const char * const path,
+             const struct w_capture_opt * const opt)
+{
+    const struct w_capture_opt o = opt ? *opt : (struct w_capture_opt){0};
+    const uint64_t size = o.size ? o.size : CAP_SIZE;
+    if (size < sizeof(struct pcap_hdr) || size > SIZE_MAX ||
+        (o.filter_len && (o.filter == 0 || !bpf_check(o.filter, o.filter_len))))
+        return EINVAL;
+
+    struct w_capture * const c =
+        calloc(1, sizeof(*c) + o.filter_len * sizeof(c->filter[0]));
+    if (c == 0)
+        return ENOMEM;
+    c->size = size;
+    c->snaplen = o.snaplen ? o.snaplen : UINT32_MAX;
+    c->filter_len = o.filter_len;
+    if (o.filter_len)
+        memcpy(c->filter, o.filter, o.filter_len * sizeof(c->filter[0]));
+
+    int err = 0;
+    c->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (c->fd == -1) {
+        err = errno;
+        goto fail;
+    }
+
+    // allocate the whole file now, so writing into the mapping cannot fail
+#ifdef HAVE_POSIX_FALLOCATE
+    err = posix_fallocate(c->fd, 0, (off_t)size);
+#else
+    err = ftruncate(c->fd, (off_t)size) == -1 ? errno : 0;
+#endif
+    if (err)
+        goto fail;
+
+    c->map =
+        mmap(0, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (c->map == MAP_FAILED) {
+        err = errno;
+        c->map = 0;
+        goto fail;
+    }
+
+    const struct pcap_hdr h = {.magic = PCAP_MAGIC_NS,
+                               .major = 2,
+                               .minor = 4,
+                               .snaplen = MIN(c->snaplen, UINT16_MAX),
+                               .link = PCAP_LINK_ETH};
+    memcpy(c->map, &h, sizeof(h));
+    c->len = sizeof(h);
+    *cap = c;
+    return 0;
+
+fail:
+    if (c->fd != -1) {
+        close(c->fd);
+        unlink(path);
+    }
+    free(c);
+    return err;
+}
+
+
+/// Close capture tap @p c, and truncate its file to the captured frames.
+///
+/// @param      c     Capture tap.
+///
+void cap_close(struct w_capture * const c)
+{
+    if (c->lost)
+        warn(WRN, "capture file full, %" PRIu64 " frame%s not captured",
+             c->lost, plural(c->lost));
+    munmap(c->map, (size_t)c->size);
+    if (ftruncate(c->fd, (off_t)c->len) == -1)
+        warn(ERR, "cannot truncate capture file: %s", strerror(errno));
+    close(c->fd);
+    free(c);
+}
+
+
+/// Stop the capture tap of engine @p w, if any.
+///
+/// @param      w     Backend engine.
+///
+void cap_cleanup(struct w_engine * const w)
+{
+    if (w->cap == 0)
+        return;
+    cap_close(w->cap);
+    w->cap = 0;
+}
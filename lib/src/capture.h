@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <warpcore/warpcore.h>
+
+
+/// Header of a pcap file.
+///
+struct pcap_hdr {
+    uint32_t magic;   ///< PCAP_MAGIC_US or PCAP_MAGIC_NS.
+    uint16_t major;   ///< Major version, 2.
+    uint16_t minor;   ///< Minor version, 4.
+    int32_t zone;     ///< GMT offset, always zero.
+    uint32_t sigfigs; ///< Timestamp accuracy, always zero.
+    uint32_t snaplen; ///< Maximum bytes captured per frame.
+    uint32_t link;    ///< Link type.
+};
+
+#define PCAP_MAGIC_US 0xa1b2c3d4 ///< Magic of a pcap file with us timestamps.
+#define PCAP_MAGIC_NS 0xa1b23c4d ///< Magic of a pcap file with ns timestamps.
+#define PCAP_LINK_ETH 1          ///< Link type for Ethernet.
+
+
+/// Header of a frame in a pcap file.
+///
+struct pcap_rec {
+    uint32_t sec;      ///< Timestamp, seconds.
+    uint32_t nsec;     ///< Timestamp, micro- or nanoseconds.
+    uint32_t incl_len; ///< Number of captured bytes that follow.
+    uint32_t orig_len; ///< Length of the frame.
+};
+
+
+/// Engine-owned capture tap, which appends frames to a pcap file through a
+/// shared mapping of it.
+///
+struct w_capture {
+    uint8_t * map;              ///< Mapping of the capture file.
+    uint64_t size;              ///< Size of @p map.
+    uint64_t len;               ///< Bytes of @p map written so far.
+    uint64_t lost;              ///< Frames not captured, file was full.
+    int fd;                     ///< Capture file descriptor.
+    uint32_t snaplen;           ///< Maximum bytes to capture per frame.
+    uint16_t filter_len;        ///< Number of instructions in @p filter.
+    struct w_bpf_insn filter[]; ///< Frame filter, if @p filter_len.
+};
+
+
+/// Append the Ethernet frame in @p buf to the capture file of engine @p w, if
+/// a capture tap is enabled.
+///
+/// @param      w     Backend engine.
+/// @param      buf   Ethernet frame.
+/// @param      len   Length of @p buf.
+///
+#define cap_tap(w, buf, len)                                                   \
+    do {                                                                       \
+        if (unlikely((w)->cap))                                                \
+            cap_frame((w)->cap, (buf), (len));                                 \
+    } while (0)
+
+
+extern void __attribute__((nonnull))
+cap_frame(struct w_capture * const c,
+          const uint8_t * const buf,
+          const uint32_t len);
+
+extern int __attribute__((nonnull(1, 2)))
+cap_open(struct w_capture ** const cap,
+         const char * const path,
+         const struct w_capture_opt * const opt);
+
+extern void __attribute__((nonnull)) cap_close(struct w_capture * const c);
+
+extern void __attribute__((nonnull)) cap_cleanup(struct w_engine * const w);
@@ -27,9 +27,6 @@
 
 #include <string.h>
 
-#include <net/netmap_user.h>
-
-#include <net/netmap.h>
 #include <warpcore/warpcore.h>
 
 #include "arp.h"
@@ -44,17 +41,19 @@
 /// or arp_rx(), based on its EtherType.
 ///
 /// @param      w     Backend engine.
-/// @param      s     Currently active netmap RX slot.
+/// @param      s     Currently active RX slot.
 /// @param      buf   Incoming packet.
 ///
 /// @return     Whether a packet was placed into a socket.
 ///
 bool eth_rx(struct w_engine * const w,
-            struct netmap_slot * const s,
+            struct w_slot * const s,
             uint8_t * const buf)
 {
     // an Ethernet frame is at least 64 bytes, enough for the Ethernet header
     const struct eth_hdr * const eth = (void *)buf;
+    trace_ev(w, W_TRACE_RX, rx, s->buf_idx, s->len, 0);
+    cap_tap(w, buf, s->len);
 
     warn(DBG, "Eth %s -> %s, type 0x%04x, len %d",
          eth_ntoa(&eth->src, eth_tmp, ETH_STRLEN),
@@ -68,6 +67,7 @@ bool eth_rx(struct w_engine * const w,
         warn(INF, "Ethernet packet to %s not destined to us (%s); ignoring",
              eth_ntoa(&eth->dst, eth_tmp, ETH_STRLEN),
              eth_ntoa(&w->mac, eth_tmp, ETH_STRLEN));
+        count_drop(w, 0, W_DROP_NOT_US);
         return false;
     }
 #endif
@@ -84,84 +84,11 @@ bool eth_rx(struct w_engine * const w,
     }
 
     warn(INF, "unhandled ethertype 0x%04x", bswap16(eth->type));
+    count_drop(w, 0, W_DROP_UNSUPPORTED);
     return false;
 }
 
 
-/// Places an Ethernet frame into a TX ring. The Ethernet frame is contained in
-/// the w_iov @p v, and will be placed into an available slot in a TX ring or -
-/// if all are full - dropped.
-///
-/// @param      v     The w_iov containing the Ethernet frame to transmit.
-///
-/// @return     True if the buffer was placed into a TX ring, false otherwise.
-///
-bool eth_tx(struct w_iov * const v)
-{
-    struct w_backend * const b = v->w->b;
-
-    // find a tx ring with space
-    struct netmap_ring * txr = 0;
-    uint32_t r = 0;
-    for (; likely(r < b->nif->ni_tx_rings); r++) {
-        txr = NETMAP_TXRING(b->nif, b->cur_txr);
-        if (likely(!nm_ring_empty(txr)))
-            // we have space in this ring
-            break;
-
-        warn(INF, "tx ring %u full; moving to next", b->cur_txr);
-        b->cur_txr = (b->cur_txr + 1) % b->nif->ni_tx_rings;
-    }
-
-    // return false if all rings are full
-    if (unlikely(r == b->nif->ni_tx_rings)) {
-        warn(NTE, "all tx rings are full");
-        return false;
-    }
-
-    struct netmap_slot * const s = &txr->slot[txr->cur];
-    b->slot_buf[txr->ringid][txr->cur] = v;
-    s->len = v->len + sizeof(struct eth_hdr);
-
-    warn(DBG, "Eth %s -> %s, type 0x%04x, len %u",
-         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->src, eth_tmp,
-                  ETH_STRLEN),
-         eth_ntoa(&((struct eth_hdr *)(void *)v->base)->dst, eth_tmp,
-                  ETH_STRLEN),
-         bswap16(((struct eth_hdr *)(void *)v->base)->type), s->len);
-
-
-    if (unlikely(is_pipe(v->w))) {
-#if 0
-        warn(DBG, "copying iov idx %u into tx ring %u slot %d (into %u)",
-             v->idx, b->cur_txr, txr->cur, s->buf_idx);
-#endif
-        memcpy(NETMAP_BUF(txr, s->buf_idx), v->base, s->len);
-
-    } else {
-#if 0
-        warn(DBG, "placing iov idx %u into tx ring %u slot %d (swap with %u)",
-             v->idx, b->cur_txr, txr->cur, s->buf_idx);
-#endif
-
-        // temporarily place v into the current tx ring
-        const uint32_t slot_idx = s->buf_idx;
-        s->buf_idx = v->idx;
-        v->idx = slot_idx;
-        s->flags = NS_BUF_CHANGED;
-        if (unlikely(nm_ring_space(txr) == 1 || sq_next(v, next) == 0)) {
-            // we are using the last slot in this ring, or this is the last
-            // w_iov in this batch - mark the slot for reporting
-            s->flags |= NS_REPORT;
-        }
-    }
-
-    // advance tx ring
-    txr->head = txr->cur = nm_ring_next(txr, txr->cur);
-    return true;
-}
-
-
 /// Wait until @p v has been transmitted, and return free it.
 ///
 /// @param      v     The w_iov containing the Ethernet frame to transmit.
@@ -170,10 +97,11 @@ void eth_tx_and_free(struct w_iov * const v)
 {
     // send the packet, and make sure it went out before returning
     const uint32_t orig_idx = v->idx;
-    eth_tx(v);
+    if (unlikely(eth_tx(v) == false))
+        count_drop(v->w, 0, W_DROP_TX_FULL);
     do {
         w_nanosleep(100 * NS_PER_US);
-        w_nic_tx(v->w);
+        backend_nic_tx(v->w);
     } while (v->idx != orig_idx);
     sq_insert_head(&v->w->iov, v, next);
 }
@@ -33,8 +33,8 @@
 
 #include <warpcore/warpcore.h>
 
-#ifdef WITH_NETMAP
-struct netmap_slot;
+#ifdef WITH_ETH
+struct w_slot;
 #endif
 
 
@@ -70,14 +70,12 @@ eth_data(uint8_t * const buf)
 }
 
 
-#ifdef WITH_NETMAP
-#include <net/netmap_user.h>
-
+#ifdef WITH_ETH
 #include "neighbor.h"
 
 
 extern bool __attribute__((nonnull)) eth_rx(struct w_engine * const w,
-                                            struct netmap_slot * const s,
+                                            struct w_slot * const s,
                                             uint8_t * const buf);
 
 extern bool __attribute__((nonnull)) eth_tx(struct w_iov * const v);
@@ -0,0 +1,473 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <warpcore/warpcore.h>
+
+#include "flow.h"
+
+
+#define FLOW_EMPTY 0x80 ///< Tag of a slot that was never used.
+#define FLOW_DEL 0xfe   ///< Tag of a slot whose w_sock was removed.
+#define FLOW_MIN 4      ///< Number of groups of a new flow table.
+#define FLOW_MIG 4      ///< Number of groups to migrate per insertion.
+
+#ifdef __SSE4_2__
+#define FLOW_HASH_BITS 32 ///< Hash bits, the high seven of which are the tag.
+#else
+#define FLOW_HASH_BITS 64 ///< Hash bits, the high seven of which are the tag.
+#endif
+
+
+#ifndef __SSE4_2__
+/// Multiply @p a and @p b, and fold the 128-bit product into 64 bits, like
+/// wyhash does.
+///
+/// @param[in]  a     First factor.
+/// @param[in]  b     Second factor.
+///
+/// @return     The high and low halves of the product, XORed.
+///
+static inline uint64_t mum(const uint64_t a, const uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    __extension__ const unsigned __int128 r = (unsigned __int128)a * b;
+    return (uint64_t)(r >> 64) ^ (uint64_t)r;
+#else
+    const uint64_t ll = (a & UINT32_MAX) * (b & UINT32_MAX);
+    const uint64_t lh = (a & UINT32_MAX) * (b >> 32);
+    const uint64_t hl = (a >> 32) * (b & UINT32_MAX);
+    const uint64_t hh = (a >> 32) * (b >> 32);
+    const uint64_t mid = (ll >> 32) + (lh & UINT32_MAX) + (hl & UINT32_MAX);
+    return (hh + (lh >> 32) + (hl >> 32) + (mid >> 32)) ^ (a * b);
+#endif
+}
+#endif
+
+
+static inline uint64_t __attribute__((nonnull))
+#if defined(__clang__)
+    __attribute__((no_sanitize("unsigned-integer-overflow")))
+#endif
+    addr_bits(const struct w_addr * const a)
+{
+    if (a->af == AF_INET)
+        return a->ip4;
+    uint64_t x[2];
+    memcpy(x, a->ip6, sizeof(x));
+    return x[0] ^ (x[1] << 32 | x[1] >> 32);
+}
+
+
+/// Hash a local and an optional remote address and port. Uses CRC32C where
+/// the CPU has an instruction for it, and a wyhash-style multiply otherwise.
+///
+/// @param[in]  l     Local address and port.
+/// @param[in]  r     Remote address and port, or zero.
+///
+/// @return     The hash.
+///
+static inline uint64_t __attribute__((nonnull(1)))
+#if defined(__clang__)
+    __attribute__((no_sanitize("unsigned-integer-overflow")))
+#endif
+    flow_hash(const struct w_sockaddr * const l,
+              const struct w_sockaddr * const r)
+{
+    const uint64_t a = addr_bits(&l->addr);
+    const uint64_t p =
+        l->port | (r ? (uint64_t)r->port << 16 | UINT64_C(1) << 32 : 0);
+    const uint64_t b = r ? addr_bits(&r->addr) : 0;
+#ifdef __SSE4_2__
+    return _mm_crc32_u64(_mm_crc32_u64(_mm_crc32_u64(0, a), p), b);
+#else
+    return mum(mum(a ^ UINT64_C(0xa0761d6478bd642f),
+                   p ^ UINT64_C(0xe7037ed1a0b428db)) ^
+                   b,
+               UINT64_C(0x8ebc6af09c88c6e3));
+#endif
+}
+
+
+static inline uint8_t tag_of(const uint64_t h)
+{
+    return (uint8_t)(h >> (FLOW_HASH_BITS - 7)) & 0x7f;
+}
+
+
+/// Return a bit mask of the slots in the group starting at @p g whose tag is
+/// @p t.
+///
+/// @param[in]  g     Tags of a group.
+/// @param[in]  t     Tag to look for.
+///
+/// @return     Bit i is set if slot i of the group has tag @p t.
+///
+static inline uint32_t __attribute__((nonnull))
+grp_match(const uint8_t * const g, const uint8_t t)
+{
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128((const __m128i *)(const void *)g),
+        _mm_set1_epi8((char)t)));
+#else
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < FLOW_GRP; i++)
+        m |= (uint32_t)(g[i] == t) << i;
+    return m;
+#endif
+}
+
+
+/// Return a bit mask of the slots in the group starting at @p g that do not
+/// hold a w_sock, i.e., whose tag has the high bit set.
+///
+/// @param[in]  g     Tags of a group.
+///
+/// @return     Bit i is set if slot i of the group is free.
+///
+static inline uint32_t __attribute__((nonnull))
+grp_free(const uint8_t * const g)
+{
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_loadu_si128((const __m128i *)(const void *)g));
+#else
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < FLOW_GRP; i++)
+        m |= (uint32_t)(g[i] >> 7) << i;
+    return m;
+#endif
+}
+
+
+static inline bool __attribute__((nonnull))
+sa_eq(const struct w_sockaddr * const a, const struct w_sockaddr * const b)
+{
+    return a->port == b->port && a->addr.af == b->addr.af &&
+           (a->addr.af == AF_INET
+                ? a->addr.ip4 == b->addr.ip4
+                : memcmp(a->addr.ip6, b->addr.ip6, IP6_LEN) == 0);
+}
+
+
+static inline const struct w_sockaddr * __attribute__((nonnull))
+remote_of(const struct w_sock * const s)
+{
+    return s->tup.remote.addr.af ? &s->tup.remote : 0;
+}
+
+
+static inline uint64_t __attribute__((nonnull))
+sock_hash(const struct w_sock * const s)
+{
+    return flow_hash(&s->tup.local, remote_of(s));
+}
+
+
+/// Find the slot of the w_sock bound to @p l and @p r in array @p a.
+///
+/// @param[in]  a     Flow table array.
+/// @param[in]  h     Hash of @p l and @p r.
+/// @param[in]  l     Local address and port.
+/// @param[in]  r     Remote address and port, or zero.
+///
+/// @return     Index of the slot, or UINT32_MAX if there is none.
+///
+static uint32_t __attribute__((nonnull(1, 3)))
+arr_find(const struct flow_arr * const a,
+         const uint64_t h,
+         const struct w_sockaddr * const l,
+         const struct w_sockaddr * const r)
+{
+    if (a->tag == 0)
+        return UINT32_MAX;
+    const uint8_t t = tag_of(h);
+    // triangular probing over the groups, which visits each group once
+    for (uint32_t g = (uint32_t)h & a->gmask, n = 1;;
+         g = (g + n++) & a->gmask) {
+        const uint8_t * const tags = &a->tag[g * FLOW_GRP];
+        for (uint32_t m = grp_match(tags, t); m; m &= m - 1) {
+            const uint32_t i = g * FLOW_GRP + (uint32_t)__builtin_ctz(m);
+            const struct w_sock * const s = a->sock[i];
+            if (likely(sa_eq(&s->tup.local, l) &&
+                       (r ? sa_eq(&s->tup.remote, r)
+                          : s->tup.remote.addr.af == 0)))
+                return i;
+        }
+        // a probe never continues past a group with an empty slot
+        if (likely(grp_match(tags, FLOW_EMPTY)))
+            return UINT32_MAX;
+    }
+}
+
+
+static void __attribute__((nonnull))
+arr_ins(struct flow_arr * const a, const uint64_t h, struct w_sock * const s)
+{
+    for (uint32_t g = (uint32_t)h & a->gmask, n = 1;;
+         g = (g + n++) & a->gmask) {
+        const uint32_t m = grp_free(&a->tag[g * FLOW_GRP]);
+        if (m) {
+            const uint32_t i = g * FLOW_GRP + (uint32_t)__builtin_ctz(m);
+            a->used += a->tag[i] == FLOW_EMPTY;
+            a->tag[i] = tag_of(h);
+            a->sock[i] = s;
+            return;
+        }
+    }
+}
+
+
+static void __attribute__((nonnull))
+arr_del(struct flow_arr * const a, const uint32_t i)
+{
+    // a slot can become empty again if its group has another empty one, since
+    // no probe can have continued past that group
+    if (grp_match(&a->tag[i & ~(FLOW_GRP - 1)], FLOW_EMPTY)) {
+        a->tag[i] = FLOW_EMPTY;
+        a->used--;
+    } else
+        a->tag[i] = FLOW_DEL;
+}
+
+
+static void __attribute__((nonnull))
+arr_alloc(struct flow_arr * const a, const uint32_t ngrps)
+{
+    const size_t n = (size_t)ngrps * FLOW_GRP;
+    ensure((a->tag = malloc(n)) != 0 &&
+               (a->sock = malloc(n * sizeof(*a->sock))) != 0,
+           "cannot alloc flow table");
+    memset(a->tag, FLOW_EMPTY, n);
+    a->gmask = ngrps - 1;
+    a->used = 0;
+}
+
+
+/// Move up to @p n groups of w_socks from the old array of @p ft into the
+/// current one, and free the old array once it is empty.
+///
+/// @param      ft    Flow table.
+/// @param[in]  n     Number of groups to migrate.
+///
+static void __attribute__((nonnull))
+flow_migrate(struct flow_tab * const ft, uint32_t n)
+{
+    struct flow_arr * const o = &ft->old;
+    for (; n && ft->mig <= o->gmask; n--, ft->mig++)
+        for (uint32_t i = ft->mig * FLOW_GRP; i < (ft->mig + 1) * FLOW_GRP;
+             i++)
+            if ((o->tag[i] & 0x80) == 0) {
+                arr_ins(&ft->cur, sock_hash(o->sock[i]), o->sock[i]);
+                o->tag[i] = FLOW_DEL;
+            }
+
+    if (ft->mig > o->gmask) {
+        free(o->tag);
+        free(o->sock);
+        *o = (struct flow_arr){0};
+    }
+}
+
+
+/// Insert w_sock @p s into flow table @p ft, keyed by its w_socktuple.
+///
+/// @param      ft    Flow table.
+/// @param      s     w_sock.
+///
+/// @return     True if @p s was inserted, false if a w_sock with the same
+///             w_socktuple already is in @p ft.
+///
+bool flow_put(struct flow_tab * const ft, struct w_sock * const s)
+{
+    if (flow_get(ft, &s->tup.local, remote_of(s)))
+        return false;
+
+    if (ft->old.tag)
+        flow_migrate(ft, FLOW_MIG);
+
+    struct flow_arr * const a = &ft->cur;
+    if (unlikely(a->tag == 0))
+        arr_alloc(a, FLOW_MIN);
+    else if (unlikely((a->used + 1) * 8 > (a->gmask + 1) * FLOW_GRP * 7)) {
+        // double the size, or only drop the removed slots if most are unused
+        if (ft->old.tag)
+            flow_migrate(ft, UINT32_MAX);
+        const uint32_t ngrps =
+            (a->gmask + 1) << (ft->cnt * 2 >= (a->gmask + 1) * FLOW_GRP);
+        ft->old = *a;
+        ft->mig = 0;
+        arr_alloc(a, ngrps);
+        flow_migrate(ft, FLOW_MIG);
+    }
+
+    arr_ins(a, sock_hash(s), s);
+    ft->cnt++;
+    ft->conn += remote_of(s) != 0;
+    return true;
+}
+
+
+/// Remove w_sock @p s from flow table @p ft.
+///
+/// @param      ft    Flow table.
+/// @param[in]  s     w_sock.
+///
+/// @return     True if @p s was removed, false if it was not in @p ft.
+///
+bool flow_del(struct flow_tab * const ft, const struct w_sock * const s)
+{
+    const struct w_sockaddr * const r = remote_of(s);
+    const uint64_t h = sock_hash(s);
+    uint32_t i = arr_find(&ft->cur, h, &s->tup.local, r);
+    if (i != UINT32_MAX)
+        arr_del(&ft->cur, i);
+    else if ((i = arr_find(&ft->old, h, &s->tup.local, r)) != UINT32_MAX)
+        arr_del(&ft->old, i);
+    else
+        return false;
+    ft->cnt--;
+    ft->conn -= r != 0;
+    return true;
+}
+
+
+static struct w_sock * __attribute__((nonnull(1, 3)))
+tab_find(const struct flow_tab * const ft,
+         const uint64_t h,
+         const struct w_sockaddr * const l,
+         const struct w_sockaddr * const r)
+{
+    uint32_t i = arr_find(&ft->cur, h, l, r);
+    if (likely(i != UINT32_MAX))
+        return ft->cur.sock[i];
+    if (likely(ft->old.tag == 0))
+        return 0;
+    i = arr_find(&ft->old, h, l, r);
+    return i != UINT32_MAX ? ft->old.sock[i] : 0;
+}
+
+
+/// Get the w_sock in flow table @p ft that is bound to exactly @p local and
+/// @p remote.
+///
+/// @param[in]  ft      Flow table.
+/// @param[in]  local   The local IP address and port.
+/// @param[in]  remote  The remote IP address and port, or zero for a w_sock
+///                     that is not connected.
+///
+/// @return     The w_sock, or zero if there is none.
+///
+struct w_sock * flow_get(const struct flow_tab * const ft,
+                         const struct w_sockaddr * const local,
+                         const struct w_sockaddr * remote)
+{
+    if (ft->cnt == 0)
+        return 0;
+    if (remote && remote->addr.af == 0)
+        remote = 0;
+    return tab_find(ft, flow_hash(local, remote), local, remote);
+}
+
+
+/// Demultiplex an inbound packet: get the w_sock in flow table @p ft that is
+/// connected to @p remote on @p local, or else the one only bound to @p local.
+/// Probes for the latter start while the former is looked up, and either
+/// lookup is skipped if the table has no such w_sock.
+///
+/// @param[in]  ft      Flow table.
+/// @param[in]  local   The local IP address and port.
+/// @param[in]  remote  The remote IP address and port.
+///
+/// @return     The w_sock, or zero if there is none.
+///
+struct w_sock * flow_demux(const struct flow_tab * const ft,
+                           const struct w_sockaddr * const local,
+                           const struct w_sockaddr * const remote)
+{
+    if (unlikely(ft->cnt == 0))
+        return 0;
+
+    const uint64_t hw = flow_hash(local, 0);
+    if (ft->conn) {
+        if (ft->cnt != ft->conn)
+            __builtin_prefetch(
+                &ft->cur.tag[((uint32_t)hw & ft->cur.gmask) * FLOW_GRP]);
+        struct w_sock * const s =
+            tab_find(ft, flow_hash(local, remote), local, remote);
+        if (s || ft->cnt == ft->conn)
+            return s;
+    }
+    return tab_find(ft, hw, local, 0);
+}
+
+
+/// Return the next w_sock of flow table @p ft, for flow_foreach().
+///
+/// @param[in]  ft    Flow table.
+/// @param      i     Iterator, zero to start.
+///
+/// @return     The next w_sock, or zero at the end.
+///
+struct w_sock * flow_next(const struct flow_tab * const ft, uint32_t * const i)
+{
+    const uint32_t no = ft->old.tag ? (ft->old.gmask + 1) * FLOW_GRP : 0;
+    const uint32_t nc = ft->cur.tag ? (ft->cur.gmask + 1) * FLOW_GRP : 0;
+    while (*i < no + nc) {
+        const struct flow_arr * const a = *i < no ? &ft->old : &ft->cur;
+        const uint32_t j = *i < no ? *i : *i - no;
+        (*i)++;
+        if ((a->tag[j] & 0x80) == 0)
+            return a->sock[j];
+    }
+    return 0;
+}
+
+
+/// Free the memory of flow table @p ft, which must be empty.
+///
+/// @param      ft    Flow table.
+///
+void flow_free(struct flow_tab * const ft)
+{
+    free(ft->cur.tag);
+    free(ft->cur.sock);
+    free(ft->old.tag);
+    free(ft->old.sock);
+    *ft = (struct flow_tab){0};
+}
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <warpcore/warpcore.h>
+
+
+#define FLOW_GRP 16 ///< Slots per probe group.
+
+
+/// One open-addressing array of a flow table. Each slot has a tag byte, which
+/// holds seven bits of the hash of the w_socktuple of its w_sock, or
+/// FLOW_EMPTY or FLOW_DEL. Tags are kept apart from the w_sock pointers, so
+/// that a probe only touches one cache line until the tag matches.
+///
+struct flow_arr {
+    uint8_t * tag;         ///< Tag of each slot.
+    struct w_sock ** sock; ///< w_sock of each slot.
+    uint32_t gmask;        ///< Number of groups minus one.
+    uint32_t used;         ///< Number of slots that are not FLOW_EMPTY.
+};
+
+
+/// The flow table of an engine, an open-addressing hash table of its bound
+/// w_socks keyed by their w_socktuple. When the table grows, its entries
+/// migrate from @p old to @p cur a few groups at a time, with each insertion.
+///
+struct flow_tab {
+    struct flow_arr cur; ///< Array that insertions go to.
+    struct flow_arr old; ///< Array being migrated into @p cur, if any.
+    uint32_t mig;        ///< Next group of @p old to migrate.
+    uint32_t cnt;        ///< Number of w_socks in the table.
+    uint32_t conn;       ///< Number of connected w_socks in the table.
+};
+
+
+/// Loop over the w_socks in flow table @p ft. The body may remove the current
+/// w_sock from @p ft, but not insert any.
+///
+/// @param      s     Loop variable, a struct w_sock pointer.
+/// @param      ft    Flow table.
+///
+#define flow_foreach(s, ft)                                                    \
+    for (uint32_t _flow_i = 0; ((s) = flow_next((ft), &_flow_i)) != 0;)
+
+
+extern bool __attribute__((nonnull))
+flow_put(struct flow_tab * const ft, struct w_sock * const s);
+
+extern bool __attribute__((nonnull))
+flow_del(struct flow_tab * const ft, const struct w_sock * const s);
+
+extern struct w_sock * __attribute__((nonnull(1, 2)))
+flow_get(const struct flow_tab * const ft,
+         const struct w_sockaddr * const local,
+         const struct w_sockaddr * const remote);
+
+extern struct w_sock * __attribute__((nonnull))
+flow_demux(const struct flow_tab * const ft,
+           const struct w_sockaddr * const local,
+           const struct w_sockaddr * const remote);
+
+extern struct w_sock * __attribute__((nonnull))
+flow_next(const struct flow_tab * const ft, uint32_t * const i);
+
+extern void __attribute__((nonnull)) flow_free(struct flow_tab * const ft);
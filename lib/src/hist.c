@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <warpcore/warpcore.h>
+
+#include "hist.h"
+
+
+/// Return the largest value that falls into bucket @p i of a w_hist.
+///
+/// @param[in]  i     Bucket index.
+///
+/// @return     Largest value of the bucket.
+///
+static uint64_t hist_max(const uint32_t i)
+{
+    if (i < (1U << W_HIST_SUB_BITS))
+        return i;
+    // the inverse of hist_idx(); the top bucket wraps to UINT64_MAX
+    const uint32_t sh = (i >> W_HIST_SUB_BITS) - 1;
+    const uint64_t m = (1U << W_HIST_SUB_BITS) - 1;
+    return ((((m + 1) | (i & m)) + 1) << sh) - 1;
+}
+
+
+/// Enable or disable recording latency histograms for engine @p w. See enum
+/// w_hist_type for what is recorded. Enabling resets the histograms.
+///
+/// The RX latency starts at w_iov::ts, so with the socket backend it only
+/// covers time spent in the kernel if w_sockopt::enable_timestamps is set.
+///
+/// @param      w       Backend engine.
+/// @param[in]  enable  Whether to record histograms.
+///
+void w_set_latency_hist(struct w_engine * const w, const bool enable)
+{
+    hist_cleanup(w);
+    if (enable)
+        ensure((w->hist = calloc(W_HIST_CNT, sizeof(*w->hist))) != 0,
+               "cannot alloc latency histograms");
+}
+
+
+/// Take a snapshot of a latency histogram of engine @p w. This may be called
+/// from another thread while the engine is running, but not concurrently with
+/// w_set_latency_hist(). The snapshot is all zero if histograms are disabled.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  t     Histogram to return.
+/// @param[out] h     Snapshot of the histogram.
+///
+void w_get_latency_hist(const struct w_engine * const w,
+                        const enum w_hist_type t,
+                        struct w_hist * const h)
+{
+    if (w->hist == 0) {
+        memset(h, 0, sizeof(*h));
+        return;
+    }
+    for (uint32_t i = 0; i < W_HIST_BUCKETS; i++)
+        h->cnt[i] = __atomic_load_n(&w->hist[t].cnt[i], __ATOMIC_RELAXED);
+}
+
+
+/// Return a quantile of the values recorded in histogram @p h, as the
+/// largest value of the bucket it falls into.
+///
+/// @param[in]  h     Histogram.
+/// @param[in]  ppm   Quantile in parts per million, e.g., 990000 for the 99th
+///                   percentile.
+///
+/// @return     Quantile value, or zero if @p h is empty.
+///
+uint64_t w_hist_quantile(const struct w_hist * const h, const uint32_t ppm)
+{
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < W_HIST_BUCKETS; i++)
+        n += h->cnt[i];
+    if (n == 0)
+        return 0;
+
+    // rank of the sample at the quantile, rounding up
+    const uint64_t q = MIN(ppm, 1000000);
+    uint64_t rank = n / 1000000 * q + ((n % 1000000) * q + 999999) / 1000000;
+    rank = MAX(rank, 1);
+    for (uint32_t i = 0; i < W_HIST_BUCKETS; i++) {
+        if (h->cnt[i] >= rank)
+            return hist_max(i);
+        rank -= h->cnt[i];
+    }
+    return UINT64_MAX;
+}
+
+
+/// Free the latency histograms of engine @p w.
+///
+/// @param      w     Backend engine.
+///
+void hist_cleanup(struct w_engine * const w)
+{
+    free(w->hist);
+    w->hist = 0;
+}
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <stdint.h>
+
+#include <warpcore/warpcore.h>
+
+
+/// Return the bucket of a w_hist that value @p v falls into.
+///
+/// @param[in]  v     Value.
+///
+/// @return     Bucket index.
+///
+static inline uint32_t hist_idx(const uint64_t v)
+{
+    if (v < (1U << W_HIST_SUB_BITS))
+        return (uint32_t)v;
+    const uint32_t e = 63 - (uint32_t)__builtin_clzll(v);
+    return ((e - W_HIST_SUB_BITS + 1) << W_HIST_SUB_BITS) |
+           (uint32_t)((v >> (e - W_HIST_SUB_BITS)) &
+                      ((1U << W_HIST_SUB_BITS) - 1));
+}
+
+
+/// Record the time from @p t to @p now in the latency histogram @p type of
+/// engine @p w, which must be enabled.
+///
+/// Only the engine's thread records, so a plain increment suffices; the store
+/// is atomic, so that w_get_latency_hist() can read concurrently.
+///
+/// @param      w     Backend engine.
+/// @param[in]  type  Histogram to record in.
+/// @param[in]  t     Start time, in ns.
+/// @param[in]  now   End time, in ns, from the same clock as @p t.
+///
+static inline void __attribute__((nonnull))
+hist_add(struct w_engine * const w,
+         const enum w_hist_type type,
+         const uint64_t t,
+         const uint64_t now)
+{
+    uint64_t * const c = &w->hist[type].cnt[hist_idx(now > t ? now - t : 0)];
+    __atomic_store_n(c, *c + 1, __ATOMIC_RELAXED);
+}
+
+
+extern void __attribute__((nonnull)) hist_cleanup(struct w_engine * const w);
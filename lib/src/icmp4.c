@@ -32,8 +32,6 @@
 #include <sys/param.h>
 #include <sys/socket.h>
 
-#include <net/netmap.h>
-
 #include "backend.h"
 #include "eth.h"
 #include "icmp4.h"
@@ -66,6 +64,7 @@ void
     if (unlikely(v == 0)) {
         warn(CRT, "no more bufs; ICMPv4 not sent (type %d, code %d)", type,
              code);
+        count_drop(w, 0, W_DROP_NO_BUFS);
         return;
     }
 
@@ -134,15 +133,14 @@ void
 ///
 /// Currently only responds to ICMPv4 echo packets.
 ///
-/// The Ethernet frame to operate on is in the current netmap lot of the
-/// indicated RX ring.
+/// The Ethernet frame to operate on is in the current RX slot @p s.
 ///
 /// @param      w     Backend engine.
-/// @param      s     Currently active netmap RX slot.
+/// @param      s     Currently active RX slot.
 /// @param      buf   Incoming packet.
 ///
 void icmp4_rx(struct w_engine * const w,
-              struct netmap_slot * const s,
+              struct w_slot * const s,
               uint8_t * const buf)
 {
     const struct icmp4_hdr * const icmp = (void *)ip4_data(buf);
@@ -156,6 +154,7 @@ void icmp4_rx(struct w_engine * const w,
     if (ip_cksum(icmp, icmp4_len) != 0) {
         warn(WRN, "invalid ICMPv4 checksum, received 0x%04x",
              bswap16(icmp->cksum));
+        count_drop(w, 0, W_DROP_BAD_CKSUM);
         return;
     }
 
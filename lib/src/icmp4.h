@@ -29,7 +29,7 @@
 
 #include <stdint.h>
 
-struct netmap_slot;
+struct w_slot;
 struct w_engine;
 
 #define ICMP4_TYPE_ECHOREPLY 0 ///< ICMP echo reply type.
@@ -58,5 +58,5 @@ extern void __attribute__((nonnull)) icmp4_tx(struct w_engine * w,
                                               uint8_t * const buf);
 
 extern void __attribute__((nonnull)) icmp4_rx(struct w_engine * w,
-                                              struct netmap_slot * const s,
+                                              struct w_slot * const s,
                                               uint8_t * const buf);
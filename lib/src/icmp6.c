@@ -37,8 +37,6 @@
 #include <sys/param.h>
 #include <sys/socket.h>
 
-#include <net/netmap.h>
-
 #include "backend.h"
 #include "eth.h"
 #include "icmp6.h"
@@ -88,6 +86,7 @@ void
     struct w_iov * const v = w_alloc_iov_base(w);
     if (unlikely(v == 0)) {
         warn(CRT, "no more bufs; neighbor request not sent");
+        count_drop(w, 0, W_DROP_NO_BUFS);
         return;
     }
 
@@ -150,6 +149,7 @@ void
     if (unlikely(v == 0)) {
         warn(CRT, "no more bufs; ICMPv6 not sent (type %d, code %d)", type,
              code);
+        count_drop(w, 0, W_DROP_NO_BUFS);
         return;
     }
 
@@ -236,11 +236,10 @@ void
 ///
 /// Currently only responds to ICMPv6 echo packets.
 ///
-/// The Ethernet frame to operate on is in the current netmap lot of the
-/// indicated RX ring.
+/// The Ethernet frame to operate on is in the current RX slot @p s.
 ///
 /// @param      w     Backend engine.
-/// @param      s     Currently active netmap RX slot.
+/// @param      s     Currently active RX slot.
 /// @param      buf   Incoming packet.
 ///
 void
@@ -248,7 +247,7 @@ void
     __attribute__((no_sanitize("alignment")))
 #endif
     icmp6_rx(struct w_engine * const w,
-             struct netmap_slot * const s,
+             struct w_slot * const s,
              uint8_t * const buf)
 {
     const struct icmp6_hdr * const icmp = (void *)ip6_data(buf);
@@ -263,6 +262,7 @@ void
     if (payload_cksum(ip, icmp_len + sizeof(*ip)) != 0) {
         warn(WRN, "invalid ICMPv6 checksum, received 0x%04x",
              bswap16(icmp->cksum));
+        count_drop(w, 0, W_DROP_BAD_CKSUM);
         return;
     }
 
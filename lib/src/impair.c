@@ -0,0 +1,583 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "backend.h"
+#include "impair.h"
+
+
+#define PPM 1000000 ///< Denominator of the probabilities in w_impair_opt.
+
+
+/// Return true with probability @p ppm parts per million.
+///
+/// @param[in]  ppm   Probability.
+///
+/// @return     True with probability @p ppm.
+///
+static inline bool chance(const uint32_t ppm)
+{
+    return ppm && w_rand_uniform32(PPM) < ppm;
+}
+
+
+static inline bool __attribute__((nonnull))
+imp_before(const struct imp_ent * const a, const struct imp_ent * const b)
+{
+    return a->t < b->t || (a->t == b->t && a->seq < b->seq);
+}
+
+
+static void __attribute__((nonnull))
+imp_up(struct imp_ent * const h, uint32_t i)
+{
+    const struct imp_ent e = h[i];
+    while (i && imp_before(&e, &h[(i - 1) / 2])) {
+        h[i] = h[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h[i] = e;
+}
+
+
+static void __attribute__((nonnull))
+imp_down(struct imp_ent * const h, const uint32_t n, uint32_t i)
+{
+    const struct imp_ent e = h[i];
+    for (uint32_t c = 2 * i + 1; c < n; i = c, c = 2 * i + 1) {
+        if (c + 1 < n && imp_before(&h[c + 1], &h[c]))
+            c++;
+        if (!imp_before(&h[c], &e))
+            break;
+        h[i] = h[c];
+    }
+    h[i] = e;
+}
+
+
+/// Remove and return the first entry of the non-empty queue of @p d.
+///
+/// @param      d     Impairment.
+///
+/// @return     The entry with the earliest release time.
+///
+static struct imp_ent __attribute__((nonnull)) imp_pop(struct imp_dir * const d)
+{
+    const struct imp_ent e = d->q[0];
+    if (--d->cnt) {
+        d->q[0] = d->q[d->cnt];
+        imp_down(d->q, d->cnt, 0);
+    }
+    return e;
+}
+
+
+/// Decide whether impairment @p d loses the next datagram, advancing its
+/// Gilbert-Elliott model, if any.
+///
+/// @param      d     Impairment.
+///
+/// @return     True if the datagram is lost.
+///
+static bool __attribute__((nonnull)) imp_lost(struct imp_dir * const d)
+{
+    if (d->opt.p_bad == 0)
+        return chance(d->opt.loss);
+    if (chance(d->bad ? d->opt.p_good : d->opt.p_bad))
+        d->bad = !d->bad;
+    return chance(d->bad ? d->opt.loss_bad : d->opt.loss);
+}
+
+
+/// Hold datagram @p v of w_sock @p s back in impairment @p d, until the rate
+/// limit and delay of @p d let it pass. Loses @p v if @p d is full.
+///
+/// @param      d     Impairment.
+/// @param      s     w_sock of @p v.
+/// @param      v     Datagram.
+/// @param[in]  now   Current time, in ns of w_now(CLOCK_MONOTONIC).
+///
+static void __attribute__((nonnull))
+imp_add(struct imp_dir * const d,
+        struct w_sock * const s,
+        struct w_iov * const v,
+        const uint64_t now)
+{
+    if (unlikely(d->opt.limit && d->cnt >= d->opt.limit)) {
+        count_drop(s->w, s, W_DROP_IMPAIRED);
+        w_free_iov(v);
+        return;
+    }
+
+    uint64_t t = now;
+    if (d->opt.rate) {
+        // the datagram leaves once it and all earlier ones are serialized
+        t = MAX(now, d->next) + v->len * 8 * NS_PER_S / d->opt.rate;
+        d->next = t;
+    }
+    if ((d->opt.delay || d->opt.jitter) && !chance(d->opt.reorder)) {
+        const uint64_t j =
+            d->opt.jitter ? w_rand_uniform64(2 * d->opt.jitter + 1) : 0;
+        t += d->opt.delay + j > d->opt.jitter ? d->opt.delay + j - d->opt.jitter
+                                              : 0;
+    }
+
+    if (unlikely(d->cnt == d->cap)) {
+        d->cap = d->cap ? 2 * d->cap : 256;
+        ensure((d->q = realloc(d->q, d->cap * sizeof(*d->q))) != 0,
+               "cannot realloc impairment queue");
+    }
+    d->q[d->cnt] = (struct imp_ent){.t = t, .seq = d->seq++, .s = s, .v = v};
+    imp_up(d->q, d->cnt++);
+}
+
+
+/// Copy datagram @p v of w_sock @p s into a new w_iov.
+///
+/// @param      s     w_sock of @p v.
+/// @param[in]  v     Datagram.
+///
+/// @return     The copy, or zero if there are no free w_iovs.
+///
+static struct w_iov * __attribute__((nonnull))
+imp_copy(struct w_sock * const s, const struct w_iov * const v)
+{
+    struct w_iov * const c = w_alloc_iov(s->w, s->ws_af, v->len, 0);
+    if (unlikely(c == 0)) {
+        count_drop(s->w, s, W_DROP_NO_BUFS);
+        return 0;
+    }
+    memcpy(c->buf, v->buf, v->len);
+    c->len = v->len;
+    c->saddr = v->saddr;
+    c->txtime = v->txtime;
+    c->ts = v->ts;
+    c->flags = v->flags;
+    c->ttl = v->ttl;
+    c->user_data = v->user_data;
+    return c;
+}
+
+
+/// Hand the TX datagrams whose time has come to the backend.
+///
+/// @param      w     Backend engine.
+/// @param[in]  now   Current time, in ns of w_now(CLOCK_MONOTONIC).
+///
+static void __attribute__((nonnull))
+imp_release_tx(struct w_engine * const w, const uint64_t now)
+{
+    struct imp_dir * const d = &w->imp->dir[W_IMPAIR_TX];
+    struct w_iov_sq o = w_iov_sq_initializer(o);
+    struct w_sock * s = 0;
+    while (d->cnt && d->q[0].t <= now) {
+        const struct imp_ent e = imp_pop(d);
+        if (e.s != s && s) {
+            // batch consecutive datagrams of the same w_sock
+            backend_tx(s, &o);
+            sq_concat(&w->imp->sent, &o);
+        }
+        s = e.s;
+        sq_insert_tail(&o, e.v, next);
+    }
+    if (s) {
+        backend_tx(s, &o);
+        sq_concat(&w->imp->sent, &o);
+    }
+}
+
+
+/// Move the RX datagrams whose time has come to w_sock::imp_iv of their
+/// sockets.
+///
+/// @param      w     Backend engine.
+/// @param[in]  now   Current time, in ns of w_now(CLOCK_MONOTONIC).
+///
+static void __attribute__((nonnull))
+imp_release_rx(struct w_engine * const w, const uint64_t now)
+{
+    struct w_impair * const imp = w->imp;
+    struct imp_dir * const d = &imp->dir[W_IMPAIR_RX];
+    while (d->cnt && d->q[0].t <= now) {
+        const struct imp_ent e = imp_pop(d);
+        if (e.s->imp_rdy == false) {
+            if (unlikely(imp->rdy_cnt == imp->rdy_cap)) {
+                imp->rdy_cap = imp->rdy_cap ? 2 * imp->rdy_cap : 16;
+                imp->rdy = realloc(imp->rdy, imp->rdy_cap * sizeof(*imp->rdy));
+                ensure(imp->rdy, "cannot realloc impairment ready list");
+            }
+            imp->rdy[imp->rdy_cnt++] = e.s;
+            e.s->imp_rdy = true;
+        }
+        sq_insert_tail(&e.s->imp_iv, e.v, next);
+    }
+}
+
+
+/// Remove the sockets without w_sock::imp_iv data from the ready list.
+///
+/// @param      imp   Impairment state.
+///
+/// @return     Number of sockets with w_sock::imp_iv data.
+///
+static uint32_t __attribute__((nonnull))
+imp_compact(struct w_impair * const imp)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < imp->rdy_cnt; i++) {
+        struct w_sock * const s = imp->rdy[i];
+        if (sq_empty(&s->imp_iv))
+            s->imp_rdy = false;
+        else
+            imp->rdy[n++] = s;
+    }
+    imp->rdy_cnt = n;
+    return n;
+}
+
+
+/// Pass the data the backend has received on w_sock @p s through the RX
+/// impairment.
+///
+/// @param      s     w_sock.
+/// @param[in]  now   Current time, in ns of w_now(CLOCK_MONOTONIC).
+///
+static void __attribute__((nonnull))
+imp_rx_sock(struct w_sock * const s, const uint64_t now)
+{
+    struct imp_dir * const d = &s->w->imp->dir[W_IMPAIR_RX];
+    struct w_iov_sq i = w_iov_sq_initializer(i);
+    backend_rx(s, &i);
+    while (!sq_empty(&i)) {
+        struct w_iov * const v = sq_first(&i);
+        sq_remove_head(&i, next);
+        sq_next(v, next) = 0;
+        if (imp_lost(d)) {
+            count_drop(s->w, s, W_DROP_IMPAIRED);
+            w_free_iov(v);
+            continue;
+        }
+        if (chance(d->opt.dup)) {
+            struct w_iov * const c = imp_copy(s, v);
+            if (c)
+                imp_add(d, s, c, now);
+        }
+        imp_add(d, s, v, now);
+    }
+}
+
+
+/// Pass the data the backend has received on any w_sock through the RX
+/// impairment.
+///
+/// @param      w     Backend engine.
+/// @param[in]  now   Current time, in ns of w_now(CLOCK_MONOTONIC).
+///
+static void __attribute__((nonnull))
+imp_rx_all(struct w_engine * const w, const uint64_t now)
+{
+    struct w_sock_slist sl = w_sock_slist_initializer(sl);
+    backend_rx_ready(w, &sl);
+    struct w_sock * s;
+    sl_foreach (s, &sl, next)
+        imp_rx_sock(s, now);
+}
+
+
+/// Pass the datagrams in @p o through the TX impairment of the engine of
+/// w_sock @p s. Datagrams that are not lost are copied into engine-owned
+/// w_iovs, so the application keeps ownership of @p o.
+///
+/// @param      s     w_sock socket to transmit over.
+/// @param      o     w_iov_sq to send.
+///
+void imp_tx(struct w_sock * const s, struct w_iov_sq * const o)
+{
+    struct w_engine * const w = s->w;
+    struct imp_dir * const d = &w->imp->dir[W_IMPAIR_TX];
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    struct w_iov * v;
+    sq_foreach (v, o, next) {
+        if (imp_lost(d)) {
+            count_drop(w, s, W_DROP_IMPAIRED);
+            continue;
+        }
+        for (uint_t n = chance(d->opt.dup) ? 2 : 1; n; n--) {
+            struct w_iov * const c = imp_copy(s, v);
+            if (unlikely(c == 0))
+                break;
+            imp_add(d, s, c, now);
+        }
+    }
+    imp_release_tx(w, now);
+}
+
+
+/// Return the data that has passed the RX impairment on w_sock @p s, or that
+/// the backend has received if there is none.
+///
+/// @param      s     w_sock.
+/// @param      i     w_iov tail queue to append new data to.
+///
+void imp_rx(struct w_sock * const s, struct w_iov_sq * const i)
+{
+    struct w_engine * const w = s->w;
+    if (w->imp->dir[W_IMPAIR_RX].on) {
+        const uint64_t now = w_now(CLOCK_MONOTONIC);
+        imp_rx_sock(s, now);
+        imp_release_rx(w, now);
+        sq_concat(i, &s->imp_iv);
+        return;
+    }
+    sq_concat(i, &s->imp_iv);
+    backend_rx(s, i);
+}
+
+
+/// Shorten the w_nic_rx() timeout @p nsec to the time until the next held-back
+/// datagram of engine @p w is due, or to zero if data is ready.
+///
+/// @param      w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds, or -1 for infinite wait.
+///
+/// @return     Timeout in nanoseconds, or -1 for infinite wait.
+///
+int64_t imp_wait(struct w_engine * const w, const int64_t nsec)
+{
+    struct w_impair * const imp = w->imp;
+    if (imp_compact(imp))
+        return 0;
+
+    uint64_t next = UINT64_MAX;
+    for (uint32_t i = 0; i < W_IMPAIR_CNT; i++)
+        if (imp->dir[i].cnt)
+            next = MIN(next, imp->dir[i].q[0].t);
+    if (next == UINT64_MAX)
+        return nsec;
+
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    const int64_t d = next > now ? (int64_t)MIN(next - now, INT64_MAX) : 0;
+    return nsec < 0 ? d : MIN(nsec, d);
+}
+
+
+/// Release the held-back datagrams of engine @p w that are due, after
+/// backend_nic_rx() returned @p rx, and pass any newly received data through
+/// the RX impairment.
+///
+/// @param      w     Backend engine.
+/// @param[in]  rx    Return value of backend_nic_rx().
+///
+/// @return     Whether any data is ready for reading.
+///
+bool imp_nic_rx(struct w_engine * const w, const bool rx)
+{
+    struct w_impair * const imp = w->imp;
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    const struct imp_dir * const tx = &imp->dir[W_IMPAIR_TX];
+    if (tx->cnt && tx->q[0].t <= now)
+        imp_nic_tx(w);
+
+    const bool on = imp->dir[W_IMPAIR_RX].on;
+    if (on && rx)
+        imp_rx_all(w, now);
+    imp_release_rx(w, now);
+    return (rx && on == false) || imp_compact(imp);
+}
+
+
+/// Release the held-back TX datagrams of engine @p w that are due, push them
+/// out with backend_nic_tx(), and free the copies that have been sent.
+///
+/// @param      w     Backend engine.
+///
+void imp_nic_tx(struct w_engine * const w)
+{
+    imp_release_tx(w, w_now(CLOCK_MONOTONIC));
+    backend_nic_tx(w);
+    w_free(&w->imp->sent);
+}
+
+
+/// Fill w_sock_slist @p sl with the sockets of engine @p w that have data
+/// ready, after passing newly received data through the RX impairment.
+///
+/// @param      w     Backend engine.
+/// @param      sl    Empty and initialized w_sock_slist.
+///
+/// @return     Number of sockets that are ready for reading.
+///
+uint32_t imp_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
+{
+    struct w_impair * const imp = w->imp;
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    uint32_t n = 0;
+    if (imp->dir[W_IMPAIR_RX].on)
+        imp_rx_all(w, now);
+    else
+        n = backend_rx_ready(w, sl);
+    imp_release_rx(w, now);
+    imp_compact(imp);
+
+    for (uint32_t i = 0; i < imp->rdy_cnt; i++) {
+        struct w_sock * const s = imp->rdy[i];
+        struct w_sock * l;
+        sl_foreach (l, sl, next)
+            if (l == s)
+                break;
+        if (l == 0) {
+            sl_insert_head(sl, s, next);
+            n++;
+        }
+    }
+    return n;
+}
+
+
+/// Remove the held-back datagrams of w_sock @p s from impairment @p d.
+///
+/// @param      d     Impairment.
+/// @param[in]  s     w_sock.
+///
+static void __attribute__((nonnull))
+imp_purge(struct imp_dir * const d, const struct w_sock * const s)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < d->cnt; i++)
+        if (d->q[i].s == s)
+            w_free_iov(d->q[i].v);
+        else
+            d->q[n++] = d->q[i];
+    d->cnt = n;
+    for (uint32_t i = n / 2; i-- > 0;)
+        imp_down(d->q, n, i);
+}
+
+
+/// Discard the held-back data of w_sock @p s, which is being closed.
+///
+/// @param      s     w_sock.
+///
+void imp_close(struct w_sock * const s)
+{
+    struct w_impair * const imp = s->w->imp;
+    for (uint32_t i = 0; i < W_IMPAIR_CNT; i++)
+        imp_purge(&imp->dir[i], s);
+    w_free(&s->imp_iv);
+    imp_compact(imp);
+}
+
+
+/// Free the impairment state of engine @p w, if any, discarding all
+/// held-back data.
+///
+/// @param      w     Backend engine.
+///
+void imp_cleanup(struct w_engine * const w)
+{
+    struct w_impair * const imp = w->imp;
+    if (imp == 0)
+        return;
+    for (uint32_t i = 0; i < W_IMPAIR_CNT; i++) {
+        struct imp_dir * const d = &imp->dir[i];
+        while (d->cnt)
+            w_free_iov(d->q[--d->cnt].v);
+        free(d->q);
+    }
+    w_free(&imp->sent);
+    for (uint32_t i = 0; i < imp->rdy_cnt; i++)
+        w_free(&imp->rdy[i]->imp_iv);
+    free(imp->rdy);
+    free(imp);
+    w->imp = 0;
+}
+
+
+/// Impair direction @p dir of engine @p w, to test an application under loss,
+/// delay, jitter, reordering, duplication and rate limits, without a network
+/// emulator. Datagrams are lost or duplicated first, and then held back until
+/// their release time: the time at which the rate limit lets them leave, plus
+/// the delay, which jitter can vary and so reorder datagrams. A datagram that
+/// skips the delay with probability w_impair_opt::reorder overtakes those that
+/// do not. Losses count as #W_DROP_IMPAIRED.
+///
+/// TX datagrams are copied into engine-owned w_iovs by w_tx(), so the
+/// application may reuse them right away; w_tx() does not set their
+/// w_iov::ts. Released TX datagrams are sent by the next w_tx(), w_nic_tx() or
+/// w_nic_rx(). RX datagrams are impaired on their way from the backend to
+/// w_rx(), and w_nic_rx() waits at most until the next one is due.
+///
+/// Disabling an impairment releases the datagrams it holds back.
+///
+/// @param      w     Backend engine.
+/// @param[in]  dir   Direction to impair.
+/// @param[in]  opt   Impairment options, or zero to disable the impairment.
+///
+/// @return     Zero on success, @p errno otherwise. EINVAL for an invalid
+///             direction or probability.
+///
+int w_set_impair(struct w_engine * const w,
+                 const enum w_impair_dir dir,
+                 const struct w_impair_opt * const opt)
+{
+    const struct w_impair_opt o = opt ? *opt : (struct w_impair_opt){0};
+    if ((uint32_t)dir >= W_IMPAIR_CNT || o.loss > PPM || o.p_bad > PPM ||
+        o.p_good > PPM || o.loss_bad > PPM || o.dup > PPM || o.reorder > PPM ||
+        o.jitter > INT64_MAX / 2)
+        return EINVAL;
+
+    const bool on = o.loss || o.p_bad || o.dup || o.delay || o.jitter || o.rate;
+    if (w->imp == 0) {
+        if (on == false)
+            return 0;
+        ensure((w->imp = calloc(1, sizeof(*w->imp))) != 0,
+               "cannot alloc impairment");
+        sq_init(&w->imp->sent);
+    }
+
+    struct imp_dir * const d = &w->imp->dir[dir];
+    d->opt = o;
+    d->on = on;
+    d->bad = false;
+    d->next = 0;
+    if (on == false) {
+        if (dir == W_IMPAIR_TX)
+            imp_release_tx(w, UINT64_MAX);
+        else
+            imp_release_rx(w, UINT64_MAX);
+    }
+    return 0;
+}
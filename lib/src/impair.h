@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <warpcore/warpcore.h>
+
+
+/// A datagram held back by an impairment.
+///
+struct imp_ent {
+    uint64_t t;        ///< Release time, in ns of w_now(CLOCK_MONOTONIC).
+    uint64_t seq;      ///< Sequence number, for FIFO order at equal @p t.
+    struct w_sock * s; ///< The w_sock the datagram belongs to.
+    struct w_iov * v;  ///< The datagram.
+};
+
+
+/// The impairment of one direction of an engine.
+///
+struct imp_dir {
+    struct w_impair_opt opt; ///< Impairment options.
+    struct imp_ent * q;      ///< Held-back datagrams, a binary min-heap.
+    uint32_t cnt;            ///< Number of entries in @p q.
+    uint32_t cap;            ///< Capacity of @p q.
+    uint64_t seq;            ///< Sequence number for the next entry.
+    uint64_t next;           ///< Earliest release time under the rate limit.
+    bool on;                 ///< Whether @p opt impairs anything.
+    bool bad;                ///< Whether the Gilbert-Elliott model is bad.
+};
+
+
+/// Engine-owned impairment state, see w_set_impair().
+///
+struct w_impair {
+    struct imp_dir dir[W_IMPAIR_CNT]; ///< Impairments, by enum w_impair_dir.
+    struct w_iov_sq sent;             ///< Released TX copies, to be freed.
+    struct w_sock ** rdy;             ///< Sockets with w_sock::imp_iv data.
+    uint32_t rdy_cnt;                 ///< Number of entries in @p rdy.
+    uint32_t rdy_cap;                 ///< Capacity of @p rdy.
+};
+
+
+extern void __attribute__((nonnull))
+imp_tx(struct w_sock * const s, struct w_iov_sq * const o);
+
+extern void __attribute__((nonnull))
+imp_rx(struct w_sock * const s, struct w_iov_sq * const i);
+
+extern int64_t __attribute__((nonnull))
+imp_wait(struct w_engine * const w, const int64_t nsec);
+
+extern bool __attribute__((nonnull))
+imp_nic_rx(struct w_engine * const w, const bool rx);
+
+extern void __attribute__((nonnull)) imp_nic_tx(struct w_engine * const w);
+
+extern uint32_t __attribute__((nonnull))
+imp_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl);
+
+extern void __attribute__((nonnull)) imp_close(struct w_sock * const s);
+
+extern void __attribute__((nonnull)) imp_cleanup(struct w_engine * const w);
@@ -36,10 +36,9 @@
 
 #include <stdint.h>
 
-#include <net/netmap_user.h>
-
 #include <warpcore/warpcore.h>
 
+#include "backend.h"
 #include "eth.h"
 #include "icmp4.h"
 #include "in_cksum.h"
@@ -75,7 +74,7 @@
 /// IPv4 options are currently unsupported; as are IPv4 fragments.
 ///
 /// @param      w     Backend engine.
-/// @param      s     Currently active netmap RX slot.
+/// @param      s     Currently active RX slot.
 /// @param      buf   Incoming packet.
 ///
 /// @return     Whether a packet was placed into a socket.
@@ -85,7 +84,7 @@ bool
     __attribute__((no_sanitize("alignment")))
 #endif
     ip4_rx(struct w_engine * const w,
-           struct netmap_slot * const s,
+           struct w_slot * const s,
            uint8_t * const buf)
 {
     // an Ethernet frame is at least 64 bytes, enough for the Ethernet+IP header
@@ -94,6 +93,7 @@ bool
 
     if (unlikely(ip_v(ip->vhl) != 4)) {
         warn(ERR, "illegal IPv4 version %u", ip_v(ip->vhl));
+        count_drop(w, 0, W_DROP_MALFORMED);
         return false;
     }
 
@@ -104,6 +104,7 @@ bool
         warn(INF, "IP packet from %s to %s (not us); ignoring",
              inet_ntop(AF_INET, &ip->src, ip4_tmp, IP4_STRLEN),
              inet_ntop(AF_INET, &ip->dst, ip4_tmp, IP4_STRLEN));
+        count_drop(w, 0, W_DROP_NOT_US);
         return false;
     }
 
@@ -111,18 +112,21 @@ bool
     if (unlikely(ip_cksum(ip, hl) != 0)) {
         warn(WRN, "invalid IP checksum, received 0x%04x != 0x%04x",
              bswap16(ip->cksum), ip_cksum(ip, hl));
+        count_drop(w, 0, W_DROP_BAD_CKSUM);
         return false;
     }
 
     if (unlikely(ip4_hl(ip->vhl) != hl)) {
         // TODO: handle IP options
         warn(WRN, "no support for IP options");
+        count_drop(w, 0, W_DROP_UNSUPPORTED);
         return false;
     }
 
     if (unlikely(ip->off & IP4_OFFMASK)) {
         // TODO: handle IP fragments
         warn(WRN, "no support for IP fragments");
+        count_drop(w, 0, W_DROP_UNSUPPORTED);
         return false;
     }
 
@@ -132,6 +136,7 @@ bool
         icmp4_rx(w, s, buf);
     else {
         warn(INF, "unhandled IP protocol %d", ip->p);
+        count_drop(w, 0, W_DROP_UNSUPPORTED);
         // be standards compliant and send an ICMP unreachable
         icmp4_tx(w, ICMP4_TYPE_UNREACH, ICMP4_UNREACH_PROTOCOL, buf);
     }
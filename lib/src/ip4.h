@@ -34,8 +34,8 @@
 
 #include "eth.h"
 
-#ifdef WITH_NETMAP
-struct netmap_slot;
+#ifdef WITH_ETH
+struct w_slot;
 #endif
 
 
@@ -144,10 +144,10 @@ ip4_data_len(const struct ip4_hdr * const ip)
 }
 
 
-#ifdef WITH_NETMAP
+#ifdef WITH_ETH
 
 extern bool __attribute__((nonnull)) ip4_rx(struct w_engine * const w,
-                                            struct netmap_slot * const s,
+                                            struct w_slot * const s,
                                             uint8_t * const buf);
 
 extern void __attribute__((nonnull(1)))
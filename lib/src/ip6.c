@@ -39,6 +39,7 @@
 
 #include <warpcore/warpcore.h>
 
+#include "backend.h"
 #include "eth.h"
 #include "icmp6.h"
 #include "ip4.h"
@@ -71,7 +72,7 @@
 /// IPv4 options are currently unsupported; as are IPv4 fragments.
 ///
 /// @param      w     Backend engine.
-/// @param      s     Currently active netmap RX slot.
+/// @param      s     Currently active RX slot.
 /// @param      buf   Incoming packet.
 ///
 /// @return     Whether a packet was placed into a socket.
@@ -81,7 +82,7 @@ bool
     __attribute__((no_sanitize("alignment")))
 #endif
     ip6_rx(struct w_engine * const w,
-           struct netmap_slot * const s,
+           struct w_slot * const s,
            uint8_t * const buf)
 {
     // an Ethernet frame is at least 64 bytes, enough for the Ethernet+IP header
@@ -91,6 +92,7 @@ bool
     if (unlikely(ip_v(ip->vfc) != 6)) {
         warn(ERR, "illegal IPv6 version %u 0x%04x", ip_v(ip->vfc),
              ip->vtcecnfl);
+        count_drop(w, 0, W_DROP_MALFORMED);
         return false;
     }
 
@@ -99,6 +101,7 @@ bool
         warn(INF, "IPv6 packet from %s to %s (not us); ignoring",
              inet_ntop(AF_INET6, &ip->src, ip6_tmp, IP6_STRLEN),
              inet_ntop(AF_INET6, &ip->dst, ip6_tmp, IP6_STRLEN));
+        count_drop(w, 0, W_DROP_NOT_US);
         return false;
     }
 
@@ -108,6 +111,7 @@ bool
         icmp6_rx(w, s, buf);
     else {
         warn(INF, "unhandled next-header protocol %d", ip->next_hdr);
+        count_drop(w, 0, W_DROP_UNSUPPORTED);
     }
     return false;
 }
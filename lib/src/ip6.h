@@ -34,8 +34,8 @@
 
 #include "eth.h"
 
-#ifdef WITH_NETMAP
-struct netmap_slot;
+#ifdef WITH_ETH
+struct w_slot;
 #endif
 
 
@@ -158,10 +158,10 @@ ip6_mk_snma(uint8_t * restrict const dst, const uint8_t * restrict src)
 }
 
 
-#ifdef WITH_NETMAP
+#ifdef WITH_ETH
 
 extern bool __attribute__((nonnull)) ip6_rx(struct w_engine * const w,
-                                            struct netmap_slot * const s,
+                                            struct w_slot * const s,
                                             uint8_t * const buf);
 
 extern void __attribute__((nonnull(1)))
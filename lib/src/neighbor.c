@@ -108,8 +108,13 @@ struct eth_addr
         else
             icmp6_nsol(w, addr->ip6);
 
+#if defined(WITH_PCAP) || defined(WITH_MEM)
+        // the answer cannot arrive while we wait, so use the broadcast address
+        break;
+#endif
+
         // wait until packets have been received, then handle them
-        w_nic_rx(w, 1 * NS_PER_S);
+        backend_nic_rx(w, 1 * NS_PER_S);
 
         // check if we can now resolve dip
         a = neighbor_find(w, addr);
@@ -0,0 +1,323 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "timer.h"
+
+
+// A hierarchical timing wheel in the style of Varghese and Lauck. Each level
+// has TW_SLOTS slots, and each slot of a level spans all TW_SLOTS slots of the
+// level below. A timer sits in the level of the highest TW_BITS-digit in
+// which its expiry tick differs from the current tick, and moves down a level
+// once the wheel reaches its slot there, until it expires from level zero.
+// Adding and cancelling a timer are O(1), and so is finding the next slot
+// that needs attention, via a bitmap of non-empty slots per level.
+
+#define TW_TICK_SHIFT 10 ///< A tick is 2^10 ns, i.e., about a microsecond.
+#define TW_BITS 6        ///< Bits per level; a level's bitmap is a uint64_t.
+#define TW_SLOTS (1U << TW_BITS)
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_LEVELS 6 ///< With the above, spans 2^46 ns, i.e., about 19 hours.
+
+
+/// Engine-owned timing wheel.
+///
+struct w_timers {
+    uint64_t tick;                              ///< Last processed tick.
+    uint64_t occ[TW_LEVELS];                    ///< Bitmaps of non-empty slots.
+    struct w_timer * slot[TW_LEVELS][TW_SLOTS]; ///< Unordered timer lists.
+};
+
+
+static inline uint64_t to_tick(const uint64_t ns)
+{
+    // round up, so a timer never fires before its expiry
+    return ns >= UINT64_MAX - ((1U << TW_TICK_SHIFT) - 1)
+               ? UINT64_MAX >> TW_TICK_SHIFT
+               : (ns + (1U << TW_TICK_SHIFT) - 1) >> TW_TICK_SHIFT;
+}
+
+
+static inline uint64_t rotl(const uint64_t x, const uint32_t r)
+{
+    return (x << (r & 63)) | (x >> ((64 - r) & 63));
+}
+
+
+static void __attribute__((nonnull))
+tw_link(struct w_timer ** const head, struct w_timer * const t)
+{
+    t->next = *head;
+    if (t->next)
+        t->next->prev = &t->next;
+    *head = t;
+    t->prev = head;
+}
+
+
+static void __attribute__((nonnull))
+tw_unlink(struct w_timers * const tw, struct w_timer * const t)
+{
+    *t->prev = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+
+    // if t was the only timer in a wheel slot, mark the slot empty
+    const uintptr_t p = (uintptr_t)t->prev;
+    const uintptr_t first = (uintptr_t)&tw->slot[0][0];
+    if (p >= first && p < (uintptr_t)&tw->slot[TW_LEVELS][0] &&
+        *t->prev == 0) {
+        const uint32_t i = (uint32_t)((p - first) / sizeof(t->prev));
+        tw->occ[i / TW_SLOTS] &= ~(UINT64_C(1) << (i % TW_SLOTS));
+    }
+    t->prev = 0;
+    t->next = 0;
+}
+
+
+/// Sort the timer list starting at @p h by expiry, keeping the order of timers
+/// with the same expiry. Only fixes up the w_timer::next links.
+///
+/// @param      h     First timer of the list.
+///
+/// @return     First timer of the sorted list.
+///
+static struct w_timer * tw_sort(struct w_timer * const h)
+{
+    if (h == 0 || h->next == 0)
+        return h;
+
+    // split the list in half, and merge the sorted halves
+    struct w_timer * mid = h;
+    for (const struct w_timer * f = h->next; f && f->next; f = f->next->next)
+        mid = mid->next;
+    struct w_timer * b = tw_sort(mid->next);
+    mid->next = 0;
+    struct w_timer * a = tw_sort(h);
+
+    struct w_timer * out = 0;
+    struct w_timer ** tail = &out;
+    while (a && b) {
+        if (b->expiry < a->expiry) {
+            *tail = b;
+            b = b->next;
+        } else {
+            *tail = a;
+            a = a->next;
+        }
+        tail = &(*tail)->next;
+    }
+    *tail = a ? a : b;
+    return out;
+}
+
+
+static void __attribute__((nonnull))
+tw_place(struct w_timers * const tw, struct w_timer * const t)
+{
+    const uint64_t e = to_tick(t->expiry);
+    uint32_t l = 0;
+    uint32_t s;
+    if (e <= tw->tick)
+        // already due, so fire with the next tick
+        s = (uint32_t)((tw->tick + 1) & TW_MASK);
+    else {
+        l = (uint32_t)(63 - __builtin_clzll(e ^ tw->tick)) / TW_BITS;
+        if (likely(l < TW_LEVELS))
+            s = (uint32_t)((e >> (l * TW_BITS)) & TW_MASK);
+        else {
+            // beyond the span of the wheel; park in the top-level slot
+            // visited last, and place again from there
+            l = TW_LEVELS - 1;
+            s = (uint32_t)(((tw->tick >> (l * TW_BITS)) - 1) & TW_MASK);
+        }
+    }
+    tw_link(&tw->slot[l][s], t);
+    tw->occ[l] |= UINT64_C(1) << s;
+}
+
+
+/// Shorten the w_nic_rx() timeout @p nsec to the time until the timing wheel
+/// of engine @p w next needs to run. For timers in higher levels of the
+/// wheel, this is when they move down a level, which can be before they are
+/// due.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds, or -1 for infinite wait.
+///
+/// @return     Timeout in nanoseconds, or -1 for infinite wait.
+///
+int64_t timer_wait(const struct w_engine * const w, const int64_t nsec)
+{
+    const struct w_timers * const tw = w->timers;
+    uint64_t next = UINT64_MAX;
+    for (uint32_t l = 0; l < TW_LEVELS; l++) {
+        if (tw->occ[l] == 0)
+            continue;
+        const uint64_t cur = tw->tick >> (l * TW_BITS);
+        // distance from the current slot to the next non-empty one
+        const uint64_t occ =
+            rotl(tw->occ[l], TW_SLOTS - (uint32_t)((cur + 1) & TW_MASK));
+        const uint64_t d = (uint64_t)__builtin_ctzll(occ) + 1;
+        next = MIN(next, (cur + d) << (l * TW_BITS));
+    }
+    if (next == UINT64_MAX)
+        return nsec;
+
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    const uint64_t at = next << TW_TICK_SHIFT;
+    const int64_t d = at > now ? (int64_t)MIN(at - now, INT64_MAX) : 0;
+    return nsec < 0 ? d : MIN(nsec, d);
+}
+
+
+/// Advance the timing wheel of engine @p w to the current time, and call the
+/// callbacks of all timers that have expired.
+///
+/// @param      w     Backend engine.
+///
+void timer_run(struct w_engine * const w)
+{
+    struct w_timers * const tw = w->timers;
+    const uint64_t target = w_now(CLOCK_MONOTONIC) >> TW_TICK_SHIFT;
+    if (target <= tw->tick)
+        return;
+
+    // collect the timers of all slots the wheel passes
+    struct w_timer * todo = 0;
+    for (uint32_t l = 0; l < TW_LEVELS; l++) {
+        const uint32_t sh = l * TW_BITS;
+        const uint64_t passed = (target >> sh) - (tw->tick >> sh);
+        if (passed == 0)
+            break;
+        uint64_t slots =
+            passed >= TW_SLOTS
+                ? UINT64_MAX
+                : rotl((UINT64_C(1) << passed) - 1,
+                       (uint32_t)(((tw->tick >> sh) + 1) & TW_MASK));
+        slots &= tw->occ[l];
+        while (slots) {
+            const uint32_t s = (uint32_t)__builtin_ctzll(slots);
+            slots &= slots - 1;
+            struct w_timer * t;
+            while ((t = tw->slot[l][s]) != 0) {
+                tw_unlink(tw, t);
+                tw_link(&todo, t);
+            }
+        }
+    }
+    tw->tick = target;
+
+    // move the ones that are not due yet further down the wheel
+    struct w_timer * t = todo;
+    while (t) {
+        struct w_timer * const next = t->next;
+        if (to_tick(t->expiry) > tw->tick) {
+            tw_unlink(tw, t);
+            tw_place(tw, t);
+        }
+        t = next;
+    }
+
+    // the slots were collected out of order, so sort the expired timers
+    todo = tw_sort(todo);
+    struct w_timer ** prev = &todo;
+    for (t = todo; t; t = t->next) {
+        t->prev = prev;
+        prev = &t->next;
+    }
+
+    // fire them in order; callbacks may add and cancel timers, including
+    // those still in todo
+    while ((t = todo) != 0) {
+        tw_unlink(tw, t);
+        t->cb(t, t->data);
+    }
+}
+
+
+/// Free the timing wheel of engine @p w. Pending timers are dropped.
+///
+/// @param      w     Backend engine.
+///
+void timer_cleanup(struct w_engine * const w)
+{
+    free(w->timers);
+    w->timers = 0;
+}
+
+
+/// Arm timer @p t to call @p cb with @p data at time @p expiry. If @p t is
+/// already pending, it is rescheduled. w_nic_rx() waits no longer than until
+/// the next timer expires, and calls the callbacks of expired timers after
+/// processing received data. Callbacks are called with @p t no longer
+/// pending, so they can re-arm it. Timers fire in order of their expiry, at
+/// most about a microsecond late, plus however late w_nic_rx() is called.
+///
+/// @param      w       Backend engine.
+/// @param      t       Timer, zero-initialized before first use.
+/// @param[in]  expiry  Expiry time, in nanoseconds of w_now(CLOCK_MONOTONIC).
+/// @param[in]  cb      Function to call on expiry.
+/// @param      data    Argument passed to @p cb.
+///
+void w_timer_add(struct w_engine * const w,
+                 struct w_timer * const t,
+                 const uint64_t expiry,
+                 void (*const cb)(struct w_timer * const, void * const),
+                 void * const data)
+{
+    if (unlikely(w->timers == 0)) {
+        ensure((w->timers = calloc(1, sizeof(*w->timers))) != 0,
+               "cannot allocate timing wheel");
+        w->timers->tick = w_now(CLOCK_MONOTONIC) >> TW_TICK_SHIFT;
+    }
+
+    struct w_timers * const tw = w->timers;
+    if (t->prev)
+        tw_unlink(tw, t);
+    t->cb = cb;
+    t->data = data;
+    t->expiry = expiry;
+    tw_place(tw, t);
+}
+
+
+/// Disarm timer @p t, if it is pending.
+///
+/// @param      w     Backend engine.
+/// @param      t     Timer.
+///
+void w_timer_cancel(struct w_engine * const w, struct w_timer * const t)
+{
+    if (t->prev)
+        tw_unlink(w->timers, t);
+}
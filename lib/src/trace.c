@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "trace.h"
+
+
+/// Enable or disable the binary event trace ring of engine @p w. The ring
+/// holds the most recent @p n events, rounded up to a power of two, which
+/// w_trace_save() writes to a file for offline decoding. Enabling discards
+/// any earlier events.
+///
+/// Independently of the ring, every event is also a USDT probe in provider
+/// "warpcore", if warpcore was built with <sys/sdt.h>.
+///
+/// @param      w     Backend engine.
+/// @param[in]  n     Number of events to keep, or zero to disable tracing.
+///
+void w_set_trace(struct w_engine * const w, const uint32_t n)
+{
+    trace_cleanup(w);
+    if (n == 0)
+        return;
+
+    uint64_t len = 1;
+    while (len < n && len < UINT32_MAX / 2 + 1)
+        len <<= 1;
+    ensure((w->trace = calloc(1, sizeof(*w->trace) +
+                                     len * sizeof(w->trace->ent[0]))) != 0,
+           "cannot alloc trace ring");
+    w->trace->mask = len - 1;
+    w->trace->ns0 = w_now(CLOCK_REALTIME);
+    w->trace->tsc0 = trace_tsc();
+}
+
+
+/// Write the events in the trace ring of engine @p w to file @p path, as a
+/// struct w_trace_hdr followed by the events, oldest first. Tracing
+/// continues.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  path  File to (over)write.
+///
+/// @return     Zero on success, @p errno otherwise.
+///
+int w_trace_save(const struct w_engine * const w, const char * const path)
+{
+    const struct w_trace * const t = w->trace;
+    if (t == 0)
+        return EINVAL;
+
+    const uint64_t cnt = MIN(t->head, t->mask + 1);
+    const struct w_trace_hdr hdr = {.magic = W_TRACE_MAGIC,
+                                    .cnt = (uint32_t)cnt,
+                                    .lost = t->head - cnt,
+                                    .tsc0 = t->tsc0,
+                                    .ns0 = t->ns0,
+                                    .tsc1 = trace_tsc(),
+                                    .ns1 = w_now(CLOCK_REALTIME)};
+
+    FILE * const f = fopen(path, "wb");
+    if (f == 0)
+        return errno;
+
+    // the oldest entry is at the head, unless the ring has not wrapped yet
+    const uint64_t first = (t->head - cnt) & t->mask;
+    const uint64_t tail = MIN(cnt, t->mask + 1 - first);
+    int ret = 0;
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        fwrite(&t->ent[first], sizeof(t->ent[0]), tail, f) != tail ||
+        fwrite(t->ent, sizeof(t->ent[0]), cnt - tail, f) != cnt - tail)
+        ret = errno ? errno : EIO;
+    if (fclose(f) != 0 && ret == 0)
+        ret = errno;
+    return ret;
+}
+
+
+/// Free the trace ring of engine @p w.
+///
+/// @param      w     Backend engine.
+///
+void trace_cleanup(struct w_engine * const w)
+{
+    free(w->trace);
+    w->trace = 0;
+}
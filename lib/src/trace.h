@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <warpcore/warpcore.h>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+
+/// Engine-owned trace ring.
+///
+struct w_trace {
+    uint64_t head;            ///< Number of entries written so far.
+    uint64_t mask;            ///< Number of entries in @p ent minus one.
+    uint64_t tsc0;            ///< trace_tsc() when tracing was enabled.
+    uint64_t ns0;             ///< CLOCK_REALTIME when tracing was enabled.
+    struct w_trace_ent ent[]; ///< The ring.
+};
+
+
+/// Read the CPU timestamp counter, or a cheap clock where there is none.
+///
+/// @return     Timestamp.
+///
+static inline uint64_t trace_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    return w_now(CLOCK_MONOTONIC);
+#endif
+}
+
+
+/// Append an event to trace ring @p t, overwriting the oldest one if full.
+///
+/// @param      t     Trace ring.
+/// @param[in]  type  Event type.
+/// @param[in]  a     Event argument.
+/// @param[in]  b     Event argument.
+/// @param[in]  c     Event argument.
+///
+static inline void __attribute__((nonnull))
+trace_add(struct w_trace * const t,
+          const enum w_trace_type type,
+          const uint32_t a,
+          const uint16_t b,
+          const uint8_t c)
+{
+    t->ent[t->head++ & t->mask] = (struct w_trace_ent){
+        .tsc = trace_tsc(), .a = a, .b = b, .c = c, .type = (uint8_t)type};
+}
+
+
+#ifdef HAVE_SYS_SDT_H
+#define trace_probe(ev, a, b, c) DTRACE_PROBE3(warpcore, ev, a, b, c)
+#else
+#define trace_probe(ev, a, b, c)                                              \
+    do {                                                                       \
+    } while (0)
+#endif
+
+
+/// Record an event of type @p type in the trace ring of engine @p w, if one is
+/// enabled, and fire the USDT probe warpcore:@p ev with the same arguments.
+///
+/// @param      w     Backend engine.
+/// @param      type  Event type, an enum w_trace_type.
+/// @param      ev    USDT probe name.
+/// @param      a     Event argument.
+/// @param      b     Event argument.
+/// @param      c     Event argument.
+///
+#define trace_ev(w, type, ev, a, b, c)                                         \
+    do {                                                                       \
+        trace_probe(ev, (uint32_t)(a), (uint16_t)(b), (uint8_t)(c));           \
+        if (unlikely((w)->trace))                                              \
+            trace_add((w)->trace, (type), (uint32_t)(a), (uint16_t)(b),        \
+                      (uint8_t)(c));                                           \
+    } while (0)
+
+
+extern void __attribute__((nonnull)) trace_cleanup(struct w_engine * const w);
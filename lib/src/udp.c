@@ -32,8 +32,7 @@
 #include <string.h>
 #include <sys/param.h>
 #include <sys/socket.h>
-
-#include <net/netmap.h>
+#include <time.h>
 
 #include "backend.h"
 #include "eth.h"
@@ -64,11 +63,10 @@
 /// data to the corresponding w_sock. Also makes the receive timestamp and IPv4
 /// flags available, via w_iov::ts and w_iov::flags, respectively.
 ///
-/// The Ethernet frame to operate on is in the current netmap lot of the
-/// indicated RX ring.
+/// The Ethernet frame to operate on is in the current RX slot @p s.
 ///
 /// @param      w     Backend engine.
-/// @param      s     Currently active netmap RX slot.
+/// @param      s     Currently active RX slot.
 /// @param      buf   Incoming packet.
 ///
 /// @return     Whether a packet was placed into a socket.
@@ -78,7 +76,7 @@ bool
     __attribute__((no_sanitize("alignment")))
 #endif
     udp_rx(struct w_engine * const w,
-           struct netmap_slot * const s,
+           struct w_slot * const s,
            uint8_t * const buf)
 {
     // grab an unused iov for the data in this packet
@@ -88,6 +86,7 @@ bool
     struct w_iov * const i = w_alloc_iov_base(w);
     if (unlikely(i == 0)) {
         warn(CRT, "no more bufs; UDP packet RX failed");
+        count_drop(w, 0, W_DROP_NO_BUFS);
         return false;
     }
 
@@ -122,6 +121,8 @@ bool
 
     if (unlikely(ip_plen < sizeof(*udp))) {
         warn(WRN, "IP payload %u too short for UDP header", ip_plen);
+        count_drop(w, 0, W_DROP_MALFORMED);
+        w_free_iov(i);
         return false;
     }
 
@@ -134,25 +135,27 @@ bool
         if (unlikely(payload_cksum(ip, udp_len + ip_hdr_len) != 0)) {
             warn(WRN, "invalid UDP checksum, received 0x%04x",
                  bswap16(udp->cksum));
+            count_drop(w, 0, W_DROP_BAD_CKSUM);
+            w_free_iov(i);
             return false;
         }
     }
 
     i->wv_port = udp->sport;
+    i->ts = s->ts;
     local.port = udp->dport;
-    struct w_sock * ws = w_get_sock(w, &local, &i->saddr);
+    // a connected socket, or else a bound-only one
+    struct w_sock * const ws = flow_demux(&w->b->sock, &local, &i->saddr);
     if (unlikely(ws == 0)) {
-        // no socket connected, check for bound-only socket
-        ws = w_get_sock(w, &local, 0);
-        if (unlikely(ws == 0)) {
-            // nobody bound to this port locally
-            // send an ICMP unreachable reply, if this was not a broadcast
-            if (v == 4 && is_my_ip4(w, i->wv_ip4, false) != UINT16_MAX)
-                icmp4_tx(w, ICMP4_TYPE_UNREACH, ICMP4_UNREACH_PORT, buf);
-            else if (v == 6 && is_my_ip6(w, i->wv_ip6, false) != UINT16_MAX)
-                icmp6_tx(w, ICMP6_TYPE_UNREACH, ICMP6_UNREACH_PORT, buf);
-            return false;
-        }
+        // nobody bound to this port locally
+        // send an ICMP unreachable reply, if this was not a broadcast
+        if (v == 4 && is_my_ip4(w, i->wv_ip4, false) != UINT16_MAX)
+            icmp4_tx(w, ICMP4_TYPE_UNREACH, ICMP4_UNREACH_PORT, buf);
+        else if (v == 6 && is_my_ip6(w, i->wv_ip6, false) != UINT16_MAX)
+            icmp6_tx(w, ICMP6_TYPE_UNREACH, ICMP6_UNREACH_PORT, buf);
+        count_drop(w, 0, W_DROP_NO_SOCK);
+        w_free_iov(i);
+        return false;
     }
 
 #if 0
@@ -168,10 +171,13 @@ bool
 
     // put the original buffer of the iov into the receive ring
     s->buf_idx = tmp_idx;
-    s->flags = NS_BUF_CHANGED;
 
     // append the iov to the socket
+    if (sq_empty(&ws->iv))
+        rdy_add(ws);
     sq_insert_tail(&ws->iv, i, next);
+    count_rx(ws, i->len);
+    trace_ev(w, W_TRACE_DEMUX, demux, i->idx, ws->ws_lport, 0);
     return true;
 }
 
@@ -214,6 +220,8 @@ bool udp_tx(const struct w_sock * const s, struct w_iov * const v)
 
     mk_eth_hdr(s, v);
     udp_log(udp);
+    if (unlikely(s->opt.enable_timestamps))
+        v->ts = w_now(CLOCK_REALTIME);
     const bool ret = eth_tx(v);
     v->len = vlen;
     return ret;
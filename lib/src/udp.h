@@ -30,7 +30,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-struct netmap_slot;
+struct w_slot;
 struct w_engine;
 struct w_iov;
 struct w_sock;
@@ -47,7 +47,7 @@ struct udp_hdr {
 
 
 extern bool __attribute__((nonnull)) udp_rx(struct w_engine * const w,
-                                            struct netmap_slot * const s,
+                                            struct w_slot * const s,
                                             uint8_t * const buf);
 
 extern bool __attribute__((nonnull))
@@ -27,17 +27,17 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
-
-#if defined(DSTACK)
 #include <sys/param.h>
-#endif
+#include <sys/time.h>
+#include <time.h>
 
 #ifdef __FreeBSD__
 #include <time.h>
@@ -79,6 +79,10 @@ int gettimeofday(struct timeval * restrict tp,
 #include "esp_system.h"
 #endif
 
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+#include <pthread.h>
+#endif
+
 
 #ifndef NDEBUG
 #ifdef DCOMPONENT
@@ -208,6 +212,9 @@ premain(const int argc __attribute__((unused)),
 ///
 static void __attribute__((destructor)) postmain(void)
 {
+    // Print any deferred messages
+    util_log_sync();
+
 #if !defined(NDEBUG) && defined(DCOMPONENT)
     // Free the regular expression used for restricting debug output
     regfree(&util_comp);
@@ -231,30 +238,32 @@ short util_dlevel = DLEVEL;
 #define BCYN "\x1B[46m" ///< ANSI escape sequence: background cyan
 
 
-static void
-    __attribute__((nonnull, no_instrument_function, format(printf, 6, 0)))
-    util_warn_valist(const unsigned dlevel,
-                     const bool tstamp,
-                     const char * const func,
-                     const char * const file,
-                     const unsigned line,
-                     const char * const fmt,
-                     va_list ap)
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+/// Print the thread indicator, timestamp and severity color of a warn() line.
+/// Must be called with DTHREAD_LOCK held.
+///
+/// @param[in]  dlevel  The #dlevel severity level of the message.
+/// @param[in]  tstamp  Whether to always print a timestamp.
+/// @param[in]  now     The time at which the message was logged.
+/// @param[in]  id      The DTHREAD_ID of the logging thread.
+///
+static void __attribute__((nonnull, no_instrument_function))
+util_warn_prefix(const unsigned dlevel,
+                 const bool tstamp,
+                 const struct timeval * const now,
+                 const char * const id)
 {
-#if !defined(PARTICLE)
-#if !defined(RIOT_VERSION)
     const char * const util_col[] = {BMAG, BRED, BYEL, BCYN, BBLU, BGRN};
-    DTHREAD_LOCK;
 
     static struct timeval last = {-1, -1};
-    struct timeval now;
-    struct timeval dur;
+    struct timeval dur = {0, 0};
     struct timeval diff;
-    gettimeofday(&now, 0);
-    timersub(&now, &util_epoch, &dur);
-    timersub(&now, &last, &diff);
+    if (!timercmp(now, &util_epoch, <))
+        // a coarse deferred timestamp can lag the epoch
+        timersub(now, &util_epoch, &dur);
+    timersub(now, &last, &diff);
 
-    fprintf(stderr, DTHREAD_ID_IND(NRM), DTHREAD_ID);
+    fprintf(stderr, DTHREAD_ID_IND(NRM), id);
 
     static int now_str_len = 0;
     if (tstamp || diff.tv_sec || diff.tv_usec > 1000) {
@@ -265,12 +274,570 @@ static void
                                (long)(dur.tv_usec / 1000) // NOLINT
         );
         fprintf(stderr, "%s ", now_str);
-        last = now;
+        last = *now;
     } else
         // subtract out the length of the ANSI control characters
         for (int i = 0; i <= now_str_len - 8; i++)
             fputc(' ', stderr);
     fprintf(stderr, "%s " NRM " ", util_col[dlevel]);
+}
+
+
+#define LOG_ARGS 12  ///< Maximum number of arguments of a deferred message.
+#define LOG_STR 192  ///< Space for copies of the strings of a deferred message.
+#define LOG_RING 512 ///< Deferred messages per thread, must be a power of two.
+
+/// Argument classes, i.e., the types a deferred argument is replayed as.
+///
+enum log_cls {
+    LOG_BAD,     ///< Unsupported conversion.
+    LOG_INT,     ///< int, also for "*" widths and precisions.
+    LOG_LONG,    ///< long
+    LOG_LLONG,   ///< long long
+    LOG_INTMAX,  ///< intmax_t
+    LOG_SIZE,    ///< size_t
+    LOG_PTRDIFF, ///< ptrdiff_t
+    LOG_DBL,     ///< double
+    LOG_LDBL,    ///< long double
+    LOG_PTR,     ///< void *
+    LOG_STRING   ///< char *, copied into log_rec::str.
+};
+
+
+/// A deferred warn() message, whose arguments are formatted by the drainer.
+///
+struct log_rec {
+    struct timeval now;    ///< Time the message was logged.
+    const char * fmt;      ///< Format string, or zero if @p str is formatted.
+    const char * func;     ///< Function that logged the message.
+    const char * file;     ///< File that logged the message.
+    unsigned line;         ///< Line that logged the message.
+    uint8_t dlevel;        ///< Severity of the message.
+    bool tstamp;           ///< Whether to always print a timestamp.
+    bool master;           ///< Whether logged by the master thread.
+    uint8_t cls[LOG_ARGS]; ///< Class of each argument, an enum log_cls.
+    union {
+        long long i;
+        double d;
+        long double ld;
+        const void * p;
+    } arg[LOG_ARGS];       ///< Raw arguments, or offsets into @p str.
+    char str[LOG_STR];     ///< Copies of string arguments.
+};
+
+
+/// Single-producer, single-consumer ring of deferred messages of one thread.
+///
+struct log_ring {
+    struct log_ring * next;       ///< Next ring in log_rings.
+    uint32_t head;                ///< Next slot to fill, by the producer.
+    uint32_t tail;                ///< Next slot to print, by the consumer.
+    uint32_t lost;                ///< Messages dropped while ring was full.
+    bool dead;                    ///< Producer thread has exited.
+    struct log_rec rec[LOG_RING]; ///< Deferred messages.
+};
+
+
+/// Whether warn() messages are deferred to util_log_drain().
+///
+static bool log_async;
+
+/// Serializes drains and ring registration.
+///
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// All per-thread rings, protected by log_lock.
+///
+static struct log_ring * log_rings;
+
+/// Ring of the calling thread, if it has logged asynchronously before.
+///
+static __thread struct log_ring * log_tls;
+
+/// Key whose destructor marks the ring of an exiting thread as dead.
+///
+static pthread_key_t log_key;
+
+/// Background drain thread, if log_interval is non-zero.
+///
+static pthread_t log_thread;
+
+/// Drain interval of log_thread, in nanoseconds.
+///
+static uint64_t log_interval;
+
+
+static void log_exit(void * const arg)
+{
+    __atomic_store_n(&((struct log_ring *)arg)->dead, true, __ATOMIC_RELEASE);
+}
+
+
+static void log_key_init(void)
+{
+    ensure(pthread_key_create(&log_key, log_exit) == 0, "pthread_key_create");
+}
+
+
+/// Parse the printf() conversion specification following a '%'.
+///
+/// @param      f     Pointer to the specification, advanced past it.
+/// @param      star  Number of "*" widths and precisions, i.e., extra int
+///                   arguments preceding the converted one.
+/// @param      prec  Literal precision, -1 if none, or -2 if "*".
+///
+/// @return     The class of the converted argument.
+///
+static enum log_cls __attribute__((nonnull, no_instrument_function))
+log_spec(const char ** const f, uint8_t * const star, int * const prec)
+{
+    const char * s = *f;
+    *star = 0;
+    *prec = -1;
+    s += strspn(s, "-+ #0'");
+    if (*s == '*') {
+        (*star)++;
+        s++;
+    } else
+        s += strspn(s, "0123456789");
+    if (*s == '.') {
+        s++;
+        if (*s == '*') {
+            (*star)++;
+            *prec = -2;
+            s++;
+        } else {
+            *prec = (int)strtol(s, 0, 10);
+            s += strspn(s, "0123456789");
+        }
+    }
+
+    enum log_cls cls = LOG_INT;
+    if (s[0] == 'h')
+        s += s[1] == 'h' ? 2 : 1;
+    else if (s[0] == 'l' && s[1] == 'l') {
+        cls = LOG_LLONG;
+        s += 2;
+    } else if (*s == 'l' || *s == 'q' || *s == 'j' || *s == 'z' ||
+               *s == 't' || *s == 'L') {
+        cls = *s == 'l'   ? LOG_LONG
+              : *s == 'q' ? LOG_LLONG
+              : *s == 'j' ? LOG_INTMAX
+              : *s == 'z' ? LOG_SIZE
+              : *s == 't' ? LOG_PTRDIFF
+                          : LOG_LDBL;
+        s++;
+    }
+
+    const char c = *s;
+    *f = c ? s + 1 : s;
+    if (strchr("diouxX", c) && c)
+        return cls == LOG_LDBL ? LOG_BAD : cls;
+    if (strchr("fFeEgGaA", c) && c)
+        return cls == LOG_LDBL ? LOG_LDBL : cls == LOG_INT ? LOG_DBL : LOG_BAD;
+    if (c == 'c')
+        return cls == LOG_INT ? LOG_INT : LOG_BAD;
+    if (c == 's')
+        return cls == LOG_INT ? LOG_STRING : LOG_BAD;
+    if (c == 'p')
+        return cls == LOG_INT ? LOG_PTR : LOG_BAD;
+    return LOG_BAD;
+}
+
+
+/// Copy the arguments of a message into @p r, without formatting them.
+///
+/// @param      r     Record to fill.
+/// @param[in]  fmt   A printf()-style format string.
+/// @param      ap    The arguments.
+///
+/// @return     Whether all conversions were supported and fit into @p r.
+///
+static bool __attribute__((nonnull, no_instrument_function))
+log_capture(struct log_rec * const r, const char * const fmt, va_list ap)
+{
+    uint_t n = 0;
+    size_t str = 0;
+    for (const char * f = strchr(fmt, '%'); f; f = strchr(f, '%')) {
+        f++;
+        if (*f == '%') {
+            f++;
+            continue;
+        }
+        uint8_t star;
+        int prec;
+        const enum log_cls cls = log_spec(&f, &star, &prec);
+        if (cls == LOG_BAD || n + star >= LOG_ARGS)
+            return false;
+        for (uint8_t i = 0; i < star; i++) {
+            r->cls[n] = LOG_INT;
+            r->arg[n++].i = va_arg(ap, int);
+        }
+        if (prec == -2)
+            // a "*" precision is the last star argument
+            prec = (int)r->arg[n - 1].i;
+
+        r->cls[n] = (uint8_t)cls;
+        switch (cls) {
+        case LOG_INT:
+            r->arg[n].i = va_arg(ap, int);
+            break;
+        case LOG_LONG:
+            r->arg[n].i = va_arg(ap, long);
+            break;
+        case LOG_LLONG:
+            r->arg[n].i = va_arg(ap, long long);
+            break;
+        case LOG_INTMAX:
+            r->arg[n].i = (long long)va_arg(ap, intmax_t);
+            break;
+        case LOG_SIZE:
+            r->arg[n].i = (long long)va_arg(ap, size_t);
+            break;
+        case LOG_PTRDIFF:
+            r->arg[n].i = (long long)va_arg(ap, ptrdiff_t);
+            break;
+        case LOG_DBL:
+            r->arg[n].d = va_arg(ap, double);
+            break;
+        case LOG_LDBL:
+            r->arg[n].ld = va_arg(ap, long double);
+            break;
+        case LOG_PTR:
+            r->arg[n].p = va_arg(ap, void *);
+            break;
+        case LOG_STRING:;
+            // the string may not outlive the call, so copy it
+            const char * s = va_arg(ap, const char *);
+            if (s == 0)
+                s = "(null)";
+            const size_t len = prec >= 0 ? strnlen(s, (size_t)prec) : strlen(s);
+            if (str + len >= LOG_STR)
+                return false;
+            memcpy(&r->str[str], s, len);
+            r->str[str + len] = 0;
+            r->arg[n].i = (long long)str;
+            str += len + 1;
+            break;
+        case LOG_BAD:
+            return false;
+        }
+        n++;
+    }
+    return true;
+}
+
+
+/// Queue a warn() message in the ring of the calling thread. If the format
+/// string has conversions log_capture() cannot handle, the message is
+/// formatted into the record right away instead.
+///
+static void __attribute__((nonnull, no_instrument_function,
+                           format(printf, 6, 0)))
+log_defer(const unsigned dlevel,
+          const bool tstamp,
+          const char * const func,
+          const char * const file,
+          const unsigned line,
+          const char * const fmt,
+          va_list ap)
+{
+    struct log_ring * g = log_tls;
+    if (unlikely(g == 0)) {
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        pthread_once(&once, log_key_init);
+        ensure((g = calloc(1, sizeof(*g))) != 0, "cannot alloc log ring");
+        pthread_setspecific(log_key, g);
+        pthread_mutex_lock(&log_lock);
+        g->next = log_rings;
+        log_rings = g;
+        pthread_mutex_unlock(&log_lock);
+        log_tls = g;
+    }
+
+    const uint32_t head = g->head;
+    if (unlikely(head - __atomic_load_n(&g->tail, __ATOMIC_ACQUIRE) ==
+                 LOG_RING)) {
+        __atomic_fetch_add(&g->lost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    struct log_rec * const r = &g->rec[head & (LOG_RING - 1)];
+#if defined(CLOCK_REALTIME_COARSE)
+    // the printed timestamps only have millisecond resolution
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    r->now = (struct timeval){now.tv_sec, (suseconds_t)(now.tv_nsec / 1000)};
+#else
+    gettimeofday(&r->now, 0);
+#endif
+    r->func = func;
+    r->file = file;
+    r->line = line;
+    r->dlevel = (uint8_t)dlevel;
+    r->tstamp = tstamp;
+#ifdef DTHREADED
+    r->master = pthread_self() == util_master;
+#endif
+
+    va_list aq;
+    va_copy(aq, ap);
+    r->fmt = log_capture(r, fmt, aq) ? fmt : 0;
+    va_end(aq);
+    if (r->fmt == 0)
+        vsnprintf(r->str, sizeof(r->str), fmt, ap);
+
+    __atomic_store_n(&g->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+
+/// Print one conversion of a deferred message.
+///
+/// @param[in]  r     The deferred message.
+/// @param[in]  spec  The conversion specification.
+/// @param[in]  n     Index of the first argument it consumes.
+/// @param[in]  star  Number of "*" arguments preceding the converted one.
+///
+static void __attribute__((nonnull, no_instrument_function))
+log_print_arg(const struct log_rec * const r,
+              const char * const spec,
+              const uint_t n,
+              const uint8_t star)
+{
+    const int w = star ? (int)r->arg[n].i : 0;
+    const int p = star > 1 ? (int)r->arg[n + 1].i : 0;
+    const uint_t a = n + star;
+
+#define log_print(v)                                                           \
+    do {                                                                       \
+        if (star == 0)                                                         \
+            fprintf(stderr, spec, (v));                                        \
+        else if (star == 1)                                                    \
+            fprintf(stderr, spec, w, (v));                                     \
+        else                                                                   \
+            fprintf(stderr, spec, w, p, (v));                                  \
+    } while (0)
+
+    switch (r->cls[a]) {
+    case LOG_INT:
+        log_print((int)r->arg[a].i);
+        break;
+    case LOG_LONG:
+        log_print((long)r->arg[a].i);
+        break;
+    case LOG_LLONG:
+        log_print(r->arg[a].i);
+        break;
+    case LOG_INTMAX:
+        log_print((intmax_t)r->arg[a].i);
+        break;
+    case LOG_SIZE:
+        log_print((size_t)r->arg[a].i);
+        break;
+    case LOG_PTRDIFF:
+        log_print((ptrdiff_t)r->arg[a].i);
+        break;
+    case LOG_DBL:
+        log_print(r->arg[a].d);
+        break;
+    case LOG_LDBL:
+        log_print(r->arg[a].ld);
+        break;
+    case LOG_PTR:
+        log_print(r->arg[a].p);
+        break;
+    case LOG_STRING:
+        log_print(&r->str[r->arg[a].i]);
+        break;
+    default:
+        break;
+    }
+#undef log_print
+}
+
+#pragma GCC diagnostic pop
+
+
+/// Format and print a deferred message. Must be called with DTHREAD_LOCK held.
+///
+/// @param[in]  r     The deferred message.
+///
+static void __attribute__((nonnull, no_instrument_function))
+log_print_rec(const struct log_rec * const r)
+{
+#ifdef DTHREADED
+    util_warn_prefix(r->dlevel, r->tstamp, &r->now, r->master ? BBLK : BWHT);
+#else
+    util_warn_prefix(r->dlevel, r->tstamp, &r->now, "");
+#endif
+    if (util_dlevel == DBG)
+        fprintf(stderr, MAG "%s" BLK " " BLU "%s:%u " NRM, r->func, r->file,
+                r->line);
+
+    if (r->fmt == 0) {
+        fputs(r->str, stderr);
+        fputc('\n', stderr);
+        return;
+    }
+
+    uint_t n = 0;
+    const char * f = r->fmt;
+    for (const char * c = strchr(f, '%'); c; c = strchr(f, '%')) {
+        fwrite(f, 1, (size_t)(c - f), stderr);
+        f = c + 1;
+        if (*f == '%') {
+            fputc('%', stderr);
+            f++;
+            continue;
+        }
+        uint8_t star;
+        int prec;
+        log_spec(&f, &star, &prec);
+        char spec[32];
+        const size_t len = MIN((size_t)(f - c), sizeof(spec) - 1);
+        memcpy(spec, c, len);
+        spec[len] = 0;
+        log_print_arg(r, spec, n, star);
+        n += star + 1U;
+    }
+    fputs(f, stderr);
+    fputc('\n', stderr);
+}
+
+
+/// Print all deferred messages.
+///
+/// @param[in]  wait  Whether to wait for a concurrent drain to finish, rather
+///                   than returning right away.
+///
+static void __attribute__((no_instrument_function)) log_drain(const bool wait)
+{
+    if (wait)
+        pthread_mutex_lock(&log_lock);
+    else if (pthread_mutex_trylock(&log_lock))
+        return;
+    DTHREAD_LOCK;
+
+    uint64_t lost = 0;
+    for (struct log_ring ** p = &log_rings; *p;) {
+        struct log_ring * const g = *p;
+        const bool dead = __atomic_load_n(&g->dead, __ATOMIC_ACQUIRE);
+        const uint32_t head = __atomic_load_n(&g->head, __ATOMIC_ACQUIRE);
+        for (uint32_t t = g->tail; t != head; t++)
+            log_print_rec(&g->rec[t & (LOG_RING - 1)]);
+        __atomic_store_n(&g->tail, head, __ATOMIC_RELEASE);
+        lost += __atomic_exchange_n(&g->lost, 0, __ATOMIC_RELAXED);
+
+        if (dead) {
+            // the thread has exited, so it will not log anything else
+            *p = g->next;
+            free(g);
+        } else
+            p = &g->next;
+    }
+    if (lost)
+        fprintf(stderr, DTIMESTAMP_GAP "  " YEL "%" PRIu64
+                        " deferred message%s lost" NRM "\n",
+                lost, plural(lost));
+    fflush(stderr);
+
+    DTHREAD_UNLOCK;
+    pthread_mutex_unlock(&log_lock);
+}
+
+
+static void * __attribute__((no_instrument_function))
+log_run(void * const arg __attribute__((unused)))
+{
+    uint64_t t;
+    while ((t = __atomic_load_n(&log_interval, __ATOMIC_ACQUIRE)) != 0) {
+        w_nanosleep(t);
+        log_drain(false);
+    }
+    return 0;
+}
+#endif
+
+
+/// Defer the formatting and output of warn() and rwarn() messages. Messages
+/// are instead copied, together with their raw arguments, into a lock-free
+/// ring of the calling thread, and formatted by util_log_drain(). Strings
+/// arguments are copied; messages with conversions that cannot be deferred
+/// are formatted when logged. When a ring is full, further messages of its
+/// thread are counted and dropped until the next drain.
+///
+/// @param[in]  interval  If non-zero, start a background thread that drains
+///                       the rings every @p interval nanoseconds. Otherwise,
+///                       the application must call util_log_drain().
+///
+void util_log_async(const uint64_t interval
+#if defined(PARTICLE) || defined(RIOT_VERSION)
+                    __attribute__((unused))
+#endif
+)
+{
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+    util_log_sync();
+    if (interval) {
+        log_interval = interval;
+        ensure(pthread_create(&log_thread, 0, log_run, 0) == 0,
+               "pthread_create");
+    }
+    __atomic_store_n(&log_async, true, __ATOMIC_RELEASE);
+#endif
+}
+
+
+/// Format and print all messages deferred since the last drain.
+///
+void util_log_drain(void)
+{
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+    log_drain(true);
+#endif
+}
+
+
+/// Stop deferring warn() and rwarn() messages, after draining the rings and
+/// stopping the background thread started by util_log_async().
+///
+void util_log_sync(void)
+{
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+    __atomic_store_n(&log_async, false, __ATOMIC_RELEASE);
+    if (log_interval) {
+        __atomic_store_n(&log_interval, 0, __ATOMIC_RELEASE);
+        pthread_join(log_thread, 0);
+    }
+    log_drain(true);
+#endif
+}
+
+
+static void
+    __attribute__((nonnull, no_instrument_function, format(printf, 6, 0)))
+    util_warn_valist(const unsigned dlevel,
+                     const bool tstamp,
+                     const char * const func,
+                     const char * const file,
+                     const unsigned line,
+                     const char * const fmt,
+                     va_list ap)
+{
+#if !defined(PARTICLE)
+#if !defined(RIOT_VERSION)
+    if (__atomic_load_n(&log_async, __ATOMIC_RELAXED)) {
+        log_defer(dlevel, tstamp, func, file, line, fmt, ap);
+        return;
+    }
+
+    DTHREAD_LOCK;
+    struct timeval now;
+    gettimeofday(&now, 0);
+    util_warn_prefix(dlevel, tstamp, &now, DTHREAD_ID);
 #endif
     if (util_dlevel == DBG) {
         fprintf(stderr, MAG "%s" BLK " " BLU "%s:%u " NRM, func, file, line);
@@ -373,6 +940,8 @@ void util_die(const char * const func,
     va_start(ap, fmt);
     const int e = errno;
 #if !defined(RIOT_VERSION)
+    // print any deferred messages first, unless we died while draining
+    log_drain(false);
     DTHREAD_LOCK;
     struct timeval now = {0, 0};
     struct timeval dur = {0, 0};
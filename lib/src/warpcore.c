@@ -51,9 +51,14 @@
 #endif
 
 #include "backend.h"
+#include "capture.h"
+#include "hist.h"
 #include "ifaddr.h"
+#include "impair.h"
 #include "ip6.h"
 #include "neighbor.h"
+#include "timer.h"
+#include "trace.h"
 
 
 #if !defined(PARTICLE) && !defined(RIOT_VERSION)
@@ -105,7 +110,7 @@ dump_bufs(const char * const label, const struct w_iov_sq * const q)
 struct w_iov * __attribute__((no_instrument_function))
 w_alloc_iov(struct w_engine * const w,
             const int af
-#if defined(NDEBUG) && !defined(WITH_NETMAP)
+#if defined(NDEBUG) && !defined(WITH_ETH)
             __attribute__((unused))
 #endif
             ,
@@ -300,6 +305,7 @@ struct w_sock * w_bind(struct w_engine * const w,
     s->ws_scope = w->ifaddr[addr_idx].scope_id;
     s->w = w;
     sq_init(&s->iv);
+    sq_init(&s->imp_iv);
 
     if (unlikely(backend_bind(s, opt) != 0)) {
         warn(ERR, "w_bind failed on %s:%u (%s)", w_ntop(&s->ws_laddr, ip_tmp),
@@ -325,6 +331,8 @@ fail:
 ///
 void w_close(struct w_sock * const s)
 {
+    if (unlikely(s->w->imp))
+        imp_close(s);
     backend_close(s);
 
     // free the socket
@@ -341,7 +349,12 @@ void w_close(struct w_sock * const s)
 void w_cleanup(struct w_engine * const w)
 {
     warn(NTE, "warpcore shutting down");
+    imp_cleanup(w);
     backend_cleanup(w);
+    timer_cleanup(w);
+    hist_cleanup(w);
+    trace_cleanup(w);
+    cap_cleanup(w);
 #if !defined(PARTICLE) && !defined(RIOT_VERSION)
     sl_remove(&engines, w, w_engine, next);
 #endif
@@ -350,6 +363,308 @@ void w_cleanup(struct w_engine * const w)
 }
 
 
+/// Set the maximum number of datagrams that engine @p w sends or receives per
+/// system call. The default is 64. Only the socket backend batches system
+/// calls in this way; it limits @p n to IOV_MAX, or to one on platforms
+/// without sendmmsg() and recvmmsg(). Other backends ignore this.
+///
+/// @param      w     Backend engine.
+/// @param[in]  n     Number of datagrams per batch.
+///
+void w_set_batch(struct w_engine * const w
+#if defined(WITH_ETH) || defined(WITH_URING) || defined(RIOT_VERSION)
+                 __attribute__((unused))
+#endif
+                 ,
+                 const uint32_t n
+#if defined(WITH_ETH) || defined(WITH_URING) || defined(RIOT_VERSION)
+                 __attribute__((unused))
+#endif
+)
+{
+#if !defined(WITH_ETH) && !defined(WITH_URING) && !defined(RIOT_VERSION)
+    backend_batch(w, n);
+#endif
+}
+
+
+/// Put engine @p w into busy-poll mode. w_nic_rx() then checks for new data
+/// without blocking for up to @p nsec, and only blocks once this spin budget
+/// is used up. Where the platform supports it, the kernel also busy-polls the
+/// NIC on behalf of the engine: the socket backend sets SO_BUSY_POLL and
+/// SO_PREFER_BUSY_POLL on sockets bound after this call, and epoll busy-poll
+/// parameters; the netmap backend syncs the RX rings without poll(). A budget
+/// of zero turns busy-polling off.
+///
+/// @param      w     Backend engine.
+/// @param[in]  nsec  Spin budget in nanoseconds.
+///
+void w_set_busy_poll(struct w_engine * const w, const uint64_t nsec)
+{
+    w->busy_poll = nsec;
+    backend_busy_poll(w);
+}
+
+
+/// Put engine @p w into adaptive-polling mode. After receiving data,
+/// w_nic_rx() then spins for about two smoothed inter-arrival times before
+/// blocking, so it catches the next packet of a busy flow without a wakeup.
+/// It blocks right away once the engine has been idle for that long, or when
+/// that window would exceed @p nsec, i.e., when arrivals are too sparse for
+/// spinning to pay off. A limit of zero turns adaptive polling off, and
+/// w_nic_rx() then spins for the budget set with w_set_busy_poll(), if any.
+///
+/// @param      w     Backend engine.
+/// @param[in]  nsec  Upper limit of the spin window in nanoseconds.
+///
+void w_set_adaptive_poll(struct w_engine * const w, const uint64_t nsec)
+{
+    w->spin_max = nsec;
+    w->rx_gap = w->rx_last = 0;
+}
+
+
+/// Start or stop a capture tap on engine @p w, which appends all received and
+/// transmitted Ethernet frames to a pcap file with nanosecond timestamps. The
+/// file is allocated at its full size up front and written through a shared
+/// mapping, so capturing a frame is a copy into memory; the kernel writes the
+/// data back in the background. Once the file is full, further frames are
+/// counted and dropped. Stopping the tap truncates the file to the captured
+/// frames. With no tap, the cost is one branch per frame, so a tap may be
+/// enabled on a running engine for a few seconds at a time.
+///
+/// Only the raw-Ethernet backends support capture taps; other engines have no
+/// Ethernet frames to capture.
+///
+/// @param      w     Backend engine.
+/// @param[in]  path  Capture file to (over)write, or zero to stop capturing.
+/// @param[in]  opt   Capture options, or zero for the defaults. The filter is
+///                   copied.
+///
+/// @return     Zero on success, @p errno otherwise. ENOTSUP if the backend
+///             does not support capture taps, EINVAL for invalid options or an
+///             invalid or unsupported filter program.
+///
+int w_set_capture(struct w_engine * const w
+#ifndef WITH_ETH
+                  __attribute__((unused))
+#endif
+                  ,
+                  const char * const path
+#ifndef WITH_ETH
+                  __attribute__((unused))
+#endif
+                  ,
+                  const struct w_capture_opt * const opt
+#ifndef WITH_ETH
+                  __attribute__((unused))
+#endif
+)
+{
+#ifdef WITH_ETH
+    cap_cleanup(w);
+    return path ? cap_open(&w->cap, path, opt) : 0;
+#else
+    return ENOTSUP;
+#endif
+}
+
+
+/// Start or stop replaying a pcap file into engine @p w. Each w_nic_rx() then
+/// hands the next frames of @p in to the stack as if they had been received,
+/// either as fast as possible or at their recorded pace, and every frame the
+/// engine transmits is appended to @p out. Once the input is exhausted,
+/// w_nic_rx() returns false without waiting. Any neighbor addresses seen in
+/// @p in are learned up front, so the engine can reply without ARP or ND.
+///
+/// Only the pcap replay backend supports this; it has no link of its own. Only
+/// classic pcap files with Ethernet frames are supported, not pcapng files.
+///
+/// @param      w     Backend engine.
+/// @param[in]  in    Input pcap file, or zero to stop replaying.
+/// @param[in]  out   Output pcap file for transmitted frames, or zero.
+/// @param[in]  opt   Replay options, or zero for the defaults.
+///
+/// @return     Zero on success, @p errno otherwise. ENOTSUP if the backend
+///             does not support replay, EINVAL if @p in is not a supported
+///             pcap file.
+///
+int w_replay(struct w_engine * const w
+#ifndef WITH_PCAP
+             __attribute__((unused))
+#endif
+             ,
+             const char * const in
+#ifndef WITH_PCAP
+             __attribute__((unused))
+#endif
+             ,
+             const char * const out
+#ifndef WITH_PCAP
+             __attribute__((unused))
+#endif
+             ,
+             const struct w_replay_opt * const opt
+#ifndef WITH_PCAP
+             __attribute__((unused))
+#endif
+)
+{
+#ifdef WITH_PCAP
+    return replay_open(w, in, out, opt);
+#else
+    return ENOTSUP;
+#endif
+}
+
+
+/// Take a snapshot of the packet and drop counters of engine @p w, or of
+/// w_sock @p s if it is non-zero. The counters are maintained on every packet
+/// and cannot be disabled; they only wrap around.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  s     A w_sock of @p w, or zero for the engine-wide counters.
+/// @param[out] st    Snapshot of the counters.
+///
+void w_get_stats(const struct w_engine * const w,
+                 const struct w_sock * const s,
+                 struct w_stats * const st)
+{
+    *st = s ? s->stats : w->stats;
+}
+
+
+/// Return how long the next w_nic_rx() should spin in adaptive-polling mode.
+///
+/// @param[in]  w     Backend engine.
+///
+/// @return     Spin budget in nanoseconds.
+///
+static uint64_t __attribute__((nonnull))
+spin_window(const struct w_engine * const w)
+{
+    const uint64_t win = 2 * w->rx_gap;
+    if (w->rx_gap == 0 || win > w->spin_max)
+        return 0;
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    return w->rx_last + win > now ? w->rx_last + win - now : 0;
+}
+
+
+/// Check/wait until any data has been received, or until the next timer armed
+/// with w_timer_add() expires. Calls the callbacks of expired timers after
+/// processing received data.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
+///                   for infinite wait.
+///
+/// @return     Whether any data is ready for reading.
+///
+bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
+{
+    w->spin = w->spin_max ? spin_window(w) : w->busy_poll;
+    int64_t wait = w->timers ? timer_wait(w, nsec) : nsec;
+    if (unlikely(w->imp))
+        wait = imp_wait(w, wait);
+    bool rx = backend_nic_rx(w, wait);
+
+    if (w->spin_max && rx) {
+        const uint64_t now = w_now(CLOCK_MONOTONIC);
+        if (w->rx_last)
+            // EWMA with a gain of 1/8, like the RTT estimator of RFC6298
+            w->rx_gap = w->rx_gap ? (7 * w->rx_gap + now - w->rx_last) / 8
+                                  : now - w->rx_last;
+        w->rx_last = now;
+    }
+
+    if (unlikely(w->imp))
+        rx = imp_nic_rx(w, rx);
+    if (w->timers)
+        timer_run(w);
+    return rx;
+}
+
+
+/// Return any new data that has been received on a socket by appending it to
+/// the w_iov tail queue @p i. The tail queue must eventually be returned to
+/// warpcore via w_free(). Records the RX latency of the returned w_iovs, if
+/// enabled with w_set_latency_hist().
+///
+/// @param      s     w_sock for which the application would like to receive
+///                   new data.
+/// @param      i     w_iov tail queue to append new data to.
+///
+void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
+{
+    struct w_engine * const w = s->w;
+    if (likely(w->hist == 0 && w->imp == 0)) {
+        backend_rx(s, i);
+        return;
+    }
+
+    struct w_iov * v = sq_last(i, w_iov, next);
+    if (unlikely(w->imp))
+        imp_rx(s, i);
+    else
+        backend_rx(s, i);
+    if (likely(w->hist == 0))
+        return;
+    v = v ? sq_next(v, next) : sq_first(i);
+    const uint64_t now = w_now(CLOCK_REALTIME);
+    for (; v; v = sq_next(v, next))
+        hist_add(w, W_HIST_RX, v->ts, now);
+}
+
+
+/// Send the w_iovs in the w_iov_sq @p o over w_sock @p s. Depending on the
+/// backend, they may not leave before the next w_nic_tx(), see backend_tx().
+/// If a TX impairment is set with w_set_impair(), they pass through it first.
+///
+/// @param      s     w_sock socket to transmit over.
+/// @param      o     w_iov_sq to send.
+///
+void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
+{
+    if (unlikely(s->w->imp && s->w->imp->dir[W_IMPAIR_TX].on))
+        imp_tx(s, o);
+    else
+        backend_tx(s, o);
+}
+
+
+/// Push out the data that w_tx() has queued on engine @p w, and process TX
+/// completions, see backend_nic_tx(). Also sends the datagrams that a TX
+/// impairment has released.
+///
+/// @param      w     Backend engine.
+///
+void w_nic_tx(struct w_engine * const w)
+{
+    if (unlikely(w->imp))
+        imp_nic_tx(w);
+    else
+        backend_nic_tx(w);
+}
+
+
+/// Fill a w_sock_slist with pointers to some sockets with pending inbound
+/// data. Data can be obtained via w_rx() on each w_sock in the list. Will
+/// return the number of ready connections, or zero if none are ready. When the
+/// return value is not zero, a repeated call may return additional ready
+/// sockets.
+///
+/// @param[in]  w     Backend engine.
+/// @param      sl    Empty and initialized w_sock_slist.
+///
+/// @return     Number of connections that are ready for reading.
+///
+uint32_t w_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
+{
+    return unlikely(w->imp) ? imp_rx_ready(w, sl) : backend_rx_ready(w, sl);
+}
+
+
 uint8_t contig_mask_len(const int af, const uint8_t * const mask)
 {
     uint8_t mask_len = 0;
@@ -409,7 +724,9 @@ struct w_engine * w_init(const char * const ifname,
                          const uint32_t rip __attribute__((unused)),
                          const uint_t nbufs)
 {
-#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+#ifdef WITH_ETH
+    // the socket-based backends can shard a port via
+    // w_sockopt::enable_reuseport
     struct w_engine * e;
     sl_foreach (e, &engines, next)
         if (strncmp(ifname, e->ifname, IFNAMSIZ) == 0 &&
@@ -498,6 +815,25 @@ void w_free(struct w_iov_sq * const q)
     if (unlikely(sq_empty(q)))
         return;
     struct w_engine * const w = sq_first(q)->w;
+#if defined(HAVE_ZEROCOPY) || defined(WITH_URING) || defined(WITH_ETH)
+#ifdef HAVE_ZEROCOPY
+    const uint32_t held = w->b->zc_cnt;
+#elif defined(WITH_URING)
+    const uint32_t held = w->b->sq_entries - w->b->tx_nfree;
+#else
+    const uint32_t held = w->b->edt_cnt;
+#endif
+    if (unlikely(held)) {
+        // some w_iovs may still be in flight, so check them one by one
+        while (!sq_empty(q)) {
+            struct w_iov * const v = sq_first(q);
+            sq_remove_head(q, next);
+            sq_next(v, next) = 0;
+            w_free_iov(v);
+        }
+        return;
+    }
+#endif
 #ifndef NDEBUG
     struct w_iov * v;
     sq_foreach (v, q, next) {
@@ -525,6 +861,19 @@ void __attribute__((no_instrument_function)) w_free_iov(struct w_iov * const v)
     assure(sq_next(v, next) == 0,
            "idx %" PRIu32 " still linked to idx %" PRIu32, v->idx,
            sq_next(v, next)->idx);
+#ifdef HAVE_ZEROCOPY
+    if (unlikely(zc_hold(v)))
+        // w_nic_tx() returns it to the free pool once the kernel releases it
+        return;
+#elif defined(WITH_URING)
+    if (unlikely(tx_hold(v)))
+        // w_nic_tx() or w_nic_rx() return it to the free pool once it was sent
+        return;
+#elif defined(WITH_ETH)
+    if (unlikely(edt_hold(v)))
+        // w_nic_tx() returns it to the free pool once it has been sent
+        return;
+#endif
     dump_bufs(__func__, &v->w->iov);
     sq_insert_head(&v->w->iov, v, next);
     ASAN_POISON_MEMORY_REGION(v->base, max_buf_len(v->w));
@@ -532,6 +881,36 @@ void __attribute__((no_instrument_function)) w_free_iov(struct w_iov * const v)
 }
 
 
+/// Return whether warpcore or the kernel may still read from the buffer of
+/// w_iov @p v, because a zero-copy transmit of it is in flight (see
+/// w_sockopt::enable_zerocopy), or because a raw-Ethernet backend is holding it
+/// until its w_iov::txtime (see w_sockopt::enable_txtime), or because the
+/// io_uring backend has not reaped the completion of its send yet. The
+/// application must not modify such a w_iov. w_nic_tx() processes the kernel's
+/// notifications that release w_iovs, and transmits held w_iovs that are due.
+///
+/// @param[in]  v     A w_iov.
+///
+/// @return     True if @p v is still in use, false otherwise.
+///
+bool w_tx_pending(const struct w_iov * const v
+#if !defined(HAVE_ZEROCOPY) && !defined(WITH_URING) && !defined(WITH_ETH)
+                  __attribute__((unused))
+#endif
+)
+{
+#ifdef HAVE_ZEROCOPY
+    return v->w->b->zc_ref[w_iov_idx(v)] != 0;
+#elif defined(WITH_URING)
+    return v->w->b->tx_ref[w_iov_idx(v)] != 0;
+#elif defined(WITH_ETH)
+    return v->w->b->edt_st[w_iov_idx(v)] != 0;
+#else
+    return false;
+#endif
+}
+
+
 /// Calculate a uniformly distributed random number in [0, upper_bound)
 /// avoiding "modulo bias".
 ///
@@ -597,6 +976,7 @@ reinit_iov(struct w_iov * const v)
     v->buf = v->base;
     v->len = max_buf_len(v->w);
     v->flags = v->ttl = 0;
+    v->txtime = 0;
     sq_next(v, next) = 0;
 }
 
@@ -636,7 +1016,7 @@ khint_t
            fnv1a_32(&tup->local.port, sizeof(tup->local.port)) +
            (tup->remote.addr.af
                 ? (w_addr_hash(&tup->remote.addr) +
-                   fnv1a_32(&tup->local.port, sizeof(tup->local.port)))
+                   fnv1a_32(&tup->remote.port, sizeof(tup->remote.port)))
                 : 0);
 }
 
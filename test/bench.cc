@@ -34,9 +34,16 @@ extern "C" {
 }
 
 
-static void BM_io(benchmark::State & state)
+static void BM_io(benchmark::State & state, const bool gso)
 {
     const auto len = static_cast<uint32_t>(state.range(0));
+    auto opt = s_clnt->opt;
+    opt.disable_udp_gso = !gso;
+    w_set_sockopt(s_clnt, &opt);
+    if (gso && s_clnt->opt.disable_udp_gso) {
+        state.SkipWithError("no UDP GSO support");
+        return;
+    }
     for (auto _ : state)
         if (!io(len)) {
             state.SkipWithError("ran out of bufs or saw packet loss");
@@ -80,7 +87,10 @@ static void BM_io(benchmark::State & state)
 // }
 
 
-BENCHMARK(BM_io)->RangeMultiplier(2)->Range(1, 512);
+BENCHMARK_CAPTURE(BM_io, plain, false)->RangeMultiplier(2)->Range(1, 512);
+#ifndef WITH_ETH
+BENCHMARK_CAPTURE(BM_io, gso, true)->RangeMultiplier(2)->Range(1, 512);
+#endif
 // BENCHMARK(BM_ip_cksum)->RangeMultiplier(2)->Range(64, 2048);
 // BENCHMARK(BM_arc4random);
 // BENCHMARK(BM_random);
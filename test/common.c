@@ -31,11 +31,22 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <time.h>
+
+#if defined(WITH_XDP) || defined(WITH_PACKET)
+#define WITH_VETH
+#include <stdlib.h>
+#endif
 
 #include <warpcore/warpcore.h>
 
 #include "common.h"
 
+#ifdef WITH_VETH
+#include "backend.h"
+#include "neighbor.h"
+#endif
+
 struct w_engine *w_serv, *w_clnt;
 struct w_sock *s_serv, *s_clnt;
 
@@ -65,6 +76,7 @@ bool io(const uint_t len)
     const uint_t olen = w_iov_sq_len(&o);
 
     // tx
+    const uint64_t before = w_now(CLOCK_REALTIME);
     w_tx(s_clnt, &o);
     w_nic_tx(w_clnt);
     ensure(olen == w_iov_sq_len(&o), "same length");
@@ -75,19 +87,26 @@ bool io(const uint_t len)
     bool again = true;
     while (ilen < olen) {
         w_rx(s_serv, &i);
+        const uint_t prev_ilen = ilen;
         ilen = w_iov_sq_len(&i);
         if (ilen < olen) {
-            if (again) {
+            // backends may deliver a burst in several parts, so keep going
+            // while there is progress
+            if (again || ilen > prev_ilen) {
                 w_nic_rx(w_serv, 100 * NS_PER_MS);
                 again = false;
-            } else
+            } else {
+                w_free(&o);
+                w_free(&i);
                 return false;
+            }
         }
     }
     ensure(w_iov_sq_cnt(&i) == w_iov_sq_cnt(&o),
            "icnt %" PRIu " != ocnt %" PRIu "", w_iov_sq_cnt(&i),
            w_iov_sq_cnt(&o));
     ensure(ilen == olen, "ilen %" PRIu " != olen %" PRIu, ilen, olen);
+    const uint64_t after = w_now(CLOCK_REALTIME);
 
     // validate data (o was sent by client, i is received by server)
     struct w_iov * iv = sq_first(&i);
@@ -100,11 +119,18 @@ bool io(const uint_t len)
                ov->buf[0], ov->len, iv->idx, iv->buf[0], iv->len);
         ensure(ov->flags == iv->flags, "TOS byte 0x%02x != 0x%02x", ov->flags,
                iv->flags);
+        ensure(iv->ts >= before && iv->ts <= after,
+               "RX ts %" PRIu64 " not in [%" PRIu64 ", %" PRIu64 "]", iv->ts,
+               before, after);
+        if (s_clnt->opt.enable_timestamps)
+            ensure(ov->ts >= before && ov->ts <= after,
+                   "TX ts %" PRIu64 " not in [%" PRIu64 ", %" PRIu64 "]",
+                   ov->ts, before, after);
         // warn(ERR, "TOS byte ov 0x%02x, iv 0x%02x", ov->flags, iv->flags);
         ensure(iv->saddr.port == s_clnt->ws_lport,
                "port mismatch, in %u != out %u", bswap16(iv->saddr.port),
                bswap16(s_clnt->ws_lport));
-#ifndef WITH_NETMAP
+#ifndef WITH_ETH
         ensure(ip6_eql(iv->wv_ip6, ov->wv_ip6), "IP mismatch");
 #endif
 
@@ -120,8 +146,109 @@ bool io(const uint_t len)
 }
 
 
+// the first call finds how many w_iovs a burst may have before the receive
+// side overflows; every later call must handle those bursts again
+void test_io(void)
+{
+    static uint32_t max_len;
+    const bool first = max_len == 0;
+    for (uint32_t i = 1; i <= 512; i <<= 1) {
+        if (io(i) == false) {
+            ensure(first ? i > 1 : i > max_len, "test len %u failed", i);
+            warn(INF, "test len %u failed", i);
+            break;
+        }
+        warn(INF, "test len %u ok", i);
+        if (first)
+            max_len = i;
+    }
+}
+
+
+// send n datagrams of len bytes from the client, and free them right away
+void send_n(const uint_t n, const uint16_t len)
+{
+    struct w_iov_sq o = w_iov_sq_initializer(o);
+    w_alloc_cnt(w_clnt, s_clnt->ws_af, &o, n, len, 0);
+    ensure(w_iov_sq_cnt(&o) == n, "got w_iovs");
+    w_tx(s_clnt, &o);
+    w_nic_tx(w_clnt);
+    w_free(&o);
+}
+
+
+// receive until the server has n datagrams, or for at most nsec; return the
+// time it took
+uint64_t recv_n(const uint_t n, const uint64_t nsec, uint_t * const got)
+{
+    const uint64_t t = w_now(CLOCK_MONOTONIC);
+    struct w_iov_sq i = w_iov_sq_initializer(i);
+    while (w_iov_sq_cnt(&i) < n && w_now(CLOCK_MONOTONIC) - t < nsec) {
+        w_nic_tx(w_clnt);
+        w_nic_rx(w_serv, NS_PER_MS);
+        struct w_sock_slist sl = w_sock_slist_initializer(sl);
+        if (w_rx_ready(w_serv, &sl))
+            w_rx(s_serv, &i);
+    }
+    *got = w_iov_sq_cnt(&i);
+    w_free(&i);
+    return w_now(CLOCK_MONOTONIC) - t;
+}
+
+
+#ifdef WITH_VETH
+// the raw-Ethernet backends run over the two ends of a veth pair, since on lo
+// each engine would also see (and answer) the traffic meant for the other
+#ifdef WITH_XDP
+#define VETH "wxdp"
+#else
+#define VETH "wpkt"
+#endif
+#define VETH_SERV VETH "0"
+#define VETH_CLNT VETH "1"
+
+static void init_veth(const uint_t len)
+{
+    // keep the kernel from sending its own IPv6 traffic over the veth pair
+    if (system("ip link del " VETH_SERV " 2>/dev/null; "
+               "ip link add " VETH_SERV " type veth peer name " VETH_CLNT " && "
+               "sysctl -qw net.ipv6.conf." VETH_SERV ".disable_ipv6=1 && "
+               "sysctl -qw net.ipv6.conf." VETH_CLNT ".disable_ipv6=1 && "
+               "ip addr add 10.11.12.1/24 dev " VETH_SERV " && "
+               "ip addr add 10.11.12.2/24 dev " VETH_CLNT " && "
+               "ip link set " VETH_SERV " up && ip link set " VETH_CLNT
+               " up") != 0) {
+        warn(WRN, "cannot create veth pair, skipping");
+        exit(77);
+    }
+
+    w_serv = w_init(VETH_SERV, 0, len);
+    w_clnt = w_init(VETH_CLNT, 0, len);
+
+    // both ends are owned by warpcore, so preload the ARP caches
+    neighbor_update(w_serv, &w_clnt->ifaddr[w_clnt->addr4_pos].addr,
+                    w_clnt->mac);
+    neighbor_update(w_clnt, &w_serv->ifaddr[w_serv->addr4_pos].addr,
+                    w_serv->mac);
+
+    const struct w_sockopt opt = {.enable_ecn = true};
+    s_serv = w_bind(w_serv, w_serv->addr4_pos, bswap16(55555), &opt);
+    s_clnt = w_bind(w_clnt, w_clnt->addr4_pos, 0, &opt);
+    w_connect(s_clnt, (struct sockaddr *)&(struct sockaddr_in){
+                          .sin_family = AF_INET,
+                          .sin_addr = {w_serv->ifaddr[w_serv->addr4_pos]
+                                           .addr.ip4},
+                          .sin_port = bswap16(55555)});
+    ensure(w_connected(s_clnt), "not connected");
+}
+#endif
+
+
 void init(const uint_t len)
 {
+#ifdef WITH_VETH
+    init_veth(len);
+#else
     char i[IFNAMSIZ] = "lo"
 #ifndef __linux__
                        "0"
@@ -149,6 +276,7 @@ void init(const uint_t len)
     //                       .sin_addr = {bswap32(INADDR_LOOPBACK)},
     //                       .sin_port = bswap16(55555)});
     ensure(w_connected(s_clnt), "not connected");
+#endif
 }
 
 
@@ -159,4 +287,7 @@ void cleanup(void)
     w_close(s_serv);
     w_cleanup(w_clnt);
     w_cleanup(w_serv);
+#ifdef WITH_VETH
+    ensure(system("ip link del " VETH_SERV) == 0, "cannot delete veth pair");
+#endif
 }
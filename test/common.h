@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <warpcore/warpcore.h>
 
@@ -39,6 +40,9 @@ extern struct w_engine *w_serv, *w_clnt;
 extern struct w_sock *s_serv, *s_clnt;
 
 extern bool io(const uint_t len);
+extern void test_io(void);
+extern void send_n(const uint_t n, const uint16_t len);
+extern uint64_t recv_n(const uint_t n, const uint64_t nsec, uint_t * const got);
 extern void init(const uint_t len);
 extern void cleanup(void);
 
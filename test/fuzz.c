@@ -102,12 +102,11 @@ int LLVMFuzzerTestOneInput(const uint8_t * data, const size_t size)
     struct netmap_ring * const r = NETMAP_TXRING(iface, 0);
     r->cur = r->head = 1;
     r->tail = 0;
-    struct netmap_slot * const s = &r->slot[r->cur];
+    struct w_slot s = {.buf_idx = r->slot[r->cur].buf_idx,
+                       .len = (uint16_t)MIN(size, r->nr_buf_size)};
     uint8_t * const buf = (uint8_t *)NETMAP_BUF(r, r->cur);
+    memcpy(buf, data, s.len);
 
-    s->len = (uint16_t)MIN(size, r->nr_buf_size);
-    memcpy(buf, data, s->len);
-
-    eth_rx(&w, s, buf);
+    eth_rx(&w, &s, buf);
     return 0;
 }
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+
+    // repeat with small batches, so each w_tx() and w_rx() needs several calls
+    w_set_batch(w_clnt, 3);
+    w_set_batch(w_serv, 3);
+    test_io();
+
+    // repeat with large batches, so one w_tx() holds more w_iovs than the
+    // kernel accepts in one UDP GSO super-buffer
+    w_set_batch(w_clnt, 512);
+    w_set_batch(w_serv, 512);
+    test_io();
+    const bool gso = s_clnt->opt.disable_udp_gso == false;
+    uint_t got;
+    send_n(200, 64);
+    recv_n(200, NS_PER_S, &got);
+    ensure(got == 200, "received %" PRIu " of 200", got);
+    ensure(s_clnt->opt.disable_udp_gso == !gso, "UDP GSO still enabled");
+    cleanup();
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+// check that a capture tap writes the filtered test traffic into a pcap file
+static void test_capture(void)
+{
+    // each backend runs this test, possibly at the same time
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_capture.%d.pcap", getpid());
+#ifdef WITH_ETH
+    // "tcpdump -dd ip or ip6", capturing only the first 96 bytes
+    static const struct w_bpf_insn filter[] = {
+        {0x28, 0, 0, 12},     // ldh [12]
+        {0x15, 1, 0, 0x0800}, // jeq #0x800, accept
+        {0x15, 0, 1, 0x86dd}, // jeq #0x86dd, accept, reject
+        {0x06, 0, 0, 96},     // accept: ret #96
+        {0x06, 0, 0, 0},      // reject: ret #0
+    };
+    static const struct w_bpf_insn bad[] = {{0x05, 0, 0, 1}};
+    ensure(w_set_capture(w_serv, path,
+                         &(struct w_capture_opt){.filter = bad,
+                                                 .filter_len = 1}) == EINVAL,
+           "invalid filter");
+    ensure(w_set_capture(w_serv, path,
+                         &(struct w_capture_opt){.filter = filter,
+                                                 .filter_len = 5}) == 0,
+           "capturing");
+    test_io();
+    ensure(w_set_capture(w_serv, 0, 0) == 0, "stopped");
+
+    FILE * const f = fopen(path, "rb");
+    ensure(f, "fopen");
+    uint32_t h[6];
+    ensure(fread(h, sizeof(h), 1, f) == 1 && h[0] == 0xa1b23c4d, "pcap");
+    uint_t n = 0;
+    uint32_t r[4];
+    while (fread(r, sizeof(r), 1, f) == 1) {
+        ensure(r[2] <= 96 && r[2] <= r[3], "snap length");
+        ensure(fseek(f, r[2], SEEK_CUR) == 0, "fseek");
+        n++;
+    }
+    fclose(f);
+    unlink(path);
+    ensure(n, "frames captured");
+#else
+    ensure(w_set_capture(w_serv, path, 0) == ENOTSUP, "not supported");
+#endif
+}
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+    test_capture();
+    cleanup();
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <warpcore/warpcore.h>
+
+#include "flow.h"
+
+
+#define N 50000 ///< Number of connected w_socks, like "ping -c 50000".
+#define W 64    ///< Number of bound-only w_socks.
+
+
+static struct w_sockaddr sa(const uint32_t ip, const uint16_t port)
+{
+    return (struct w_sockaddr){
+        .addr = {.af = AF_INET, .ip4 = bswap32(ip)}, .port = bswap16(port)};
+}
+
+
+int main(void)
+{
+    struct flow_tab ft = {0};
+    struct w_sock * const s = calloc(N + W, sizeof(*s));
+    ensure(s, "calloc");
+
+    // connections from many local ports to one peer, and some bound ports
+    for (uint_t i = 0; i < N; i++) {
+        s[i].tup.local = sa(0x0a000001, (uint16_t)(1024 + i));
+        s[i].tup.remote = sa(0x0a000002, 4433);
+        ensure(flow_put(&ft, &s[i]), "inserted connected");
+    }
+    for (uint_t i = N; i < N + W; i++) {
+        s[i].tup.local = sa(0x0a000001, (uint16_t)(1024 + i - N));
+        ensure(flow_put(&ft, &s[i]), "inserted bound");
+    }
+    ensure(flow_put(&ft, &s[0]) == false, "duplicate rejected");
+    ensure(ft.cnt == N + W && ft.conn == N, "counted");
+
+    // connected w_socks take precedence over bound-only ones
+    for (uint_t i = 0; i < N; i++) {
+        const struct w_sockaddr l = sa(0x0a000001, (uint16_t)(1024 + i));
+        const struct w_sockaddr r = sa(0x0a000002, 4433);
+        ensure(flow_demux(&ft, &l, &r) == &s[i], "demuxed connected");
+        ensure(flow_get(&ft, &l, &r) == &s[i], "found connected");
+    }
+    const struct w_sockaddr l = sa(0x0a000001, 1024);
+    const struct w_sockaddr other = sa(0x0a000003, 4433);
+    ensure(flow_demux(&ft, &l, &other) == &s[N], "demuxed bound");
+    ensure(flow_get(&ft, &l, 0) == &s[N], "found bound");
+    const struct w_sockaddr none = sa(0x0a000001, (uint16_t)(1024 + N));
+    ensure(flow_demux(&ft, &none, &other) == 0, "no w_sock");
+
+    // remove every other connected w_sock, and reinsert some, which reuses
+    // the removed slots
+    for (uint_t i = 0; i < N; i += 2)
+        ensure(flow_del(&ft, &s[i]), "removed");
+    ensure(flow_del(&ft, &s[0]) == false, "removed twice");
+    for (uint_t i = 0; i < N; i++) {
+        const struct w_sockaddr r = sa(0x0a000002, 4433);
+        ensure(flow_get(&ft, &s[i].tup.local, &r) == (i % 2 ? &s[i] : 0),
+               "found remaining");
+    }
+    for (uint_t i = 0; i < N / 2; i += 2)
+        ensure(flow_put(&ft, &s[i]), "reinserted");
+
+    // iteration visits each w_sock once, also while removing them
+    uint_t n = 0;
+    struct w_sock * v;
+    flow_foreach (v, &ft) {
+        ensure(flow_del(&ft, v), "removed while iterating");
+        n++;
+    }
+    ensure(n == N / 2 + N / 4 + W && ft.cnt == 0 && ft.conn == 0, "iterated");
+    flow_free(&ft);
+    free(s);
+}
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+
+    // repeat with UDP GRO enabled on the server
+    w_set_sockopt(s_serv, &(struct w_sockopt){.enable_ecn = true,
+                                              .enable_udp_gro = true});
+    test_io();
+
+    // back-to-back datagrams of one size are coalesced, and must come out of
+    // w_rx() as the original datagrams
+    struct w_stats st;
+    w_get_stats(w_serv, s_serv, &st);
+    const uint64_t gro_pkts = st.rx_gro_pkts;
+    struct w_iov_sq o = w_iov_sq_initializer(o);
+    w_alloc_cnt(w_clnt, s_clnt->ws_af, &o, 32, 1000, 0);
+    ensure(w_iov_sq_cnt(&o) == 32, "got w_iovs");
+    w_tx(s_clnt, &o);
+    w_nic_tx(w_clnt);
+    w_free(&o);
+
+    struct w_iov_sq i = w_iov_sq_initializer(i);
+    for (uint_t n = 0; w_iov_sq_cnt(&i) < 32 && n < 1000; n++) {
+        w_nic_rx(w_serv, NS_PER_MS);
+        w_rx(s_serv, &i);
+    }
+    ensure(w_iov_sq_cnt(&i) == 32, "received %" PRIu " of 32",
+           w_iov_sq_cnt(&i));
+    const struct w_iov * v;
+    sq_foreach (v, &i, next)
+        ensure(v->len == 1000, "length %u", v->len);
+    w_free(&i);
+    w_get_stats(w_serv, s_serv, &st);
+    ensure(st.rx_gro_pkts > gro_pkts, "GRO super-datagrams split");
+    cleanup();
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+static uint64_t hist_cnt(const struct w_hist * const h)
+{
+    uint64_t n = 0;
+    for (uint_t i = 0; i < W_HIST_BUCKETS; i++)
+        n += h->cnt[i];
+    return n;
+}
+
+
+// check that the latency histograms record the test traffic
+static void test_hist(void)
+{
+    struct w_hist h = {.cnt = {[5] = 1, [100] = 1}};
+    ensure(w_hist_quantile(&h, 500000) == 5, "median");
+    ensure(w_hist_quantile(&h, 1000000) == 671, "max of bucket 100");
+
+    w_set_latency_hist(w_serv, true);
+    w_set_latency_hist(w_clnt, true);
+    struct w_stats before;
+    struct w_stats after;
+    w_get_stats(w_serv, s_serv, &before);
+    test_io();
+    w_get_stats(w_serv, s_serv, &after);
+    w_get_latency_hist(w_serv, W_HIST_RX, &h);
+    ensure(hist_cnt(&h) == after.rx_pkts - before.rx_pkts,
+           "RX latency recorded");
+    ensure(w_hist_quantile(&h, 500000) <= w_hist_quantile(&h, 990000),
+           "quantiles ordered");
+    w_get_latency_hist(w_clnt, W_HIST_TX, &h);
+    ensure(hist_cnt(&h), "TX latency recorded");
+    w_set_latency_hist(w_serv, false);
+    w_set_latency_hist(w_clnt, false);
+    w_get_latency_hist(w_serv, W_HIST_RX, &h);
+    ensure(hist_cnt(&h) == 0, "disabled");
+}
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+    test_hist();
+    cleanup();
+}
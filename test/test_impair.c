@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+// check that impairments lose, duplicate, delay and rate-limit datagrams
+static void test_impair(void)
+{
+    ensure(w_set_impair(w_clnt, W_IMPAIR_TX,
+                        &(struct w_impair_opt){.loss = 1000001}) == EINVAL,
+           "invalid probability");
+
+    // measure from before send_n(), which already spends part of the delay
+    uint_t got;
+    w_set_impair(w_clnt, W_IMPAIR_TX,
+                 &(struct w_impair_opt){.delay = 20 * NS_PER_MS});
+    uint64_t t = w_now(CLOCK_MONOTONIC);
+    send_n(10, 64);
+    recv_n(10, NS_PER_S, &got);
+    ensure(w_now(CLOCK_MONOTONIC) - t >= 19 * NS_PER_MS && got == 10,
+           "TX delay");
+
+    // 8 Mb/s lets 20 datagrams of 1000 bytes pass in 20 ms
+    w_set_impair(w_clnt, W_IMPAIR_TX,
+                 &(struct w_impair_opt){.rate = 8000000});
+    t = w_now(CLOCK_MONOTONIC);
+    send_n(20, 1000);
+    recv_n(20, NS_PER_S, &got);
+    ensure(w_now(CLOCK_MONOTONIC) - t >= 19 * NS_PER_MS && got == 20,
+           "TX rate");
+
+    w_set_impair(w_clnt, W_IMPAIR_TX,
+                 &(struct w_impair_opt){.dup = 1000000});
+    send_n(5, 64);
+    recv_n(10, NS_PER_S, &got);
+    ensure(got == 10, "TX duplication");
+    w_set_impair(w_clnt, W_IMPAIR_TX, 0);
+
+    w_set_impair(w_serv, W_IMPAIR_RX,
+                 &(struct w_impair_opt){.delay = 10 * NS_PER_MS});
+    t = w_now(CLOCK_MONOTONIC);
+    send_n(10, 64);
+    recv_n(10, NS_PER_S, &got);
+    ensure(w_now(CLOCK_MONOTONIC) - t >= 9 * NS_PER_MS && got == 10,
+           "RX delay");
+
+    struct w_stats st;
+    w_get_stats(w_serv, s_serv, &st);
+    const uint64_t drops = st.drop[W_DROP_IMPAIRED];
+    w_set_impair(w_serv, W_IMPAIR_RX,
+                 &(struct w_impair_opt){.loss = 1000000});
+    send_n(10, 64);
+    recv_n(10, 50 * NS_PER_MS, &got);
+    w_get_stats(w_serv, s_serv, &st);
+    ensure(got == 0 && st.drop[W_DROP_IMPAIRED] == drops + 10, "RX loss");
+    w_set_impair(w_serv, W_IMPAIR_RX, 0);
+    test_io();
+}
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+    test_impair();
+    cleanup();
+}
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+#define ROUNDS 100
+
+
+static int cmp_u64(const void * const a, const void * const b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+// measure how late w_nic_rx() wakes up from a sub-millisecond timeout
+static void test_jitter(const int64_t nsec)
+{
+    uint64_t late[ROUNDS];
+    uint_t n = 0;
+    for (uint_t i = 0; i < ROUNDS; i++) {
+        const uint64_t t = w_now(CLOCK_MONOTONIC);
+        if (w_nic_rx(w_serv, nsec))
+            // stray data, ignore this round
+            continue;
+        const uint64_t d = w_now(CLOCK_MONOTONIC) - t;
+        ensure(d >= (uint64_t)nsec, "woke up %" PRIu64 " ns early",
+               (uint64_t)nsec - d);
+        late[n++] = d - (uint64_t)nsec;
+    }
+    ensure(n, "got samples");
+
+    qsort(late, n, sizeof(late[0]), cmp_u64);
+    warn(NTE,
+         "timeout %" PRId64 " ns: late min %" PRIu64 " med %" PRIu64
+         " p99 %" PRIu64 " max %" PRIu64 " ns",
+         nsec, late[0], late[n / 2], late[n * 99 / 100], late[n - 1]);
+    ensure(late[n / 2] < NS_PER_MS, "median wakeup %" PRIu64 " ns late",
+           late[n / 2]);
+}
+
+
+int main(void)
+{
+    init(1024);
+    test_jitter(50 * NS_PER_US);
+    test_jitter(250 * NS_PER_US);
+    test_jitter(1500 * NS_PER_US);
+    cleanup();
+}
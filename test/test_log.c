@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+
+#define FLOOD 2000
+
+
+// log a line directly, so this test also works when warn() is compiled out
+#define tlog(...)                                                              \
+    util_warn(NTE, false, __func__, __FILENAME__, __LINE__, __VA_ARGS__)
+
+
+static void * logger(void * const arg __attribute__((unused)))
+{
+    tlog("thread %s", "done");
+    return 0;
+}
+
+
+static char * slurp(FILE * const f)
+{
+    static char buf[512 * 1024];
+    rewind(f);
+    const size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[len] = 0;
+    return buf;
+}
+
+
+static uint_t count(const char * s, const char * const needle)
+{
+    uint_t n = 0;
+    while ((s = strstr(s, needle)) != 0) {
+        n++;
+        s++;
+    }
+    return n;
+}
+
+
+int main(void)
+{
+    // capture stderr in a temporary file
+    FILE * const f = tmpfile();
+    ensure(f, "tmpfile");
+    const int err = dup(STDERR_FILENO);
+    fflush(stderr);
+    ensure(dup2(fileno(f), STDERR_FILENO) >= 0, "dup2");
+
+    util_log_async(0);
+    char s[] = "abc";
+    tlog("int %d str %s dbl %.2f u64 %" PRIu64 " pad %*d|%.*s| %%", -42, s,
+         3.14159, UINT64_MAX, 5, 7, 2, "xyz");
+    // the deferred message must have copied the string
+    s[0] = 'X';
+    // too many arguments to defer, formatted right away instead
+    tlog("%d %d %d %d %d %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8, 9,
+         10, 11, 12, 13);
+    pthread_t t;
+    ensure(pthread_create(&t, 0, logger, 0) == 0, "pthread_create");
+    pthread_join(t, 0);
+    for (uint_t i = 0; i < FLOOD; i++)
+        tlog("flood %u", i);
+    const bool empty = strlen(slurp(f)) == 0;
+    util_log_drain();
+
+    const char * const out = slurp(f);
+    const uint_t flood = count(out, "flood ");
+    const bool ok1 =
+        strstr(out, "int -42 str abc dbl 3.14 u64 18446744073709551615 pad"
+                    "     7|xy| %\n") &&
+        strstr(out, "1 2 3 4 5 6 7 8 9 10 11 12 13\n") &&
+        strstr(out, "thread done\n") && strstr(out, "deferred messages lost");
+
+    // now with a background drain thread
+    util_log_async(NS_PER_MS);
+    tlog("background");
+    for (uint_t i = 0; i < 1000 && count(slurp(f), "background") == 0; i++)
+        w_nanosleep(NS_PER_MS);
+    const bool ok2 = count(slurp(f), "background") == 1;
+    util_log_sync();
+
+    // restore stderr
+    fflush(stderr);
+    ensure(dup2(err, STDERR_FILENO) >= 0, "dup2");
+    close(err);
+    fputs(slurp(f), stderr);
+    fclose(f);
+
+    ensure(empty, "output deferred");
+    ensure(ok1, "deferred output correct");
+    ensure(flood > 0 && flood < FLOOD, "flood limited to ring, %u", flood);
+    ensure(ok2, "background drain");
+    return 0;
+}
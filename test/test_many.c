@@ -27,6 +27,7 @@
 
 #include <netinet/in.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <sys/socket.h>
 
 #include <warpcore/warpcore.h>
@@ -40,23 +41,47 @@ int main(void)
 
     // util_dlevel = WRN;
 
+#define MAX_SOCKS (64 * 1024)
+    struct w_sock ** const socks = calloc(MAX_SOCKS, sizeof(*socks));
+    ensure(socks, "could not calloc");
+
     int n = 0;
-    while (1) {
+    while (n < MAX_SOCKS) {
         struct w_sock * const s = w_bind(w_clnt, 0, 0, 0);
         if (s == 0)
             break;
+        socks[n] = s;
         w_connect(s, (struct sockaddr *)&(struct sockaddr_in6){
                          .sin6_family = AF_INET6,
                          .sin6_addr = IN6ADDR_LOOPBACK_INIT,
                          .sin6_port = bswap16(55555)});
-        if (w_connected(s) == false)
+        if (w_connected(s) == false) {
+            w_close(s);
             break;
+        }
         n++;
     }
 
     // util_dlevel = DBG;
 
     warn(WRN, "Was able to open %d connections", n);
+#ifdef WITH_ETH
+    // every ephemeral port but the one of s_clnt is in use exactly once
+    ensure(n == UINT16_MAX - 1024, "opened %d connections", n);
+
+    // ports can still be shared towards a different peer
+    struct w_sock * const s = w_bind(w_clnt, 0, 0, 0);
+    ensure(s, "bound");
+    w_connect(s, (struct sockaddr *)&(struct sockaddr_in6){
+                     .sin6_family = AF_INET6,
+                     .sin6_addr = IN6ADDR_LOOPBACK_INIT,
+                     .sin6_port = bswap16(55556)});
+    ensure(w_connected(s), "connected");
+    w_close(s);
+#endif
 
+    for (int i = 0; i < n; i++)
+        w_close(socks[i]);
+    free(socks);
     cleanup();
 }
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+// repeat with busy-polling, and check that an idle w_nic_rx() still times out
+// after spinning
+static void test_busy_poll(void)
+{
+    w_set_busy_poll(w_serv, 200 * NS_PER_US);
+    w_set_busy_poll(w_clnt, 200 * NS_PER_US);
+    test_io();
+    const uint64_t t = w_now(CLOCK_MONOTONIC);
+    ensure(w_nic_rx(w_serv, 0) == false, "no data");
+    ensure(w_nic_rx(w_serv, 5 * NS_PER_MS) == false, "no data");
+    ensure(w_now(CLOCK_MONOTONIC) - t < NS_PER_S, "timed out");
+    w_set_busy_poll(w_serv, 0);
+    w_set_busy_poll(w_clnt, 0);
+}
+
+
+// repeat with adaptive polling, and check that it still delivers datagrams
+// as they arrive, but stops spinning once the engine is idle
+static void test_adaptive_poll(void)
+{
+    w_set_adaptive_poll(w_serv, NS_PER_MS);
+    test_io();
+    for (uint_t n = 0; n < 10; n++) {
+        send_n(1, 64);
+        ensure(w_nic_rx(w_serv, 100 * NS_PER_MS), "data");
+        struct w_iov_sq i = w_iov_sq_initializer(i);
+        w_rx(s_serv, &i);
+        ensure(w_iov_sq_cnt(&i) == 1, "received w_iov");
+        w_free(&i);
+    }
+    w_nanosleep(2 * NS_PER_MS);
+    const uint64_t cpu = w_now(CLOCK_PROCESS_CPUTIME_ID);
+    ensure(w_nic_rx(w_serv, 20 * NS_PER_MS) == false, "no data");
+    ensure(w_now(CLOCK_PROCESS_CPUTIME_ID) - cpu < 10 * NS_PER_MS,
+           "idle w_nic_rx() did not spin");
+    w_set_adaptive_poll(w_serv, 0);
+}
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+    test_busy_poll();
+    test_adaptive_poll();
+    cleanup();
+}
@@ -132,6 +132,9 @@ static void con(void)
 {
     const int n1 = r(N);
     const int n2 = r(N);
+    if (n1 == n2)
+        // sq_concat() cannot concatenate a queue with itself
+        return;
     sq_concat(&sq[n1], &sq[n2]);
 
     len[n1] += len[n2];
@@ -195,4 +198,11 @@ int main(void)
             ini();
         }
     }
+
+    for (int i = 0; i < N; i++) {
+        struct elem * e;
+        struct elem * t;
+        sq_foreach_safe (e, &sq[i], next, t)
+            free(e);
+    }
 }
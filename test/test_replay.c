@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+#include "backend.h"
+#include "eth.h"
+#include "in_cksum.h"
+#include "ip4.h"
+#include "udp.h"
+
+
+#define N 10 ///< Number of frames in the input file.
+
+
+static const char in[] = "/tmp/test_replay.in.pcap";
+static const char out[] = "/tmp/test_replay.out.pcap";
+
+static const struct eth_addr peer_mac = {{0x02, 0, 0, 0, 0, 0x02}};
+
+
+// write a pcap file with N UDP/IPv4 datagrams from a peer to some other host,
+// one millisecond apart
+static void
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+    __attribute__((no_sanitize("alignment")))
+#endif
+    mk_input(void)
+{
+    FILE * const f = fopen(in, "wb");
+    ensure(f, "fopen");
+    const struct pcap_hdr h = {.magic = PCAP_MAGIC_US,
+                               .major = 2,
+                               .minor = 4,
+                               .snaplen = 65535,
+                               .link = PCAP_LINK_ETH};
+    ensure(fwrite(&h, sizeof(h), 1, f) == 1, "fwrite");
+
+    for (uint32_t i = 0; i < N; i++) {
+        uint8_t buf[128] __attribute__((aligned(8))) = {0};
+        struct eth_hdr * const eth = (void *)buf;
+        eth->dst = (struct eth_addr){{0x02, 0, 0, 0, 0, 0x09}};
+        eth->src = peer_mac;
+        eth->type = ETH_TYPE_IP4;
+
+        const uint16_t len =
+            sizeof(struct ip4_hdr) + sizeof(struct udp_hdr) + 32;
+        struct ip4_hdr * const ip = (void *)eth_data(buf);
+        ip->vhl = 0x45;
+        ip->len = bswap16(len);
+        ip->ttl = 64;
+        ip->p = IP_P_UDP;
+        ip->src = bswap32(0x0a000002);
+        ip->dst = bswap32(0x0a000009);
+        ip->cksum = ip_cksum(ip, sizeof(*ip));
+
+        struct udp_hdr * const udp = (void *)ip4_data(buf);
+        udp->sport = bswap16(44444);
+        udp->dport = bswap16(55555);
+        udp->len = bswap16(len - sizeof(*ip));
+        memset(udp + 1, 'a' + (int)i, 32);
+        udp->cksum = payload_cksum(ip, len);
+
+        const struct pcap_rec r = {.sec = 1,
+                                   .nsec = i * 1000,
+                                   .incl_len = sizeof(*eth) + len,
+                                   .orig_len = sizeof(*eth) + len};
+        ensure(fwrite(&r, sizeof(r), 1, f) == 1, "fwrite");
+        ensure(fwrite(buf, r.incl_len, 1, f) == 1, "fwrite");
+    }
+    fclose(f);
+}
+
+
+// receive until the replay is exhausted, echoing all datagrams
+static uint_t rx_echo(struct w_sock * const s, const int64_t nsec)
+{
+    uint_t n = 0;
+    while (w_nic_rx(s->w, nsec)) {
+        struct w_iov_sq i = w_iov_sq_initializer(i);
+        w_rx(s, &i);
+        n += w_iov_sq_cnt(&i);
+        w_tx(s, &i);
+        w_nic_tx(s->w);
+        w_free(&i);
+    }
+    return n;
+}
+
+
+int main(void)
+{
+    mk_input();
+    struct w_engine * const w = w_init("lo", 0, 1024);
+    struct w_sock * const s = w_bind(w, w->addr4_pos, bswap16(55555), 0);
+    ensure(s, "bound");
+
+    ensure(w_replay(w, "/nonexistent", 0, 0) == ENOENT, "no input");
+    ensure(w_replay(w, out, 0, 0) == ENOENT, "no input");
+
+    // retargeted, the datagrams reach the socket, and the echoes go to the
+    // peer learned from the input
+    ensure(w_replay(w, in, out,
+                    &(struct w_replay_opt){.loops = 2, .retarget = true}) == 0,
+           "replaying");
+    uint_t n = rx_echo(s, 0);
+    ensure(n == 2 * N, "%" PRIu " of %u datagrams received", n, 2 * N);
+    ensure(w_nic_rx(w, -1) == false, "replay exhausted");
+    ensure(w_replay(w, 0, 0, 0) == 0, "stopped");
+
+    FILE * const f = fopen(out, "rb");
+    ensure(f, "fopen");
+    struct pcap_hdr h;
+    ensure(fread(&h, sizeof(h), 1, f) == 1 && h.magic == PCAP_MAGIC_NS,
+           "pcap");
+    n = 0;
+    struct pcap_rec r;
+    uint8_t buf[2048];
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        ensure(r.incl_len <= sizeof(buf) && fread(buf, r.incl_len, 1, f) == 1,
+               "fread");
+        const struct eth_hdr * const eth = (const void *)buf;
+        ensure(memcmp(&eth->dst, &peer_mac, sizeof(peer_mac)) == 0,
+               "echo to peer");
+        n++;
+    }
+    fclose(f);
+    ensure(n == 2 * N, "%" PRIu " of %u datagrams echoed", n, 2 * N);
+
+    // without retargeting, the datagrams are not for us
+    ensure(w_replay(w, in, 0, 0) == 0, "replaying");
+    ensure(rx_echo(s, 0) == 0, "not for us");
+
+    // at the recorded pace, the replay takes as long as the recording
+    ensure(w_replay(w, in, 0,
+                    &(struct w_replay_opt){.timed = true, .retarget = true}) ==
+               0,
+           "replaying");
+    const uint64_t t = w_now(CLOCK_MONOTONIC);
+    n = 0;
+    while (n < N) {
+        n += rx_echo(s, 10 * NS_PER_MS);
+        ensure(w_now(CLOCK_MONOTONIC) - t < NS_PER_S, "timely");
+    }
+    ensure(w_now(CLOCK_MONOTONIC) - t >= (N - 1) * NS_PER_MS, "paced");
+
+    w_close(s);
+    w_cleanup(w);
+    unlink(in);
+    unlink(out);
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+#define SHARDS 2
+#define PORT 55556
+#define FLOWS 16
+
+
+int main(void)
+{
+    init(8 * 1024);
+
+#ifdef __linux__
+    // bind the same port on several engines, steering by receiving CPU
+    struct w_engine * w[SHARDS];
+    struct w_sock * s[SHARDS];
+    const struct w_sockopt opt = {.enable_reuseport = true,
+                                  .reuseport_shards = SHARDS};
+    for (uint_t i = 0; i < SHARDS; i++) {
+        w[i] = w_init("lo", 0, 1024);
+        ensure(w[i], "w_init %" PRIu, i);
+        s[i] = w_bind(w[i], 0, bswap16(PORT), &opt);
+        ensure(s[i], "w_bind %" PRIu, i);
+    }
+
+    // stay on this CPU, which then also receives the loopback traffic
+    const int cpu = sched_getcpu();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    ensure(sched_setaffinity(0, sizeof(set), &set) == 0, "sched_setaffinity");
+
+    // send one packet each over several flows, which the kernel would
+    // otherwise hash to different shards
+    for (uint_t f = 0; f < FLOWS; f++) {
+        struct w_sock * const c = w_bind(w_clnt, 0, 0, 0);
+        ensure(c, "w_bind client");
+        w_connect(c, (struct sockaddr *)&(struct sockaddr_in6){
+                         .sin6_family = AF_INET6,
+                         .sin6_addr = IN6ADDR_LOOPBACK_INIT,
+                         .sin6_port = bswap16(PORT)});
+        ensure(w_connected(c), "not connected");
+        struct w_iov_sq o = w_iov_sq_initializer(o);
+        w_alloc_cnt(w_clnt, c->ws_af, &o, 1, 64, 0);
+        w_tx(c, &o);
+        w_nic_tx(w_clnt);
+        w_free(&o);
+        w_close(c);
+    }
+
+    // all packets must have arrived at the shard of this CPU
+    for (uint_t i = 0; i < SHARDS; i++) {
+        struct w_iov_sq q = w_iov_sq_initializer(q);
+        w_nic_rx(w[i], 0);
+        w_rx(s[i], &q);
+        const uint_t want = i == (uint_t)cpu % SHARDS ? FLOWS : 0;
+        ensure(w_iov_sq_cnt(&q) == want,
+               "shard %" PRIu " got %" PRIu " pkts, want %" PRIu, i,
+               w_iov_sq_cnt(&q), want);
+        w_free(&q);
+        w_close(s[i]);
+        w_cleanup(w[i]);
+    }
+#endif
+
+    cleanup();
+}
@@ -36,12 +36,8 @@
 int main(void)
 {
     init(64 * 1024);
-    for (uint32_t i = 1; i <= 512; i <<= 1) {
-        if (io(i) == false) {
-            warn(INF, "test len %u failed", i);
-            break;
-        }
-        warn(INF, "test len %u ok", i);
-    }
+    test_io();
+    struct w_sock_slist sl = w_sock_slist_initializer(sl);
+    ensure(w_rx_ready(w_serv, &sl) == 0 && sl_empty(&sl), "all data read");
     cleanup();
 }
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef WITH_URING
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+// check that the packet counters saw the test traffic
+static void test_stats(void)
+{
+    struct w_stats clnt;
+    struct w_stats serv;
+    struct w_stats eng;
+    w_get_stats(w_clnt, s_clnt, &clnt);
+    w_get_stats(w_serv, s_serv, &serv);
+    w_get_stats(w_serv, 0, &eng);
+    ensure(clnt.tx_pkts && clnt.tx_bytes, "client TX counted");
+    ensure(serv.rx_pkts && serv.rx_pkts <= clnt.tx_pkts, "server RX counted");
+    ensure(eng.rx_pkts >= serv.rx_pkts && eng.rx_bytes >= serv.rx_bytes,
+           "engine RX counted");
+
+#ifdef WITH_ETH
+    // a datagram to a port nobody is bound to is dropped and counted
+    struct w_sock * const s = w_bind(w_clnt, w_clnt->addr4_pos, 0, 0);
+    w_connect(s, (struct sockaddr *)&(struct sockaddr_in){
+                     .sin_family = AF_INET,
+                     .sin_addr = {w_serv->ifaddr[w_serv->addr4_pos].addr.ip4},
+                     .sin_port = bswap16(55556)});
+    struct w_iov_sq o = w_iov_sq_initializer(o);
+    w_alloc_cnt(w_clnt, s->ws_af, &o, 1, 64, 0);
+    w_tx(s, &o);
+    w_nic_tx(w_clnt);
+    serv = eng;
+    for (uint_t n = 0;
+         n < 100 && serv.drop[W_DROP_NO_SOCK] == eng.drop[W_DROP_NO_SOCK];
+         n++) {
+        w_nic_rx(w_serv, NS_PER_MS);
+        w_get_stats(w_serv, 0, &serv);
+    }
+    ensure(serv.drop[W_DROP_NO_SOCK] == eng.drop[W_DROP_NO_SOCK] + 1,
+           "drop counted");
+    w_free(&o);
+    w_close(s);
+#endif
+
+#ifdef WITH_URING
+    // a datagram that does not fit into a w_iov is dropped and counted
+    const int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    ensure(fd >= 0, "socket");
+    static uint8_t big[4096];
+    ensure(sendto(fd, big, sizeof(big), 0,
+                  (struct sockaddr *)&(struct sockaddr_in6){
+                      .sin6_family = AF_INET6,
+                      .sin6_addr = IN6ADDR_LOOPBACK_INIT,
+                      .sin6_port = bswap16(55555)},
+                  sizeof(struct sockaddr_in6)) == sizeof(big),
+           "sendto");
+    close(fd);
+    serv = eng;
+    for (uint_t n = 0;
+         n < 100 && serv.drop[W_DROP_TRUNC] == eng.drop[W_DROP_TRUNC]; n++) {
+        w_nic_rx(w_serv, NS_PER_MS);
+        w_get_stats(w_serv, 0, &serv);
+    }
+    ensure(serv.drop[W_DROP_TRUNC] == eng.drop[W_DROP_TRUNC] + 1,
+           "truncation counted");
+    struct w_sock_slist sl = w_sock_slist_initializer(sl);
+    ensure(w_rx_ready(w_serv, &sl) == 0, "truncated datagram not delivered");
+#endif
+}
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+    test_stats();
+    cleanup();
+}
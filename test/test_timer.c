@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+#define N 8
+#define REPEAT 3
+
+
+static struct w_timer t[N];
+static uint64_t fired[N];
+static uint_t fired_cnt;
+static uint_t repeat_cnt;
+
+
+static void on_timer(struct w_timer * const tm, void * const data)
+{
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    ensure(now >= tm->expiry, "timer %" PRIu " fired %" PRIu64 " ns early",
+           (uint_t)(uintptr_t)data, tm->expiry - now);
+    ensure(w_timer_pending(tm) == false, "timer not pending in callback");
+    fired[fired_cnt++] = tm->expiry;
+}
+
+
+static void on_repeat(struct w_timer * const tm,
+                      void * const data __attribute__((unused)))
+{
+    if (++repeat_cnt < REPEAT)
+        w_timer_add(w_serv, tm, tm->expiry + 500 * NS_PER_US, on_repeat, 0);
+}
+
+
+int main(void)
+{
+    init(1024);
+
+    // expiries spanning several levels of the wheel, in random order, plus one
+    // that is already due
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    const uint64_t at[N] = {now + 3 * NS_PER_MS,   now + 200 * NS_PER_US,
+                            now + 70 * NS_PER_MS,  now + 1 * NS_PER_MS,
+                            now - 1 * NS_PER_MS,   now + 2500 * NS_PER_US,
+                            now + 150 * NS_PER_MS, now + 20 * NS_PER_MS};
+    for (uint_t i = 0; i < N; i++)
+        w_timer_add(w_serv, &t[i], at[i], on_timer, (void *)(uintptr_t)i);
+
+    // a timer beyond the span of the wheel, and one to cancel
+    struct w_timer far = {0};
+    w_timer_add(w_serv, &far, now + 48 * 3600 * NS_PER_S, on_timer, 0);
+    struct w_timer cancel = {0};
+    w_timer_add(w_serv, &cancel, now + 5 * NS_PER_MS, on_timer, 0);
+    ensure(w_timer_pending(&cancel), "timer pending");
+    w_timer_cancel(w_serv, &cancel);
+    ensure(w_timer_pending(&cancel) == false, "timer cancelled");
+
+    // a timer that re-arms itself, and one that is rescheduled
+    struct w_timer rep = {0};
+    w_timer_add(w_serv, &rep, now + 500 * NS_PER_US, on_repeat, 0);
+    w_timer_add(w_serv, &t[7], now + 30 * NS_PER_MS, on_timer, (void *)7);
+
+    // w_nic_rx() must return whenever a timer is due, even without data
+    for (uint_t n = 0; (fired_cnt < N || repeat_cnt < REPEAT) && n < 10000;
+         n++)
+        w_nic_rx(w_serv, -1);
+    ensure(fired_cnt == N, "%" PRIu " of %" PRIu " timers fired", fired_cnt,
+           N);
+    ensure(repeat_cnt == REPEAT, "repeating timer fired %" PRIu " times",
+           repeat_cnt);
+    for (uint_t i = 1; i < N; i++)
+        ensure(fired[i - 1] <= fired[i], "timers fired in order");
+    ensure(w_now(CLOCK_MONOTONIC) - now < 10 * NS_PER_S, "timers were timely");
+
+    ensure(w_timer_pending(&far), "far timer still pending");
+    w_timer_cancel(w_serv, &far);
+    cleanup();
+}
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/param.h>
+#include <unistd.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+// check that the trace ring records the test traffic, and saves it
+static void test_trace(void)
+{
+    w_set_trace(w_serv, 1000);
+    w_set_trace(w_clnt, 1000);
+    test_io();
+
+    // each backend runs this test, possibly at the same time
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_trace.%d", getpid());
+    ensure(w_trace_save(w_serv, path) == 0, "saved");
+    FILE * const f = fopen(path, "rb");
+    ensure(f, "fopen");
+    struct w_trace_hdr h;
+    ensure(fread(&h, sizeof(h), 1, f) == 1, "fread");
+    ensure(h.magic == W_TRACE_MAGIC && h.cnt == MIN(1024, h.cnt + h.lost),
+           "header");
+    ensure(h.ns1 >= h.ns0, "calibrated");
+    bool rx = false;
+    struct w_trace_ent e;
+    while (fread(&e, sizeof(e), 1, f) == 1)
+        rx |= e.type == W_TRACE_RX;
+    fclose(f);
+    unlink(path);
+    ensure(rx, "RX traced");
+
+    w_set_trace(w_serv, 0);
+    w_set_trace(w_clnt, 0);
+    ensure(w_trace_save(w_serv, path) == EINVAL, "disabled");
+}
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+    test_trace();
+    cleanup();
+}
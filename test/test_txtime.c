@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+// send a w_iov with a departure time in the future, and free it right away
+static void test_txtime(void)
+{
+    const struct w_sockopt opt = s_clnt->opt;
+    w_set_sockopt(s_clnt, &(struct w_sockopt){.enable_txtime = true});
+
+    struct w_iov_sq o = w_iov_sq_initializer(o);
+    w_alloc_cnt(w_clnt, s_clnt->ws_af, &o, 1, 64, 0);
+    ensure(w_iov_sq_cnt(&o) == 1, "got w_iov");
+    struct w_iov * const v = sq_first(&o);
+    const uint64_t t = w_now(CLOCK_MONOTONIC) + 50 * NS_PER_MS;
+    v->txtime = t;
+    w_tx(s_clnt, &o);
+    w_nic_tx(w_clnt);
+#ifdef WITH_ETH
+    // the raw-Ethernet backends hold it back themselves
+    ensure(w_tx_pending(v), "w_iov held back");
+#endif
+    w_free(&o);
+
+    struct w_iov_sq i = w_iov_sq_initializer(i);
+    for (uint_t n = 0; sq_empty(&i) && n < 1000; n++) {
+        w_nic_tx(w_clnt);
+        w_nic_rx(w_serv, NS_PER_MS);
+        w_rx(s_serv, &i);
+    }
+    ensure(w_iov_sq_cnt(&i) == 1, "received w_iov");
+#ifdef WITH_ETH
+    ensure(w_now(CLOCK_MONOTONIC) >= t, "w_iov not sent early");
+#endif
+    w_free(&i);
+    w_set_sockopt(s_clnt, &opt);
+}
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+
+    // make sure the freed w_iov returns to the pool once it has been sent
+    const uint_t nfree = w_iov_sq_cnt(&w_clnt->iov);
+    test_txtime();
+    for (uint_t n = 0; w_iov_sq_cnt(&w_clnt->iov) < nfree && n < 1000; n++) {
+        w_nanosleep(NS_PER_MS);
+        w_nic_tx(w_clnt);
+    }
+    ensure(w_iov_sq_cnt(&w_clnt->iov) == nfree, "%" PRIu " != %" PRIu " bufs",
+           w_iov_sq_cnt(&w_clnt->iov), nfree);
+    cleanup();
+}
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+
+    // w_iovs freed while their transmission is still in flight must be held
+    // back, and return to the pool once it has completed
+    const uint_t nfree = w_iov_sq_cnt(&w_clnt->iov);
+    struct w_iov_sq o = w_iov_sq_initializer(o);
+    w_alloc_cnt(w_clnt, s_clnt->ws_af, &o, 8, 512, 0);
+    w_tx(s_clnt, &o);
+    ensure(w_tx_pending(sq_first(&o)), "send in flight");
+    w_free(&o);
+    ensure(w_iov_sq_cnt(&w_clnt->iov) == nfree - 8, "w_iovs held back");
+    uint_t got;
+    recv_n(8, NS_PER_S, &got);
+    ensure(got == 8, "got %" PRIu " of 8", got);
+    for (uint_t n = 0; w_iov_sq_cnt(&w_clnt->iov) < nfree && n < 1000; n++) {
+        w_nanosleep(NS_PER_MS);
+        w_nic_tx(w_clnt);
+    }
+    ensure(w_iov_sq_cnt(&w_clnt->iov) == nfree, "%" PRIu " != %" PRIu " bufs",
+           w_iov_sq_cnt(&w_clnt->iov), nfree);
+
+    // a datagram that fails to send must not take the rest of the batch with
+    // it; port zero makes the kernel reject the second one
+    struct w_stats st;
+    w_get_stats(w_clnt, 0, &st);
+    struct w_sock * const s = w_bind(w_clnt, 0, 0, 0);
+    w_alloc_cnt(w_clnt, s->ws_af, &o, 3, 512, 0);
+    struct w_iov * v;
+    sq_foreach (v, &o, next)
+        v->saddr = s_clnt->tup.remote;
+    sq_next(sq_first(&o), next)->wv_port = 0;
+    w_tx(s, &o);
+    w_free(&o);
+    recv_n(2, NS_PER_S, &got);
+    ensure(got == 2, "got %" PRIu " of 2", got);
+    struct w_stats st2;
+    w_get_stats(w_clnt, 0, &st2);
+    ensure(st2.drop[W_DROP_TX_ERR] == st.drop[W_DROP_TX_ERR] + 1,
+           "failed send counted");
+    w_close(s);
+    cleanup();
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2022, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <warpcore/warpcore.h>
+
+#include "common.h"
+
+
+int main(void)
+{
+    init(64 * 1024);
+    test_io();
+
+    // repeat with zero-copy TX on the client, and make sure all w_iovs return
+    // to the pool once the kernel has released them
+    const uint_t nfree = w_iov_sq_cnt(&w_clnt->iov);
+    w_set_sockopt(s_clnt, &(struct w_sockopt){.enable_ecn = true,
+                                              .enable_zerocopy = true});
+    test_io();
+    for (uint_t n = 0; w_iov_sq_cnt(&w_clnt->iov) < nfree && n < 1000; n++) {
+        w_nanosleep(NS_PER_MS);
+        w_nic_tx(w_clnt);
+    }
+    ensure(w_iov_sq_cnt(&w_clnt->iov) == nfree, "%" PRIu " != %" PRIu " bufs",
+           w_iov_sq_cnt(&w_clnt->iov), nfree);
+    cleanup();
+}